@@ -0,0 +1,97 @@
+#include <rcl/allocator.h>
+#include <stdlib.h>
+
+static void *_libc_alloc(__attribute__((unused)) void *ctx, size_t size) {
+  return malloc(size);
+}
+
+static void *_libc_realloc(__attribute__((unused)) void *ctx, void *ptr,
+                           size_t size) {
+  return realloc(ptr, size);
+}
+
+static void _libc_free(__attribute__((unused)) void *ctx, void *ptr) {
+  free(ptr);
+}
+
+const rcl_allocator_t rcl_libc_allocator = {
+    .alloc = _libc_alloc,
+    .realloc = _libc_realloc,
+    .free = _libc_free,
+    .ctx = NULL,
+};
+
+// The counting allocator prefixes every block with its size so that frees and
+// reallocations can keep `live_bytes` accurate. The union keeps the block
+// that follows aligned for any type.
+typedef union {
+  size_t size;
+  long double ld;
+  long long ll;
+  void *ptr;
+} counting_header_t;
+
+static void _counting_grew(rcl_counting_allocator_t *self, size_t size) {
+  self->bytes += size;
+  self->live_bytes += size;
+  if (self->live_bytes > self->peak_bytes)
+    self->peak_bytes = self->live_bytes;
+}
+
+static void *_counting_alloc(void *ctx, size_t size) {
+  rcl_counting_allocator_t *self = ctx;
+  counting_header_t *header =
+      rcl_alloc(self->parent, sizeof(*header) + size);
+  header->size = size;
+  self->allocations++;
+  _counting_grew(self, size);
+  return header + 1;
+}
+
+static void *_counting_realloc(void *ctx, void *ptr, size_t size) {
+  rcl_counting_allocator_t *self = ctx;
+  if (!ptr)
+    return _counting_alloc(ctx, size);
+
+  counting_header_t *header = (counting_header_t *)ptr - 1;
+  size_t old_size = header->size;
+  header = rcl_realloc(self->parent, header, sizeof(*header) + size);
+  header->size = size;
+  self->reallocations++;
+  self->live_bytes -= old_size;
+  _counting_grew(self, size);
+  return header + 1;
+}
+
+static void _counting_free(void *ctx, void *ptr) {
+  rcl_counting_allocator_t *self = ctx;
+  if (!ptr)
+    return;
+
+  counting_header_t *header = (counting_header_t *)ptr - 1;
+  self->frees++;
+  self->live_bytes -= header->size;
+  rcl_free(self->parent, header);
+}
+
+void rcl_counting_allocator_init(rcl_counting_allocator_t *self,
+                                 const rcl_allocator_t *parent) {
+  *self = (rcl_counting_allocator_t){
+      .allocator =
+          {
+              .alloc = _counting_alloc,
+              .realloc = _counting_realloc,
+              .free = _counting_free,
+              .ctx = self,
+          },
+      .parent = parent,
+  };
+}
+
+void rcl_counting_allocator_reset(rcl_counting_allocator_t *self) {
+  self->allocations = 0;
+  self->reallocations = 0;
+  self->frees = 0;
+  self->bytes = 0;
+  self->peak_bytes = self->live_bytes;
+}
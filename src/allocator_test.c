@@ -0,0 +1,102 @@
+#include <rcl/allocator.h>
+#include "unity.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static void test_counting_allocator_counts(void) {
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+  const rcl_allocator_t *allocator = &counter.allocator;
+
+  char *a = rcl_alloc(allocator, 10);
+  char *b = rcl_calloc(allocator, 4, 8);
+  TEST_ASSERT_EQUAL_size_t(2, counter.allocations);
+  TEST_ASSERT_EQUAL_size_t(42, counter.live_bytes);
+
+  for (size_t i = 0; i < 32; i++)
+    TEST_ASSERT_EQUAL_CHAR(0, b[i]);
+
+  memset(a, 'x', 10);
+  a = rcl_realloc(allocator, a, 100);
+  TEST_ASSERT_EQUAL_CHAR('x', a[9]);
+  TEST_ASSERT_EQUAL_size_t(1, counter.reallocations);
+  TEST_ASSERT_EQUAL_size_t(132, counter.live_bytes);
+  TEST_ASSERT_EQUAL_size_t(142, counter.bytes);
+
+  rcl_free(allocator, a);
+  rcl_free(allocator, b);
+  rcl_free(allocator, NULL);
+  TEST_ASSERT_EQUAL_size_t(2, counter.frees);
+  TEST_ASSERT_EQUAL_size_t(0, counter.live_bytes);
+  TEST_ASSERT_EQUAL_size_t(132, counter.peak_bytes);
+}
+
+static void test_counting_allocator_alignment(void) {
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+
+  for (size_t size = 1; size < 64; size++) {
+    void *ptr = rcl_alloc(&counter.allocator, size);
+    TEST_ASSERT_EQUAL(0, (uintptr_t)ptr % sizeof(void *));
+    rcl_free(&counter.allocator, ptr);
+  }
+}
+
+static void test_counting_allocator_parent(void) {
+  rcl_counting_allocator_t outer, inner;
+  rcl_counting_allocator_init(&outer, &rcl_libc_allocator);
+  rcl_counting_allocator_init(&inner, &outer.allocator);
+
+  char *str = rcl_strdup(&inner.allocator, "hello");
+  TEST_ASSERT_EQUAL_STRING("hello", str);
+  TEST_ASSERT_EQUAL_size_t(1, inner.allocations);
+  TEST_ASSERT_EQUAL_size_t(6, inner.live_bytes);
+  TEST_ASSERT_EQUAL_size_t(1, outer.allocations);
+  // The outer allocator also sees the inner one's size header.
+  TEST_ASSERT_TRUE(outer.live_bytes > inner.live_bytes);
+
+  rcl_free(&inner.allocator, str);
+  TEST_ASSERT_EQUAL_size_t(0, inner.live_bytes);
+  TEST_ASSERT_EQUAL_size_t(0, outer.live_bytes);
+
+  str = rcl_strndup(NULL, "hello", 3);
+  TEST_ASSERT_EQUAL_STRING("hel", str);
+  rcl_free(NULL, str);
+  str = rcl_strndup(NULL, "hi", 16);
+  TEST_ASSERT_EQUAL_STRING("hi", str);
+  rcl_free(NULL, str);
+}
+
+static void test_counting_allocator_reset(void) {
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+
+  void *a = rcl_alloc(&counter.allocator, 16);
+  void *b = rcl_alloc(&counter.allocator, 16);
+  rcl_free(&counter.allocator, b);
+
+  rcl_counting_allocator_reset(&counter);
+  TEST_ASSERT_EQUAL_size_t(0, counter.allocations);
+  TEST_ASSERT_EQUAL_size_t(0, counter.frees);
+  TEST_ASSERT_EQUAL_size_t(16, counter.live_bytes);
+  TEST_ASSERT_EQUAL_size_t(16, counter.peak_bytes);
+
+  rcl_free(&counter.allocator, a);
+  TEST_ASSERT_EQUAL_size_t(0, counter.live_bytes);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_counting_allocator_counts);
+  RUN_TEST(test_counting_allocator_alignment);
+  RUN_TEST(test_counting_allocator_parent);
+  RUN_TEST(test_counting_allocator_reset);
+
+  return UNITY_END();
+}
@@ -4,14 +4,15 @@
 #include <string.h>
 
 array_t *array_new_full(array_init_t init) {
-  array_t *array = malloc(sizeof(array_t));
+  array_t *array = rcl_alloc(init.allocator, sizeof(array_t));
 
   *array = (array_t){
-      .data = malloc(init.capacity * init.item_size),
+      .data = rcl_alloc(init.allocator, init.capacity * init.item_size),
       .capacity = init.capacity,
       .length = 0,
       .item_size = init.item_size,
       .free_func = init.free_func,
+      .allocator = init.allocator,
   };
 
   return array;
@@ -48,8 +49,8 @@ void array_free(array_t *arr) {
     }
   }
 
-  free(arr->data);
-  free(arr);
+  rcl_free(arr->allocator, arr->data);
+  rcl_free(arr->allocator, arr);
 }
 
 __attribute__((always_inline)) inline void array_destroy(array_t **arr) {
@@ -281,6 +281,25 @@ static void array_test_filter_copy2(void) {
   array_destroy(&copy);
 }
 
+static void array_uses_allocator(void) {
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+
+  array_t *arr = array_new(int, .capacity = 2, .allocator = &counter.allocator);
+  for (int i = 0; i < 100; i++)
+    array_push(arr, i);
+  TEST_ASSERT_EQUAL_size_t(2, counter.allocations);
+  TEST_ASSERT_TRUE(counter.reallocations > 0);
+
+  array_t *doubled = array_map(arr, int, int, map_double);
+  TEST_ASSERT_EQUAL_PTR(&counter.allocator, doubled->allocator);
+  TEST_ASSERT_EQUAL(198, ((int *)doubled->data)[99]);
+
+  array_destroy(&arr);
+  array_destroy(&doubled);
+  TEST_ASSERT_EQUAL_size_t(0, counter.live_bytes);
+}
+
 int main(void) {
   UNITY_BEGIN();
 
@@ -297,6 +316,7 @@ int main(void) {
   RUN_TEST(array_test_filter);
   RUN_TEST(array_test_filter_copy);
   RUN_TEST(array_test_filter_copy2);
+  RUN_TEST(array_uses_allocator);
 
   return UNITY_END();
 }
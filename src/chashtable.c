@@ -0,0 +1,355 @@
+#include <assert.h>
+#include <rcl/chashtable.h>
+#include <sched.h>
+#include <string.h>
+
+#ifndef CHASHTABLE_DEFAULT_CAPACITY
+#define CHASHTABLE_DEFAULT_CAPACITY 1024
+#endif
+
+// Entries are singly linked per bucket. Readers walk the lists without locks,
+// so a published entry never changes except for its `value` (swapped
+// atomically) and `next` (when the entry after it is unlinked).
+struct s_chashtable_node {
+  chashtable_node_t *next;
+  void *value;
+  size_t hash;
+  char key[];
+};
+
+struct s_chashtable_buckets {
+  size_t capacity;
+  chashtable_node_t *heads[];
+};
+
+// A pointer waiting for a grace period: an entry, a bucket array, or a value
+// for `free_func`.
+struct s_chashtable_retired {
+  void *ptr;
+  bool is_value;
+};
+
+#define load_acquire(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define store_release(ptr, val) __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+
+// The reader counter shard of the calling thread, plus one; 0 until the thread
+// first reads.
+static __thread unsigned _reader_shard;
+static unsigned _next_reader_shard;
+
+static inline unsigned _chashtable_shard(void) {
+  if (!_reader_shard) {
+    _reader_shard = __atomic_fetch_add(&_next_reader_shard, 1,
+                                       __ATOMIC_RELAXED) %
+                        CHASHTABLE_READER_SHARDS +
+                    1;
+  }
+  return _reader_shard - 1;
+}
+
+static chashtable_buckets_t *_chashtable_buckets_new(chashtable_t *self,
+                                                     size_t capacity) {
+  chashtable_buckets_t *buckets = rcl_alloc(
+      self->allocator, sizeof(*buckets) + capacity * sizeof(*buckets->heads));
+  buckets->capacity = capacity;
+  memset(buckets->heads, 0, capacity * sizeof(*buckets->heads));
+  return buckets;
+}
+
+static chashtable_node_t *_chashtable_node_new(chashtable_t *self,
+                                               const char *key, size_t hash,
+                                               void *value) {
+  size_t length = strlen(key);
+  chashtable_node_t *node =
+      rcl_alloc(self->allocator, sizeof(*node) + length + 1);
+  node->next = NULL;
+  node->value = value;
+  node->hash = hash;
+  memcpy(node->key, key, length + 1);
+  return node;
+}
+
+chashtable_t *chashtable_new(void) {
+  return chashtable_new_full(
+      (chashtable_init_t){.capacity = CHASHTABLE_DEFAULT_CAPACITY});
+}
+
+chashtable_t *chashtable_new_full(chashtable_init_t init) {
+  chashtable_t *self = rcl_alloc(init.allocator, sizeof(*self));
+  memset(self, 0, sizeof(*self));
+  self->free_func = init.free_func;
+  self->hash_func = init.hash_func ? init.hash_func : &hashtable_hash_wyhash;
+  self->allocator = init.allocator;
+
+  // Every bucket must belong to a single stripe.
+  size_t capacity = CHASHTABLE_STRIPES;
+  while (capacity < init.capacity)
+    capacity <<= 1;
+  self->buckets = _chashtable_buckets_new(self, capacity);
+
+  for (size_t i = 0; i < CHASHTABLE_STRIPES; i++)
+    pthread_mutex_init(&self->stripes[i].lock, NULL);
+  pthread_mutex_init(&self->retired_lock, NULL);
+  pthread_mutex_init(&self->grace_lock, NULL);
+
+  return self;
+}
+
+static void _chashtable_free_retired(chashtable_t *self,
+                                     chashtable_retired_t *retired,
+                                     size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (!retired[i].is_value)
+      rcl_free(self->allocator, retired[i].ptr);
+    else if (self->free_func)
+      self->free_func(retired[i].ptr);
+  }
+}
+
+void chashtable_free(chashtable_t *self) {
+  if (!self)
+    return;
+
+  chashtable_buckets_t *buckets = self->buckets;
+  for (size_t i = 0; i < buckets->capacity; i++) {
+    chashtable_node_t *node = buckets->heads[i];
+    while (node) {
+      chashtable_node_t *next = node->next;
+      if (self->free_func && node->value)
+        self->free_func(node->value);
+      rcl_free(self->allocator, node);
+      node = next;
+    }
+  }
+  rcl_free(self->allocator, buckets);
+
+  _chashtable_free_retired(self, self->retired, self->retired_length);
+  rcl_free(self->allocator, self->retired);
+
+  for (size_t i = 0; i < CHASHTABLE_STRIPES; i++)
+    pthread_mutex_destroy(&self->stripes[i].lock);
+  pthread_mutex_destroy(&self->retired_lock);
+  pthread_mutex_destroy(&self->grace_lock);
+
+  rcl_free(self->allocator, self);
+}
+
+void chashtable_destroy(chashtable_t **self) {
+  if (self) {
+    chashtable_free(*self);
+    *self = NULL;
+  }
+}
+
+// Read sections and grace periods, after SRCU. A reader increments the counter
+// of its shard at `reader_index` and decrements the same counter when done. A
+// grace period flips `reader_index` and waits for the old side to drain, twice,
+// so that readers which read the old index just before a flip are waited for
+// too. Anything unlinked before a grace period is unreachable after it.
+
+chashtable_guard_t chashtable_read_begin(chashtable_t *self) {
+  unsigned index = __atomic_load_n(&self->reader_index, __ATOMIC_SEQ_CST);
+  // A full barrier: the increment is visible before any entry is read.
+  __atomic_fetch_add(&self->readers[_chashtable_shard()].count[index], 1,
+                     __ATOMIC_SEQ_CST);
+  return index;
+}
+
+void chashtable_read_end(chashtable_t *self, chashtable_guard_t guard) {
+  __atomic_fetch_sub(&self->readers[_chashtable_shard()].count[guard], 1,
+                     __ATOMIC_RELEASE);
+}
+
+static void _chashtable_wait_readers(chashtable_t *self, unsigned index) {
+  for (;;) {
+    long readers = 0;
+    for (size_t i = 0; i < CHASHTABLE_READER_SHARDS; i++)
+      readers += __atomic_load_n(&self->readers[i].count[index],
+                                 __ATOMIC_ACQUIRE);
+    if (readers == 0)
+      return;
+    sched_yield();
+  }
+}
+
+static void _chashtable_synchronize(chashtable_t *self) {
+  pthread_mutex_lock(&self->grace_lock);
+  for (int pass = 0; pass < 2; pass++) {
+    unsigned index = self->reader_index;
+    __atomic_store_n(&self->reader_index, index ^ 1, __ATOMIC_SEQ_CST);
+    // Pairs with the barrier in `chashtable_read_begin`: a reader whose
+    // increment we miss has to see everything unlinked before this point.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    _chashtable_wait_readers(self, index);
+  }
+  pthread_mutex_unlock(&self->grace_lock);
+}
+
+// Queue a pointer to be freed after a grace period. Returns true if a batch is
+// ready for `_chashtable_reclaim`.
+static bool _chashtable_retire(chashtable_t *self, void *ptr, bool is_value) {
+  pthread_mutex_lock(&self->retired_lock);
+  if (self->retired_length == self->retired_capacity) {
+    self->retired_capacity =
+        self->retired_capacity ? self->retired_capacity * 2
+                               : CHASHTABLE_RETIRE_BATCH;
+    self->retired =
+        rcl_realloc(self->allocator, self->retired,
+                    self->retired_capacity * sizeof(*self->retired));
+  }
+  self->retired[self->retired_length++] =
+      (chashtable_retired_t){.ptr = ptr, .is_value = is_value};
+  bool full = self->retired_length >= CHASHTABLE_RETIRE_BATCH;
+  pthread_mutex_unlock(&self->retired_lock);
+  return full;
+}
+
+// Free everything retired so far once a grace period has passed. Writers call
+// this after releasing their stripe, so only they wait; readers never do.
+static void _chashtable_reclaim(chashtable_t *self) {
+  pthread_mutex_lock(&self->retired_lock);
+  chashtable_retired_t *retired = self->retired;
+  size_t length = self->retired_length;
+  self->retired = NULL;
+  self->retired_length = 0;
+  self->retired_capacity = 0;
+  pthread_mutex_unlock(&self->retired_lock);
+
+  if (length > 0) {
+    _chashtable_synchronize(self);
+    _chashtable_free_retired(self, retired, length);
+  }
+  rcl_free(self->allocator, retired);
+}
+
+static chashtable_node_t *_chashtable_find(chashtable_buckets_t *buckets,
+                                           const char *key, size_t hash) {
+  chashtable_node_t *node =
+      load_acquire(&buckets->heads[hash & (buckets->capacity - 1)]);
+  for (; node; node = load_acquire(&node->next)) {
+    if (node->hash == hash && strcmp(node->key, key) == 0)
+      return node;
+  }
+  return NULL;
+}
+
+void *chashtable_get(chashtable_t *self, const char *key) {
+  size_t hash = self->hash_func(key);
+  chashtable_node_t *node =
+      _chashtable_find(load_acquire(&self->buckets), key, hash);
+  return node ? load_acquire(&node->value) : NULL;
+}
+
+bool chashtable_exists(chashtable_t *self, const char *key) {
+  size_t hash = self->hash_func(key);
+  chashtable_guard_t guard = chashtable_read_begin(self);
+  bool exists = _chashtable_find(load_acquire(&self->buckets), key, hash);
+  chashtable_read_end(self, guard);
+  return exists;
+}
+
+size_t chashtable_length(chashtable_t *self) {
+  size_t length = 0;
+  for (size_t i = 0; i < CHASHTABLE_STRIPES; i++)
+    length += __atomic_load_n(&self->stripes[i].length, __ATOMIC_RELAXED);
+  return length;
+}
+
+// Double the bucket array once there are more entries than buckets. The
+// entries are copied, not relinked, so readers still walking the old array see
+// it unchanged; it is retired like everything else.
+static void _chashtable_grow(chashtable_t *self) {
+  for (size_t i = 0; i < CHASHTABLE_STRIPES; i++)
+    pthread_mutex_lock(&self->stripes[i].lock);
+
+  chashtable_buckets_t *old = self->buckets;
+  bool reclaim = false;
+
+  // Another writer may have grown the table while we waited for the locks.
+  if (chashtable_length(self) > old->capacity) {
+    chashtable_buckets_t *buckets =
+        _chashtable_buckets_new(self, old->capacity * 2);
+    size_t mask = buckets->capacity - 1;
+
+    for (size_t i = 0; i < old->capacity; i++) {
+      for (chashtable_node_t *node = old->heads[i]; node; node = node->next) {
+        chashtable_node_t *copy =
+            _chashtable_node_new(self, node->key, node->hash, node->value);
+        copy->next = buckets->heads[node->hash & mask];
+        buckets->heads[node->hash & mask] = copy;
+        reclaim |= _chashtable_retire(self, node, false);
+      }
+    }
+    store_release(&self->buckets, buckets);
+    reclaim |= _chashtable_retire(self, old, false);
+  }
+
+  for (size_t i = CHASHTABLE_STRIPES; i-- > 0;)
+    pthread_mutex_unlock(&self->stripes[i].lock);
+
+  if (reclaim)
+    _chashtable_reclaim(self);
+}
+
+void chashtable_set(chashtable_t *self, const char *key, void *value) {
+  size_t hash = self->hash_func(key);
+  __auto_type stripe = &self->stripes[hash & (CHASHTABLE_STRIPES - 1)];
+  bool reclaim = false;
+  bool grow = false;
+
+  pthread_mutex_lock(&stripe->lock);
+  chashtable_buckets_t *buckets = self->buckets;
+  chashtable_node_t *node = _chashtable_find(buckets, key, hash);
+
+  if (node) {
+    void *old = __atomic_exchange_n(&node->value, value, __ATOMIC_ACQ_REL);
+    pthread_mutex_unlock(&stripe->lock);
+    if (old && self->free_func)
+      reclaim = _chashtable_retire(self, old, true);
+  } else {
+    node = _chashtable_node_new(self, key, hash, value);
+    chashtable_node_t **head = &buckets->heads[hash & (buckets->capacity - 1)];
+    node->next = *head;
+    store_release(head, node);
+    size_t length = stripe->length + 1;
+    __atomic_store_n(&stripe->length, length, __ATOMIC_RELAXED);
+    // Stripes fill evenly, so this one's share estimates the total.
+    grow = length * CHASHTABLE_STRIPES > buckets->capacity;
+    pthread_mutex_unlock(&stripe->lock);
+  }
+
+  if (grow)
+    _chashtable_grow(self);
+  if (reclaim)
+    _chashtable_reclaim(self);
+}
+
+bool chashtable_delete(chashtable_t *self, const char *key) {
+  size_t hash = self->hash_func(key);
+  __auto_type stripe = &self->stripes[hash & (CHASHTABLE_STRIPES - 1)];
+
+  pthread_mutex_lock(&stripe->lock);
+  chashtable_buckets_t *buckets = self->buckets;
+  chashtable_node_t **link = &buckets->heads[hash & (buckets->capacity - 1)];
+
+  for (chashtable_node_t *node = *link; node; node = *link) {
+    if (node->hash == hash && strcmp(node->key, key) == 0) {
+      // Readers on `node` can still follow its `next`.
+      store_release(link, node->next);
+      __atomic_store_n(&stripe->length, stripe->length - 1, __ATOMIC_RELAXED);
+      pthread_mutex_unlock(&stripe->lock);
+
+      bool reclaim = false;
+      if (node->value && self->free_func)
+        reclaim = _chashtable_retire(self, node->value, true);
+      reclaim |= _chashtable_retire(self, node, false);
+      if (reclaim)
+        _chashtable_reclaim(self);
+      return true;
+    }
+    link = &node->next;
+  }
+
+  pthread_mutex_unlock(&stripe->lock);
+  return false;
+}
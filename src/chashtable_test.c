@@ -0,0 +1,200 @@
+#include "unity.h"
+#include <pthread.h>
+#include <rcl/chashtable.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAGIC 0x5ca1ab1eu
+
+typedef struct {
+  unsigned magic;
+  int id;
+} value_t;
+
+static long values_alive = 0;
+
+static value_t *value_new(int id) {
+  value_t *value = malloc(sizeof(*value));
+  *value = (value_t){.magic = MAGIC, .id = id};
+  __atomic_add_fetch(&values_alive, 1, __ATOMIC_RELAXED);
+  return value;
+}
+
+static void value_free(void *ptr) {
+  value_t *value = ptr;
+  value->magic = 0;
+  free(value);
+  __atomic_sub_fetch(&values_alive, 1, __ATOMIC_RELAXED);
+}
+
+void setUp(void) { values_alive = 0; }
+
+void tearDown(void) {}
+
+static void test_chashtable_basic(void) {
+  chashtable_t *table = chashtable_new_full((chashtable_init_t){
+      .capacity = 4,
+      .free_func = value_free,
+  });
+
+  chashtable_set(table, "a", value_new(1));
+  chashtable_set(table, "b", value_new(2));
+  TEST_ASSERT_EQUAL_size_t(2, chashtable_length(table));
+  TEST_ASSERT_TRUE(chashtable_exists(table, "a"));
+  TEST_ASSERT_FALSE(chashtable_exists(table, "c"));
+
+  chashtable_guard_t guard = chashtable_read_begin(table);
+  value_t *value = chashtable_get(table, "b");
+  TEST_ASSERT_EQUAL_INT(2, value->id);
+  TEST_ASSERT_NULL(chashtable_get(table, "c"));
+  chashtable_read_end(table, guard);
+
+  // Replacing keeps one entry; the old value is freed eventually.
+  chashtable_set(table, "b", value_new(3));
+  TEST_ASSERT_EQUAL_size_t(2, chashtable_length(table));
+  guard = chashtable_read_begin(table);
+  TEST_ASSERT_EQUAL_INT(3, ((value_t *)chashtable_get(table, "b"))->id);
+  chashtable_read_end(table, guard);
+
+  TEST_ASSERT_TRUE(chashtable_delete(table, "a"));
+  TEST_ASSERT_FALSE(chashtable_delete(table, "a"));
+  TEST_ASSERT_EQUAL_size_t(1, chashtable_length(table));
+
+  chashtable_free(table);
+  TEST_ASSERT_EQUAL_INT(0, values_alive);
+}
+
+static void test_chashtable_grows(void) {
+  chashtable_t *table = chashtable_new_full((chashtable_init_t){
+      .capacity = 1,
+      .free_func = value_free,
+  });
+
+  char key[16];
+  for (int i = 0; i < 20000; i++) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    chashtable_set(table, key, value_new(i));
+  }
+  TEST_ASSERT_EQUAL_size_t(20000, chashtable_length(table));
+
+  chashtable_guard_t guard = chashtable_read_begin(table);
+  for (int i = 0; i < 20000; i++) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    value_t *value = chashtable_get(table, key);
+    TEST_ASSERT_NOT_NULL(value);
+    TEST_ASSERT_EQUAL_INT(i, value->id);
+  }
+  chashtable_read_end(table, guard);
+
+  for (int i = 0; i < 20000; i += 2) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    TEST_ASSERT_TRUE(chashtable_delete(table, key));
+  }
+  TEST_ASSERT_EQUAL_size_t(10000, chashtable_length(table));
+
+  chashtable_free(table);
+  TEST_ASSERT_EQUAL_INT(0, values_alive);
+}
+
+#define KEYS 512
+#define READERS 4
+#define WRITERS 2
+
+typedef struct {
+  chashtable_t *table;
+  int seed;
+  bool done;
+  long bad_values;
+  long found;
+} worker_t;
+
+static void *reader_main(void *arg) {
+  worker_t *worker = arg;
+  char key[16];
+  unsigned n = (unsigned)worker->seed;
+
+  while (!__atomic_load_n(&worker->done, __ATOMIC_ACQUIRE)) {
+    n = n * 1103515245 + 12345;
+    snprintf(key, sizeof(key), "key_%u", (n >> 8) % (KEYS * 2));
+
+    chashtable_guard_t guard = chashtable_read_begin(worker->table);
+    value_t *value = chashtable_get(worker->table, key);
+    if (value) {
+      worker->found++;
+      // A freed value would fail this (and trip ASan).
+      if (value->magic != MAGIC)
+        worker->bad_values++;
+    }
+    chashtable_read_end(worker->table, guard);
+  }
+  return NULL;
+}
+
+static void *writer_main(void *arg) {
+  worker_t *worker = arg;
+  char key[16];
+  unsigned n = (unsigned)worker->seed;
+
+  for (int i = 0; i < 20000; i++) {
+    n = n * 1103515245 + 12345;
+    // Keys beyond KEYS come and go; the table grows and values churn.
+    snprintf(key, sizeof(key), "key_%u", (n >> 8) % (KEYS * 2));
+    if (n % 4 == 0)
+      chashtable_delete(worker->table, key);
+    else
+      chashtable_set(worker->table, key, value_new(i));
+  }
+  return NULL;
+}
+
+static void test_chashtable_concurrent(void) {
+  chashtable_t *table = chashtable_new_full((chashtable_init_t){
+      .capacity = 1,
+      .free_func = value_free,
+  });
+  char key[16];
+  for (int i = 0; i < KEYS; i++) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    chashtable_set(table, key, value_new(i));
+  }
+
+  worker_t readers[READERS], writers[WRITERS];
+  pthread_t threads[READERS + WRITERS];
+  for (int i = 0; i < READERS; i++) {
+    readers[i] = (worker_t){.table = table, .seed = i + 1};
+    pthread_create(&threads[i], NULL, reader_main, &readers[i]);
+  }
+  for (int i = 0; i < WRITERS; i++) {
+    writers[i] = (worker_t){.table = table, .seed = 100 + i};
+    pthread_create(&threads[READERS + i], NULL, writer_main, &writers[i]);
+  }
+
+  for (int i = 0; i < WRITERS; i++)
+    pthread_join(threads[READERS + i], NULL);
+  for (int i = 0; i < READERS; i++) {
+    __atomic_store_n(&readers[i].done, true, __ATOMIC_RELEASE);
+    pthread_join(threads[i], NULL);
+  }
+
+  for (int i = 0; i < READERS; i++) {
+    TEST_ASSERT_EQUAL_INT64(0, readers[i].bad_values);
+    TEST_ASSERT_TRUE(readers[i].found > 0);
+  }
+
+  // Every value still reachable, plus any awaiting reclamation, is alive.
+  TEST_ASSERT_TRUE(values_alive >= (long)chashtable_length(table));
+  chashtable_free(table);
+  TEST_ASSERT_EQUAL_INT(0, values_alive);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_chashtable_basic);
+  RUN_TEST(test_chashtable_grows);
+  RUN_TEST(test_chashtable_concurrent);
+
+  return UNITY_END();
+}
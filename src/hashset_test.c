@@ -0,0 +1,212 @@
+#include <rcl/hashset.h>
+#include "unity.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// A set of "key_<i>" for i in [from, to).
+static hashset_t *range_set(int from, int to,
+                            hashtable_hash_func_t hash_func) {
+  hashset_t *set = hashset_new_full((hashset_init_t){.hash_func = hash_func});
+  char key[16];
+  for (int i = from; i < to; i++) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    hashset_insert(set, key);
+  }
+  return set;
+}
+
+// Check that `set` holds exactly the keys of `range_set(from, to)`.
+static void assert_range(const hashset_t *set, int from, int to) {
+  TEST_ASSERT_EQUAL_size_t(from < to ? to - from : 0, hashset_length(set));
+  char key[16];
+  for (int i = from; i < to; i++) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    TEST_ASSERT_TRUE(hashset_contains(set, key));
+  }
+}
+
+static void test_hashset_basic(void) {
+  hashset_t *set = hashset_new();
+  TEST_ASSERT_FALSE(hashset_contains(set, "a"));
+  TEST_ASSERT_FALSE(hashset_remove(set, "a"));
+
+  TEST_ASSERT_TRUE(hashset_insert(set, "a"));
+  TEST_ASSERT_TRUE(hashset_insert(set, "b"));
+  TEST_ASSERT_FALSE(hashset_insert(set, "a"));
+  TEST_ASSERT_EQUAL_size_t(2, hashset_length(set));
+  TEST_ASSERT_TRUE(hashset_contains(set, "a"));
+  TEST_ASSERT_FALSE(hashset_contains(set, "c"));
+
+  // The set keeps its own copy of the key.
+  char copied[] = "c";
+  hashset_insert(set, copied);
+  copied[0] = 'd';
+  TEST_ASSERT_TRUE(hashset_contains(set, "c"));
+  TEST_ASSERT_FALSE(hashset_contains(set, "d"));
+
+  TEST_ASSERT_TRUE(hashset_remove(set, "a"));
+  TEST_ASSERT_FALSE(hashset_remove(set, "a"));
+  TEST_ASSERT_FALSE(hashset_contains(set, "a"));
+  TEST_ASSERT_EQUAL_size_t(2, hashset_length(set));
+
+  size_t seen = 0;
+  hashset_foreach(set, {
+    TEST_ASSERT_TRUE(strcmp(key, "b") == 0 || strcmp(key, "c") == 0);
+    seen++;
+  });
+  TEST_ASSERT_EQUAL_size_t(2, seen);
+
+  hashset_destroy(&set);
+  TEST_ASSERT_NULL(set);
+}
+
+static void test_hashset_grow_and_remove(void) {
+  hashset_t *set = hashset_new_full((hashset_init_t){.capacity = 1});
+  char key[16];
+
+  for (int i = 0; i < 10000; i++) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    TEST_ASSERT_TRUE(hashset_insert(set, key));
+  }
+  assert_range(set, 0, 10000);
+
+  // Removal shifts entries back; everything else must stay reachable.
+  for (int i = 0; i < 10000; i += 2) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    TEST_ASSERT_TRUE(hashset_remove(set, key));
+  }
+  TEST_ASSERT_EQUAL_size_t(5000, hashset_length(set));
+  for (int i = 0; i < 10000; i++) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    TEST_ASSERT_EQUAL(i % 2 == 1, hashset_contains(set, key));
+  }
+
+  hashset_free(set);
+}
+
+static void test_hashset_algebra(void) {
+  hashset_t *small = range_set(0, 100, NULL);
+  hashset_t *large = range_set(50, 1000, NULL);
+
+  // Both argument orders, so either set can be the one that's walked.
+  hashset_t *result = hashset_union(small, large);
+  assert_range(result, 0, 1000);
+  hashset_free(result);
+  result = hashset_union(large, small);
+  assert_range(result, 0, 1000);
+  hashset_free(result);
+
+  result = hashset_intersection(small, large);
+  assert_range(result, 50, 100);
+  hashset_free(result);
+  result = hashset_intersection(large, small);
+  assert_range(result, 50, 100);
+  hashset_free(result);
+
+  result = hashset_difference(small, large);
+  assert_range(result, 0, 50);
+  TEST_ASSERT_FALSE(hashset_contains(result, "key_50"));
+  hashset_free(result);
+  result = hashset_difference(large, small);
+  assert_range(result, 100, 1000);
+  TEST_ASSERT_FALSE(hashset_contains(result, "key_99"));
+  hashset_free(result);
+
+  // The results are sets of their own.
+  result = hashset_union(small, small);
+  assert_range(result, 0, 100);
+  TEST_ASSERT_TRUE(hashset_insert(result, "extra"));
+  TEST_ASSERT_FALSE(hashset_contains(small, "extra"));
+  hashset_free(result);
+
+  hashset_t *empty = hashset_new();
+  result = hashset_intersection(empty, large);
+  assert_range(result, 0, 0);
+  hashset_free(result);
+  result = hashset_difference(small, empty);
+  assert_range(result, 0, 100);
+  hashset_free(result);
+  result = hashset_union(empty, empty);
+  assert_range(result, 0, 0);
+  hashset_free(result);
+
+  hashset_free(empty);
+  hashset_free(large);
+  hashset_free(small);
+}
+
+static void test_hashset_algebra_hash_funcs(void) {
+  // Different hash functions: the cached hashes can't be reused, and the
+  // result hashes like the first set.
+  hashset_t *a = range_set(0, 300, hashtable_hash_fnv1a);
+  hashset_t *b = range_set(200, 400, hashtable_hash_wyhash);
+
+  hashset_t *result = hashset_union(a, b);
+  TEST_ASSERT_TRUE(result->hash_func == hashtable_hash_fnv1a);
+  assert_range(result, 0, 400);
+  hashset_free(result);
+
+  result = hashset_intersection(b, a);
+  TEST_ASSERT_TRUE(result->hash_func == hashtable_hash_wyhash);
+  assert_range(result, 200, 300);
+  hashset_free(result);
+
+  result = hashset_difference(a, b);
+  assert_range(result, 0, 200);
+  hashset_free(result);
+  result = hashset_difference(b, a);
+  assert_range(result, 300, 400);
+  hashset_free(result);
+
+  hashset_free(b);
+  hashset_free(a);
+}
+
+static void test_hashset_allocator(void) {
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+
+  hashset_t *set = hashset_new_full((hashset_init_t){
+      .allocator = &counter.allocator,
+  });
+  char key[16];
+  for (int i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    hashset_insert(set, key);
+  }
+  hashset_t *other = hashset_new();
+  hashset_insert(other, "key_1");
+  hashset_insert(other, "other");
+
+  hashset_t *results[] = {
+      hashset_union(set, other),
+      hashset_intersection(set, other),
+      hashset_difference(set, other),
+  };
+  TEST_ASSERT_TRUE(counter.live_bytes > 0);
+  for (size_t i = 0; i < 3; i++)
+    hashset_free(results[i]);
+  hashset_free(set);
+  hashset_free(other);
+
+  TEST_ASSERT_EQUAL_size_t(0, counter.live_bytes);
+  TEST_ASSERT_EQUAL_size_t(counter.allocations, counter.frees);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_hashset_basic);
+  RUN_TEST(test_hashset_grow_and_remove);
+  RUN_TEST(test_hashset_algebra);
+  RUN_TEST(test_hashset_algebra_hash_funcs);
+  RUN_TEST(test_hashset_allocator);
+
+  return UNITY_END();
+}
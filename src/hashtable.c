@@ -1,31 +1,71 @@
-#include <assert.h>
+#if defined(__linux__)
+#define _GNU_SOURCE
+#elif defined(__APPLE__)
+#define _DARWIN_C_SOURCE
+#endif
+#include <rcl/hashset.h>
 #include <rcl/hashtable.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
-const size_t _table_sizes[] = {
-    769,       1543,      3079,      6151,      12289,    24593,
-    49157,     98317,     196613,    393241,    786433,   1572869,
-    3145739,   6291469,   12582917,  25165843,  50331653, 100663319,
-    201326611, 402653189, 805306457, 1610612741};
-const size_t _table_sizes_count =
-    sizeof(_table_sizes) / sizeof(_table_sizes[0]);
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
+// Capacity a table gets on its first insert, unless it was created with one.
+// Many tables stay empty or tiny, so this is small.
 #ifndef HASHTABLE_DEFAULT_CAPACITY
-#define HASHTABLE_DEFAULT_CAPACITY 769
+#define HASHTABLE_DEFAULT_CAPACITY 8
+#endif
+
+// Old slots an incremental table moves over per set, remove or delete. A
+// resize has to finish before the new arrays fill up, after at least
+// 0.7 * old capacity inserts, so anything above 2 works; larger steps finish
+// sooner, smaller ones make each write cheaper.
+#ifndef HASHTABLE_MIGRATE_STEP
+#define HASHTABLE_MIGRATE_STEP 32
+#endif
+
+// Smallest chunk a key arena allocates. Later chunks are as big as all the
+// live keys, so the number of chunks grows logarithmically.
+#ifndef HASHTABLE_KEY_CHUNK_SIZE
+#define HASHTABLE_KEY_CHUNK_SIZE 4096
+#endif
+
+// Average keys per bucket of a frozen table's perfect hash. Every bucket takes
+// 4 bytes; bigger ones take less memory but longer to place.
+#ifndef HASHTABLE_FREEZE_BUCKET_SIZE
+#define HASHTABLE_FREEZE_BUCKET_SIZE 4
 #endif
 
+// Keys `hashtable_get_many` has in flight at once. Enough to cover memory
+// latency with the misses of the others, few enough that the prefetched lines
+// are still in L1 when they're used.
+#ifndef HASHTABLE_GET_MANY_BATCH
+#define HASHTABLE_GET_MANY_BATCH 16
+#endif
+
+// Statistics level: 0 counts nothing, 1 counts lookups in tables that have
+// `hashtable_counters_t`. See `hashtable_stats_level`.
+#ifndef RCL_HASHTABLE_STATS
+#define RCL_HASHTABLE_STATS 0
+#endif
+
+#define is_item_empty(item) ((item)->key == NULL)
+
 // FNV-1a hash function
 
 #define FNV_PRIME_32 16777619
 #define FNV_OFFSET_32 2166136261
 
-#define is_item_empty(item)                                                    \
-  ((item)->key == NULL || (item)->key == HASHTABLE_TOMBSTONE_MARKER)
-
-__attribute__((always_inline)) static inline size_t fnv1a(const char *key) {
+size_t hashtable_hash_fnv1a(const char *key) {
   const unsigned char *d = (const unsigned char *)key;
   size_t hash = FNV_OFFSET_32;
 
@@ -37,81 +77,1580 @@ __attribute__((always_inline)) static inline size_t fnv1a(const char *key) {
   return hash;
 }
 
-static size_t get_next_table_size(const size_t current_size) {
-  for (size_t i = 0; i < _table_sizes_count; i++) {
-    if (_table_sizes[i] > current_size) {
-      return _table_sizes[i];
+// Word-at-a-time hash after wyhash (https://github.com/wangyi-fudan/wyhash,
+// public domain): the key is read in 8-byte words, each pair folded with a
+// 64x64->128 bit multiply.
+
+static const uint64_t _wyp[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                                 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+static inline void _wymum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t)*a * *b;
+  *a = (uint64_t)r;
+  *b = (uint64_t)(r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)*a, lb = (uint32_t)*b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32), c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t _wymix(uint64_t a, uint64_t b) {
+  _wymum(&a, &b);
+  return a ^ b;
+}
+
+// `_wymum` and `_wymix` that, if `keep`, fold their inputs back into the
+// product, as wyhash's WYHASH_CONDOM=2 does. Otherwise an input that cancels
+// out a constant makes the product 0, and the rest of the key and the seed are
+// lost; the seeded hash can't have that, since its inputs are picked by
+// whoever sends the keys.
+static inline void _wymum_keep(uint64_t *a, uint64_t *b, bool keep) {
+  uint64_t x = *a, y = *b;
+  _wymum(a, b);
+  if (keep) {
+    *a ^= x;
+    *b ^= y;
+  }
+}
+
+static inline uint64_t _wymix_keep(uint64_t a, uint64_t b, bool keep) {
+  _wymum_keep(&a, &b, keep);
+  return a ^ b;
+}
+
+static inline uint64_t _wyr8(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static inline uint64_t _wyr4(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static inline uint64_t _wyr3(const uint8_t *p, size_t k) {
+  return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+}
+
+// The hash of `hashtable_hash_bytes` from a starting state of `seed`; see
+// `_wymum_keep` for `keep`. Inlined into each caller, so `keep` is a
+// constant.
+static inline uint64_t _wyhash(const void *data, size_t length, uint64_t seed,
+                               bool keep) {
+  const uint8_t *p = data;
+  seed ^= _wymix_keep(seed, _wyp[1], keep);
+  uint64_t a, b;
+
+  if (length <= 16) {
+    if (length >= 4) {
+      size_t shift = (length >> 3) << 2;
+      a = (_wyr4(p) << 32) | _wyr4(p + shift);
+      b = (_wyr4(p + length - 4) << 32) | _wyr4(p + length - 4 - shift);
+    } else if (length > 0) {
+      a = _wyr3(p, length);
+      b = 0;
+    } else {
+      a = b = 0;
     }
+  } else {
+    size_t i = length;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = _wymix_keep(_wyr8(p) ^ _wyp[1], _wyr8(p + 8) ^ seed, keep);
+        see1 = _wymix_keep(_wyr8(p + 16) ^ _wyp[2], _wyr8(p + 24) ^ see1,
+                           keep);
+        see2 = _wymix_keep(_wyr8(p + 32) ^ _wyp[3], _wyr8(p + 40) ^ see2,
+                           keep);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = _wymix_keep(_wyr8(p) ^ _wyp[1], _wyr8(p + 8) ^ seed, keep);
+      p += 16;
+      i -= 16;
+    }
+    a = _wyr8(p + i - 16);
+    b = _wyr8(p + i - 8);
   }
-  return current_size * 2;
+
+  a ^= _wyp[1];
+  b ^= seed;
+  _wymum_keep(&a, &b, keep);
+  return _wymix_keep(a ^ _wyp[0] ^ length, b ^ _wyp[1], keep);
 }
 
-static size_t hashtable_hash(hashtable_t *self, const char *key) {
-  size_t index = self->hash_func(key) % self->capacity;
-  bool found_tombstone = false;
-  size_t first_tombstone = 0;
+size_t hashtable_hash_bytes(const void *data, size_t length) {
+  return (size_t)_wyhash(data, length, _wyp[0], false);
+}
 
-  for (size_t i = 0; i < self->capacity; i++) {
-    if (self->items[index].key == NULL)
+size_t hashtable_hash_wyhash(const char *key) {
+  return hashtable_hash_bytes(key, strlen(key));
+}
+
+// A secret for `hashtable_hash_seeded`, from the OS's random source, or the
+// time, process and address space layout where there is none.
+static uint64_t hashtable_random_seed(void) {
+  uint64_t seed = 0;
+  int fd = open("/dev/urandom", O_RDONLY);
+  if (fd >= 0) {
+    if (read(fd, &seed, sizeof(seed)) != sizeof(seed))
+      seed = 0;
+    close(fd);
+  }
+  if (seed == 0)
+    seed = _wymix((uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32),
+                  (uintptr_t)&seed ^ _wyp[2]);
+  // 0 means not drawn yet.
+  return seed ? seed : 1;
+}
+
+// The process's secret, drawn on first use. Threads that race to draw it all
+// end up with the one stored first.
+static uint64_t hashtable_seed(void) {
+  static uint64_t seed;
+  uint64_t current = __atomic_load_n(&seed, __ATOMIC_ACQUIRE);
+  if (current)
+    return current;
+  uint64_t drawn = hashtable_random_seed();
+  if (__atomic_compare_exchange_n(&seed, &current, drawn, false,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    return drawn;
+  return current;
+}
+
+size_t hashtable_hash_seeded(const char *key) {
+  return (size_t)_wyhash(key, strlen(key), _wyp[0] ^ hashtable_seed(), true);
+}
+
+size_t hashtable_capacity_for(size_t length) {
+  // `hashtable_set_steal` grows when an insert would make the table 70% full.
+  size_t capacity = 1;
+  while (capacity * 7 <= length * 10)
+    capacity <<= 1;
+  return capacity;
+}
+
+// Round up to a power of two, so probing can mask instead of dividing.
+static size_t round_capacity(size_t capacity) {
+  size_t rounded = 1;
+  while (rounded < capacity)
+    rounded <<= 1;
+  return rounded;
+}
+
+// Returned by the find functions when the key isn't in the table.
+#define NOT_FOUND SIZE_MAX
+
+// Linear layout: Robin Hood hashing. An item's displacement is how far it sits
+// from the slot its hash points to (computed from the stored hash). Inserting
+// takes the slot of any item closer to home than the one being placed, which
+// then moves on in its stead. Probe lengths stay short and even, and a lookup
+// can stop as soon as it meets an item closer to home than it would be.
+// Removal shifts the items that follow back by one instead of leaving a
+// tombstone.
+
+#define displacement(index, hash, mask) (((index) - (hash)) & (mask))
+
+// The Robin Hood core, for any slot type with a `key` (NULL in empty slots)
+// and its `hash`: `prefix##_find`, `prefix##_insert` and `prefix##_erase`.
+// The linear layout's items use it, and so do the entries of `hashset_t`.
+#define ROBIN_HOOD(prefix, slot_t)                                             \
+  /* Find the slot of `key`, whose full hash is `hash`. The stored hashes */   \
+  /* are compared first so strcmp only runs on slots that are very likely */   \
+  /* a match. */                                                               \
+  static size_t prefix##_find(const slot_t *slots, size_t capacity,            \
+                              const char *key, size_t hash) {                  \
+    size_t mask = capacity - 1;                                                \
+    size_t index = hash & mask;                                                \
+                                                                               \
+    for (size_t dist = 0;; dist++) {                                           \
+      const slot_t *slot = &slots[index];                                      \
+      if (slot->key == NULL || displacement(index, slot->hash, mask) < dist)   \
+        return NOT_FOUND;                                                      \
+      if (slot->hash == hash && strcmp(slot->key, key) == 0)                   \
+        return index;                                                          \
+      index = (index + 1) & mask;                                              \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  /* Place a slot whose key isn't in the table yet. There must be an empty */  \
+  /* slot. Returns the index it ended up at. */                                \
+  static size_t prefix##_insert(slot_t *slots, size_t capacity, slot_t slot) { \
+    size_t mask = capacity - 1;                                                \
+    size_t index = slot.hash & mask;                                           \
+    size_t placed = NOT_FOUND;                                                 \
+                                                                               \
+    for (size_t dist = 0;; dist++) {                                           \
+      if (slots[index].key == NULL) {                                          \
+        slots[index] = slot;                                                   \
+        return placed == NOT_FOUND ? index : placed;                           \
+      }                                                                        \
+      size_t other = displacement(index, slots[index].hash, mask);             \
+      if (other < dist) {                                                      \
+        slot_t tmp = slots[index];                                             \
+        slots[index] = slot;                                                   \
+        slot = tmp;                                                            \
+        dist = other;                                                          \
+        /* The rest of the loop places the slots pushed along. */              \
+        if (placed == NOT_FOUND)                                               \
+          placed = index;                                                      \
+      }                                                                        \
+      index = (index + 1) & mask;                                              \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  /* Empty the slot at `index`, shifting back the slots after it that */       \
+  /* aren't in their home slot. */                                             \
+  static void prefix##_erase(slot_t *slots, size_t capacity, size_t index) {   \
+    size_t mask = capacity - 1;                                                \
+    size_t next = (index + 1) & mask;                                          \
+                                                                               \
+    while (slots[next].key != NULL &&                                          \
+           displacement(next, slots[next].hash, mask) != 0) {                  \
+      slots[index] = slots[next];                                              \
+      index = next;                                                            \
+      next = (next + 1) & mask;                                                \
+    }                                                                          \
+    slots[index] = (slot_t){0};                                                \
+  }
+
+ROBIN_HOOD(linear, item_t)
+ROBIN_HOOD(set, hashset_entry_t)
+
+// Swiss-table layout. Alongside `items`, `ctrl` holds one byte per slot: the
+// low 7 bits of the slot's hash, or SWISS_EMPTY/SWISS_DELETED (high bit set).
+// Slots are probed a group of 16 control bytes at a time, and items are only
+// touched where the control byte matches. Deleted items have a NULL key, just
+// like empty ones, so `is_item_empty` and `hashtable_foreach` work unchanged.
+
+#define SWISS_EMPTY ((uint8_t)0x80)
+#define SWISS_DELETED ((uint8_t)0xfe)
+#define SWISS_GROUP 16
+
+#define swiss_h1(hash) ((hash) >> 7)
+#define swiss_h2(hash) ((uint8_t)((hash)&0x7f))
+
+// Bit i is set if byte i of the group equals `byte`.
+static inline uint32_t swiss_match(const uint8_t *group, uint8_t byte) {
+#ifdef __SSE2__
+  __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+  return (uint32_t)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)byte)));
+#else
+  uint32_t mask = 0;
+  for (int i = 0; i < SWISS_GROUP; i++)
+    mask |= (uint32_t)(group[i] == byte) << i;
+  return mask;
+#endif
+}
+
+// Bit i is set if slot i of the group is empty or deleted.
+static inline uint32_t swiss_match_vacant(const uint8_t *group) {
+#ifdef __SSE2__
+  return (uint32_t)_mm_movemask_epi8(
+      _mm_loadu_si128((const __m128i *)group));
+#else
+  uint32_t mask = 0;
+  for (int i = 0; i < SWISS_GROUP; i++)
+    mask |= (uint32_t)(group[i] >> 7) << i;
+  return mask;
+#endif
+}
+
+// Groups are visited in triangular steps (+1, +2, +3, ...), which covers every
+// group when their number is a power of two. The load factor, deleted slots
+// included, stays under 7/8, so there's always an empty slot to stop at.
+static size_t swiss_find(const item_t *items, const uint8_t *ctrls,
+                         size_t capacity, const char *key, size_t hash) {
+  size_t groups_mask = capacity / SWISS_GROUP - 1;
+  size_t group = swiss_h1(hash) & groups_mask;
+  uint8_t h2 = swiss_h2(hash);
+
+  for (size_t step = 1; step <= groups_mask + 1; step++) {
+    size_t base = group * SWISS_GROUP;
+    const uint8_t *ctrl = ctrls + base;
+
+    for (uint32_t m = swiss_match(ctrl, h2); m; m &= m - 1) {
+      const item_t *item = &items[base + __builtin_ctz(m)];
+      if (item->hash == hash && strcmp(item->key, key) == 0)
+        return base + __builtin_ctz(m);
+    }
+    if (swiss_match(ctrl, SWISS_EMPTY))
       break;
-    if (self->items[index].key == HASHTABLE_TOMBSTONE_MARKER) {
-      if (!found_tombstone) {
-        found_tombstone = true;
-        first_tombstone = index;
-      }
-    } else if (strcmp(self->items[index].key, key) == 0) {
-      return index;
+    group = (group + step) & groups_mask;
+  }
+
+  return NOT_FOUND;
+}
+
+// First empty or deleted slot on the probe sequence of `hash`.
+static size_t swiss_find_vacant(hashtable_t *self, size_t hash) {
+  size_t groups_mask = self->capacity / SWISS_GROUP - 1;
+  size_t group = swiss_h1(hash) & groups_mask;
+
+  for (size_t step = 1;; step++) {
+    uint32_t vacant = swiss_match_vacant(self->ctrl + group * SWISS_GROUP);
+    if (vacant)
+      return group * SWISS_GROUP + __builtin_ctz(vacant);
+    group = (group + step) & groups_mask;
+  }
+}
+
+// First empty slot for `hash` in a table being rebuilt (no deleted slots).
+static size_t swiss_find_empty(const uint8_t *ctrl, size_t capacity,
+                               size_t hash) {
+  size_t groups_mask = capacity / SWISS_GROUP - 1;
+  size_t group = swiss_h1(hash) & groups_mask;
+
+  for (size_t step = 1;; step++) {
+    uint32_t empty = swiss_match(ctrl + group * SWISS_GROUP, SWISS_EMPTY);
+    if (empty)
+      return group * SWISS_GROUP + __builtin_ctz(empty);
+    group = (group + step) & groups_mask;
+  }
+}
+
+// Compact layout, after CPython's dict. Items are appended to `items` in
+// insertion order, and `index` maps each slot to an item's position plus one
+// (0 is an empty slot). The index is a Robin Hood table like the linear
+// layout, with each slot's hash read from its item. A removed item leaves a
+// hole (NULL key) in `items`; holes go when the items are compacted, which
+// happens whenever the index is rebuilt.
+
+// Number of items a compact table can hold before its index has to grow: the
+// same 70% load as the linear layout, see `hashtable_needs_room`.
+static size_t compact_room(size_t capacity) {
+  return capacity ? (capacity * 7 - 1) / 10 : 0;
+}
+
+static size_t compact_find(const hashtable_t *self, const char *key,
+                           size_t hash) {
+  size_t mask = self->capacity - 1;
+  size_t slot = hash & mask;
+
+  for (size_t dist = 0;; dist++) {
+    uint32_t entry = self->index[slot];
+    if (entry == 0)
+      return NOT_FOUND;
+    const item_t *item = &self->items[entry - 1];
+    if (displacement(slot, item->hash, mask) < dist)
+      return NOT_FOUND;
+    if (item->hash == hash && strcmp(item->key, key) == 0)
+      return entry - 1;
+    slot = (slot + 1) & mask;
+  }
+}
+
+// Add the item at `items[entry - 1]` to the index. There must be an empty
+// slot.
+static void compact_index_insert(uint32_t *index, size_t capacity,
+                                 const item_t *items, uint32_t entry) {
+  size_t mask = capacity - 1;
+  size_t slot = items[entry - 1].hash & mask;
+
+  for (size_t dist = 0;; dist++) {
+    if (index[slot] == 0) {
+      index[slot] = entry;
+      return;
+    }
+    size_t other = displacement(slot, items[index[slot] - 1].hash, mask);
+    if (other < dist) {
+      uint32_t tmp = index[slot];
+      index[slot] = entry;
+      entry = tmp;
+      dist = other;
     }
-    index = (index + 1) % self->capacity;
+    slot = (slot + 1) & mask;
   }
+}
+
+// Remove the item at `position` from the index, shifting back the entries
+// after it that aren't in their home slot. The item must still be there.
+static void compact_index_erase(hashtable_t *self, size_t position) {
+  size_t mask = self->capacity - 1;
+  size_t slot = self->items[position].hash & mask;
+  while (self->index[slot] != position + 1)
+    slot = (slot + 1) & mask;
 
-  return found_tombstone ? first_tombstone : index;
+  size_t next = (slot + 1) & mask;
+  while (self->index[next] != 0 &&
+         displacement(next, self->items[self->index[next] - 1].hash, mask) !=
+             0) {
+    self->index[slot] = self->index[next];
+    slot = next;
+    next = (next + 1) & mask;
+  }
+  self->index[slot] = 0;
 }
 
-/**
- * Grow the hashtable by doubling its capacity and rehashing all the items
- */
-static void hashtable_grow(hashtable_t *self) {
-  size_t new_capacity = get_next_table_size(self->capacity);
+// Append an item that isn't in the table yet. There must be room for it.
+static item_t *compact_place(hashtable_t *self, item_t item) {
+  size_t position = self->used++;
+  self->items[position] = item;
+  compact_index_insert(self->index, self->capacity, self->items,
+                       (uint32_t)(position + 1));
+  return &self->items[position];
+}
 
-  hashtable_t *tmp_table = hashtable_new_with_capacity(new_capacity);
+// Give `items` room for `count` items, which must cover the ones appended.
+static void compact_resize_items(hashtable_t *self, size_t count) {
+  self->items =
+      rcl_realloc(self->allocator, self->items, count * sizeof(*self->items));
+  self->items_capacity = count;
+}
+
+// Squeeze the holes out of `items`, keeping the order, and rebuild the index
+// with `capacity` slots. A capacity of 0 (only for empty tables) frees both.
+static void compact_rebuild(hashtable_t *self, size_t capacity) {
+  size_t used = 0;
+  for (size_t i = 0; i < self->used; i++) {
+    if (!is_item_empty(&self->items[i]))
+      self->items[used++] = self->items[i];
+  }
+  self->used = used;
+
+  rcl_free(self->allocator, self->index);
+  self->index =
+      capacity ? rcl_calloc(self->allocator, capacity, sizeof(*self->index))
+               : NULL;
+  self->capacity = capacity;
+  for (size_t i = 0; i < used; i++)
+    compact_index_insert(self->index, capacity, self->items,
+                         (uint32_t)(i + 1));
+
+  if (capacity == 0) {
+    rcl_free(self->allocator, self->items);
+    self->items = NULL;
+    self->items_capacity = 0;
+  } else if (self->items_capacity > compact_room(capacity)) {
+    compact_resize_items(self, compact_room(capacity));
+  }
+}
 
+// Frozen tables, see `hashtable_freeze`. A minimal perfect hash in the style
+// of CHD (hash, displace and compress, Belazzougui et al.), minus the
+// compression: each key's hash, mixed again so weak hash functions still
+// spread, picks a bucket, and the bucket's displacement, together with the
+// hash, picks the key's position among the `length` items. Building places the
+// biggest buckets first, trying displacements until every key of the bucket
+// lands on a free position.
+
+// Map `x` onto [0, n) without a division.
+static inline size_t frozen_reduce(uint64_t x, size_t n) {
+#ifdef __SIZEOF_INT128__
+  return (size_t)(((__uint128_t)x * n) >> 64);
+#else
+  return (size_t)(x % n);
+#endif
+}
+
+static inline uint64_t frozen_mix(size_t hash) {
+  return _wymix(hash ^ _wyp[0], _wyp[1]);
+}
+
+static inline size_t frozen_position(uint64_t mixed, uint32_t displacement,
+                                     size_t n) {
+  return frozen_reduce(_wymix(mixed ^ _wyp[2],
+                              _wyp[3] ^ (displacement * 0x9e3779b97f4a7c15ull)),
+                       n);
+}
+
+// The only position an item with this hash can be at.
+static inline size_t frozen_slot(const hashtable_t *self, size_t hash) {
+  uint64_t mixed = frozen_mix(hash);
+  uint32_t displacement =
+      self->displacements[frozen_reduce(mixed, self->buckets)];
+  return frozen_position(mixed, displacement, self->capacity);
+}
+
+static size_t frozen_find(const hashtable_t *self, const char *key,
+                          size_t hash) {
+  size_t index = frozen_slot(self, hash);
+  const item_t *item = &self->items[index];
+  if (item->hash == hash && strcmp(item->key, key) == 0)
+    return index;
+  return NOT_FOUND;
+}
+
+// Find the slot holding `key`, whose full hash is `hash`, or NOT_FOUND.
+// For HASHTABLE_LAYOUT_COMPACT, the position of its item.
+static size_t hashtable_find(hashtable_t *self, const char *key,
+                             size_t hash) {
+  // Also covers a table with no slots allocated yet.
+  if (self->length == 0)
+    return NOT_FOUND;
+  if (self->frozen)
+    return frozen_find(self, key, hash);
+  if (self->layout == HASHTABLE_LAYOUT_SWISS)
+    return swiss_find(self->items, self->ctrl, self->capacity, key, hash);
+  if (self->layout == HASHTABLE_LAYOUT_COMPACT)
+    return compact_find(self, key, hash);
+  return linear_find(self->items, self->capacity, key, hash);
+}
+
+// Same as `hashtable_find`, but in the arrays of a resize in progress.
+static size_t hashtable_find_old(hashtable_t *self, const char *key,
+                                 size_t hash) {
+  if (self->layout == HASHTABLE_LAYOUT_SWISS)
+    return swiss_find(self->old_items, self->old_ctrl, self->old_capacity, key,
+                      hash);
+  return linear_find(self->old_items, self->old_capacity, key, hash);
+}
+
+// The position of the item in slot `slot` of a linear or compact table, or
+// NOT_FOUND if the slot is empty.
+static size_t hashtable_slot_item(const hashtable_t *self, size_t slot) {
+  if (self->layout == HASHTABLE_LAYOUT_COMPACT)
+    return self->index[slot] ? self->index[slot] - 1 : NOT_FOUND;
+  return is_item_empty(&self->items[slot]) ? NOT_FOUND : slot;
+}
+
+// Number of slots (groups, for Swiss tables) `hashtable_find` looks at for
+// `hash` if it ends at `index`, or doesn't find the key if that is NOT_FOUND.
+// Walks the probe again without comparing keys, for statistics only.
+static size_t hashtable_probe_length(const hashtable_t *self, size_t hash,
+                                     size_t index) {
+  if (self->length == 0)
+    return 0;
+  if (self->frozen)
+    return 1;
+
+  if (self->layout == HASHTABLE_LAYOUT_SWISS) {
+    size_t groups_mask = self->capacity / SWISS_GROUP - 1;
+    size_t group = swiss_h1(hash) & groups_mask;
+    size_t probes = 1;
+    for (size_t step = 1; step <= groups_mask; step++, probes++) {
+      if (index != NOT_FOUND
+              ? group == index / SWISS_GROUP
+              : swiss_match(self->ctrl + group * SWISS_GROUP, SWISS_EMPTY))
+        break;
+      group = (group + step) & groups_mask;
+    }
+    return probes;
+  }
+
+  size_t mask = self->capacity - 1;
+  size_t slot = hash & mask;
+  size_t dist = 0;
+  for (;; dist++) {
+    size_t item = hashtable_slot_item(self, slot);
+    if (index != NOT_FOUND ? item == index
+                           : item == NOT_FOUND ||
+                                 displacement(slot, self->items[item].hash,
+                                              mask) < dist)
+      break;
+    slot = (slot + 1) & mask;
+  }
+  return dist + 1;
+}
+
+#if RCL_HASHTABLE_STATS
+static void hashtable_count(hashtable_counters_t *counters, size_t probes,
+                            bool hit) {
+  counters->lookups++;
+  counters->hits += hit;
+  counters->misses += !hit;
+  counters->probes += probes;
+}
+
+// Count a lookup for `hash` that ended at `index` (NOT_FOUND for a miss).
+#define HASHTABLE_COUNT(self, hash, index, hit)                                \
+  ((self)->counters                                                            \
+       ? hashtable_count((self)->counters,                                     \
+                         hashtable_probe_length(self, hash, index), hit)       \
+       : (void)0)
+#else
+#define HASHTABLE_COUNT(self, hash, index, hit) ((void)(self))
+#endif
+
+// Place an item that isn't in the table yet. There must be room for it.
+// Returns where it ended up.
+static item_t *hashtable_place(hashtable_t *self, item_t item) {
+  if (self->layout == HASHTABLE_LAYOUT_SWISS) {
+    size_t index = swiss_find_vacant(self, item.hash);
+    if (self->ctrl[index] == SWISS_DELETED)
+      self->tombstones--;
+    self->ctrl[index] = swiss_h2(item.hash);
+    self->items[index] = item;
+    return &self->items[index];
+  }
+  if (self->layout == HASHTABLE_LAYOUT_COMPACT)
+    return compact_place(self, item);
+  return &self->items[linear_insert(self->items, self->capacity, item)];
+}
+
+// Incremental resizing. `hashtable_resize_begin` swaps in empty arrays and
+// keeps the old ones in `old_items`/`old_ctrl`; from then on new items only go
+// into the new arrays, and each write moves a few old slots over, in order,
+// from `migrate_index`. A moved Swiss slot is marked deleted, so probing the
+// old arrays still works. A moved linear slot is erased with the usual
+// backward shift, which keeps the old arrays a valid Robin Hood table; it may
+// pull the next item back into the same slot, so that slot is looked at again.
+
+// Move the item in slot `index` of the old arrays into the new ones.
+static void hashtable_migrate_slot(hashtable_t *self, size_t index) {
+  item_t item = self->old_items[index];
+  if (self->layout == HASHTABLE_LAYOUT_SWISS) {
+    self->old_items[index] = (item_t){0};
+    self->old_ctrl[index] = SWISS_DELETED;
+  } else {
+    linear_erase(self->old_items, self->old_capacity, index);
+  }
+  hashtable_place(self, item);
+}
+
+// Look at up to `slots` old slots, moving their items over, and free the old
+// arrays once they are empty.
+static void hashtable_migrate(hashtable_t *self, size_t slots) {
+  for (; slots > 0 && self->migrate_index < self->old_capacity; slots--) {
+    if (!is_item_empty(&self->old_items[self->migrate_index])) {
+      hashtable_migrate_slot(self, self->migrate_index);
+      if (self->layout == HASHTABLE_LAYOUT_LINEAR)
+        continue;
+    }
+    self->migrate_index++;
+  }
+
+  if (self->migrate_index == self->old_capacity) {
+    rcl_free(self->allocator, self->old_items);
+    rcl_free(self->allocator, self->old_ctrl);
+    self->old_items = NULL;
+    self->old_ctrl = NULL;
+    self->old_capacity = 0;
+    self->migrate_index = 0;
+  }
+}
+
+// Before a write to `key`: take a step of the resize in progress, if any, and
+// move `key` over if it's still in the old arrays, so the write only has to
+// deal with the new ones.
+static void hashtable_migrate_key(hashtable_t *self, const char *key,
+                                  size_t hash) {
+  if (!self->old_items)
+    return;
+  hashtable_migrate(self, HASHTABLE_MIGRATE_STEP);
+  if (!self->old_items)
+    return;
+  size_t index = hashtable_find_old(self, key, hash);
+  if (index != NOT_FOUND)
+    hashtable_migrate_slot(self, index);
+}
+
+// Find `key` for a write, see `hashtable_migrate_key`.
+static size_t hashtable_find_for_write(hashtable_t *self, const char *key,
+                                       size_t hash) {
+  // Writes need a mapped table's items in memory.
+  if (self->mapping)
+    hashtable_finish_resize(self);
+  hashtable_migrate_key(self, key, hash);
+  return hashtable_find(self, key, hash);
+}
+
+// Find `key`, whose full hash is `hash`, for a read: in the new arrays, then
+// in the old ones during a resize. Returns the item or NULL.
+static item_t *hashtable_lookup(hashtable_t *self, const char *key,
+                                size_t hash) {
+  size_t index = hashtable_find(self, key, hash);
+  item_t *item = index != NOT_FOUND ? &self->items[index] : NULL;
+  if (!item && self->old_items) {
+    size_t old = hashtable_find_old(self, key, hash);
+    if (old != NOT_FOUND)
+      item = &self->old_items[old];
+  }
+  // Only the probe in the new arrays is counted.
+  HASHTABLE_COUNT(self, hash, index, item != NULL);
+  return item;
+}
+
+// Key arena, for `.key_arena` tables. Keys are copied one after another into
+// chunks the table owns. A removed key's bytes are only counted as garbage;
+// once at least half of the bytes are garbage, compacting copies the live keys
+// into a single new chunk and frees the old ones.
+
+struct s_hashtable_key_chunk {
+  hashtable_key_chunk_t *next;
+  size_t used;
+  size_t size;
+  char data[];
+};
+
+static void hashtable_push_key_chunk(hashtable_t *self, size_t size) {
+  hashtable_key_chunk_t *chunk =
+      rcl_alloc(self->allocator, sizeof(*chunk) + size);
+  chunk->next = self->key_chunks;
+  chunk->used = 0;
+  chunk->size = size;
+  self->key_chunks = chunk;
+}
+
+static void hashtable_free_key_chunks(hashtable_key_chunk_t *chunk,
+                                      const rcl_allocator_t *allocator) {
+  while (chunk) {
+    hashtable_key_chunk_t *next = chunk->next;
+    rcl_free(allocator, chunk);
+    chunk = next;
+  }
+}
+
+static bool hashtable_keys_fragmented(hashtable_t *self) {
+  return self->key_garbage && self->key_garbage * 2 >= self->key_bytes;
+}
+
+static void hashtable_compact_items(hashtable_t *self, item_t *items,
+                                    size_t capacity) {
+  hashtable_key_chunk_t *chunk = self->key_chunks;
+  for (size_t i = 0; i < capacity; i++) {
+    if (is_item_empty(&items[i]))
+      continue;
+    size_t length = strlen(items[i].key) + 1;
+    char *key = chunk->data + chunk->used;
+    memcpy(key, items[i].key, length);
+    chunk->used += length;
+    items[i].key = key;
+  }
+}
+
+// Copy the live keys, in slot order, into one new chunk with `extra` bytes to
+// spare, and free the old chunks.
+static void hashtable_compact_keys(hashtable_t *self, size_t extra) {
+  hashtable_key_chunk_t *old = self->key_chunks;
+  size_t live = self->key_bytes - self->key_garbage;
+
+  self->key_chunks = NULL;
+  if (live + extra > 0) {
+    size_t size = live + extra;
+    hashtable_push_key_chunk(self, size > HASHTABLE_KEY_CHUNK_SIZE
+                                       ? size
+                                       : HASHTABLE_KEY_CHUNK_SIZE);
+    hashtable_compact_items(self, self->items, hashtable_items_end(self));
+    if (self->old_items)
+      hashtable_compact_items(self, self->old_items, self->old_capacity);
+  }
+  hashtable_free_key_chunks(old, self->allocator);
+  self->key_bytes = live;
+  self->key_garbage = 0;
+}
+
+// Copy a key for a new item: into the arena, or with its own allocation.
+static char *hashtable_copy_key(hashtable_t *self, const char *key) {
+  if (!self->key_arena)
+    return rcl_strdup(self->allocator, key);
+
+  size_t length = strlen(key) + 1;
+  hashtable_key_chunk_t *chunk = self->key_chunks;
+  if (!chunk || chunk->size - chunk->used < length) {
+    size_t live = self->key_bytes - self->key_garbage;
+    if (hashtable_keys_fragmented(self))
+      hashtable_compact_keys(self, live + length);
+    else
+      hashtable_push_key_chunk(self, live + length > HASHTABLE_KEY_CHUNK_SIZE
+                                         ? live + length
+                                         : HASHTABLE_KEY_CHUNK_SIZE);
+    chunk = self->key_chunks;
+  }
+
+  char *copy = chunk->data + chunk->used;
+  memcpy(copy, key, length);
+  chunk->used += length;
+  self->key_bytes += length;
+  return copy;
+}
+
+// Let go of the key of an item being removed or replaced.
+static void hashtable_free_key(hashtable_t *self, char *key) {
+  if (self->key_arena)
+    self->key_garbage += strlen(key) + 1;
+  else
+    rcl_free(self->allocator, key);
+}
+
+// Move every item into a fresh array of `capacity` slots, placing each from
+// its stored hash. A capacity of 0 (only for empty tables) frees the slots.
+static void hashtable_rebuild_slots(hashtable_t *self, size_t capacity) {
+  item_t *items =
+      capacity ? rcl_calloc(self->allocator, capacity, sizeof(*items)) : NULL;
+  uint8_t *ctrl = NULL;
+
+  if (capacity && self->layout == HASHTABLE_LAYOUT_SWISS) {
+    ctrl = rcl_alloc(self->allocator, capacity);
+    memset(ctrl, SWISS_EMPTY, capacity);
+  }
+
+  // Keys are unique, so items are placed from their stored hash; no hashing,
+  // no strcmp.
   for (size_t i = 0; i < self->capacity; i++) {
     if (is_item_empty(&self->items[i])) {
       continue;
     }
-    size_t new_index = hashtable_hash(tmp_table, self->items[i].key);
-    tmp_table->items[new_index] = self->items[i];
+    if (ctrl) {
+      size_t hash = self->items[i].hash;
+      size_t index = swiss_find_empty(ctrl, capacity, hash);
+      ctrl[index] = swiss_h2(hash);
+      items[index] = self->items[i];
+    } else {
+      linear_insert(items, capacity, self->items[i]);
+    }
+  }
+
+  rcl_free(self->allocator, self->items);
+  rcl_free(self->allocator, self->ctrl);
+  self->items = items;
+  self->ctrl = ctrl;
+  self->capacity = capacity;
+  self->tombstones = 0;
+}
+
+// Rebuild the table with `capacity` slots, see `hashtable_rebuild_slots` and
+// `compact_rebuild`.
+static void hashtable_rehash(hashtable_t *self, size_t capacity) {
+  hashtable_finish_resize(self);
+  if (self->layout == HASHTABLE_LAYOUT_COMPACT)
+    compact_rebuild(self, capacity);
+  else
+    hashtable_rebuild_slots(self, capacity);
+
+  // Every item was just visited anyway; laying the keys out in slot order
+  // also helps lookups that go on to compare them.
+  if (hashtable_keys_fragmented(self))
+    hashtable_compact_keys(self, 0);
+}
+
+// Start an incremental resize to `capacity` slots, see `hashtable_migrate`.
+static void hashtable_resize_begin(hashtable_t *self, size_t capacity) {
+  // The previous resize normally finished long ago.
+  hashtable_finish_resize(self);
+
+  self->old_items = self->items;
+  self->old_ctrl = self->ctrl;
+  self->old_capacity = self->capacity;
+  self->migrate_index = 0;
+
+  self->items = rcl_calloc(self->allocator, capacity, sizeof(*self->items));
+  if (self->layout == HASHTABLE_LAYOUT_SWISS) {
+    self->ctrl = rcl_alloc(self->allocator, capacity);
+    memset(self->ctrl, SWISS_EMPTY, capacity);
+  }
+  self->capacity = capacity;
+  self->tombstones = 0;
+}
+
+// Resize to `capacity` slots, all at once or incrementally.
+static void hashtable_resize(hashtable_t *self, size_t capacity) {
+  if (self->incremental)
+    hashtable_resize_begin(self, capacity);
+  else
+    hashtable_rehash(self, capacity);
+}
+
+// Swiss tables probe whole groups, so they have at least one.
+static size_t hashtable_min_capacity(hashtable_t *self, size_t capacity) {
+  if (self->layout == HASHTABLE_LAYOUT_SWISS && capacity < SWISS_GROUP)
+    return SWISS_GROUP;
+  return capacity;
+}
+
+/**
+ * Grow the hashtable by doubling its capacity and rehashing all the items.
+ * A table with no slots yet gets the default capacity.
+ */
+static void hashtable_grow(hashtable_t *self) {
+  self->grows++;
+  if (self->capacity == 0)
+    hashtable_rehash(self,
+                     hashtable_min_capacity(self, HASHTABLE_DEFAULT_CAPACITY));
+  else
+    hashtable_resize(self, self->capacity * 2);
+}
+
+// Whether inserting one more item has to grow (or clean up) the table first.
+// Linear tables grow at 70% full; Swiss tables probe whole groups at once and
+// can fill up to 7/8, deleted slots included, since they are what a miss has
+// to scan past. Compact tables need room at the end of `items`.
+static bool hashtable_needs_room(hashtable_t *self) {
+  if (self->layout == HASHTABLE_LAYOUT_SWISS)
+    return (self->length + self->tombstones + 1) * 8 > self->capacity * 7;
+  if (self->layout == HASHTABLE_LAYOUT_COMPACT)
+    return self->used == self->items_capacity;
+  return (self->length + 1) * 10 >= self->capacity * 7;
+}
+
+// Make room at the end of a compact table's `items`. If at least half of them
+// are holes they're squeezed out; otherwise `items` doubles, and the index
+// with it once it is at its 70% load. `items` grows on its own so a table
+// sized with `hashtable_reserve` or prescanned holds just its items.
+static void compact_make_room(hashtable_t *self) {
+  if (self->used > 0 && self->length * 2 <= self->used) {
+    hashtable_rehash(self, self->capacity);
+    return;
   }
+  if (self->items_capacity == compact_room(self->capacity))
+    hashtable_grow(self);
+
+  size_t count = self->items_capacity ? self->items_capacity * 2 : 2;
+  size_t room = compact_room(self->capacity);
+  compact_resize_items(self, count < room ? count : room);
+}
 
-  free(self->items);
-  self->items = tmp_table->items;
-  self->capacity = new_capacity;
+// Make room for one more item. A Swiss table that is mostly deleted slots is
+// rebuilt at the same size instead of doubling.
+static void hashtable_make_room(hashtable_t *self) {
+  if (self->layout == HASHTABLE_LAYOUT_COMPACT) {
+    compact_make_room(self);
+  } else if (self->layout == HASHTABLE_LAYOUT_SWISS &&
+      (self->length + 1) * 16 <= self->capacity * 7) {
+    hashtable_resize(self, self->capacity);
+  } else {
+    hashtable_grow(self);
+  }
+}
 
-  // We set the items to NULL so that the free function doesn't free the
-  // keys and values.
-  tmp_table->items = NULL;
-  hashtable_free(tmp_table);
+// Empty the slot at `index` after its key and value were taken care of.
+static void hashtable_erase(hashtable_t *self, size_t index) {
+  if (self->layout == HASHTABLE_LAYOUT_SWISS) {
+    self->items[index].key = NULL;
+    self->items[index].value = NULL;
+    self->ctrl[index] = SWISS_DELETED;
+    self->tombstones++;
+  } else if (self->layout == HASHTABLE_LAYOUT_COMPACT) {
+    compact_index_erase(self, index);
+    self->items[index] = (item_t){0};
+    // Holes at the end are simply given back.
+    while (self->used > 0 && is_item_empty(&self->items[self->used - 1]))
+      self->used--;
+  } else {
+    linear_erase(self->items, self->capacity, index);
+  }
+  self->length--;
 }
 
 hashtable_t *hashtable_new(void) {
-  return hashtable_new_with_capacity(HASHTABLE_DEFAULT_CAPACITY);
+  return hashtable_new_full((hashtable_init_t){0});
 }
 
 hashtable_t *hashtable_new_with_capacity(size_t initial_capacity) {
-  assert(initial_capacity > 0);
-  hashtable_t *self = malloc(sizeof(*self));
+  return hashtable_new_full(
+      (hashtable_init_t){.capacity = initial_capacity});
+}
 
+hashtable_t *hashtable_new_full(hashtable_init_t init) {
+  hashtable_t *self = rcl_alloc(init.allocator, sizeof(*self));
   *self = (hashtable_t){
-      .items = calloc(initial_capacity, sizeof(*self->items)),
-      .capacity = initial_capacity,
-      .free_func = NULL,
-      .hash_func = &fnv1a,
+      .free_func = init.free_func,
+      .hash_func = init.hash_func ? init.hash_func : &hashtable_hash_wyhash,
+      .allocator = init.allocator,
+      .layout = init.layout,
+      .incremental =
+          init.incremental && init.layout != HASHTABLE_LAYOUT_COMPACT,
+      .key_arena = init.key_arena,
+      .counters = init.counters,
   };
 
+  if (init.capacity) {
+    size_t capacity = round_capacity(init.capacity);
+    hashtable_rehash(self, hashtable_min_capacity(self, capacity));
+  }
+
   return self;
 }
 
+// Turn a frozen table back into its layout, before a write that needs one.
+static void hashtable_thaw(hashtable_t *self) {
+  // A mapped table's displacements are in the file until it's loaded.
+  hashtable_finish_resize(self);
+  self->frozen = false;
+  rcl_free(self->allocator, self->displacements);
+  self->displacements = NULL;
+  self->buckets = 0;
+  // The items are all live, so every layout rebuilds from them as they are.
+  hashtable_rehash(self, self->length ? hashtable_min_capacity(
+                                            self, hashtable_capacity_for(
+                                                      self->length))
+                                      : 0);
+}
+
+#define bit_test(bits, i) ((bits)[(i) / 64] >> ((i) % 64) & 1)
+#define bit_flip(bits, i) ((bits)[(i) / 64] ^= (uint64_t)1 << ((i) % 64))
+
+// Find a displacement that puts every key of a bucket on a free position, and
+// put them there. `keys` are the bucket's items, and `taken` has a bit per
+// position of `items`; the last buckets try many displacements, and the bits
+// stay in cache where the items wouldn't. Returns false if there is none,
+// which only happens if two hashes mix the same.
+static bool frozen_place_bucket(item_t *items, uint64_t *taken, size_t n,
+                                const item_t *keys, size_t count,
+                                uint32_t *displacement) {
+  for (size_t i = 0; i < count; i++) {
+    for (size_t j = 0; j < i; j++) {
+      if (frozen_mix(keys[i].hash) == frozen_mix(keys[j].hash))
+        return false;
+    }
+  }
+
+  for (uint32_t d = 0;; d++) {
+    size_t placed = 0;
+    for (; placed < count; placed++) {
+      size_t index = frozen_position(frozen_mix(keys[placed].hash), d, n);
+      if (bit_test(taken, index))
+        break;
+      // Taken until this displacement is known to work or not.
+      bit_flip(taken, index);
+    }
+    if (placed == count) {
+      for (size_t i = 0; i < count; i++)
+        items[frozen_position(frozen_mix(keys[i].hash), d, n)] = keys[i];
+      *displacement = d;
+      return true;
+    }
+    for (size_t i = 0; i < placed; i++)
+      bit_flip(taken, frozen_position(frozen_mix(keys[i].hash), d, n));
+    if (d == UINT32_MAX)
+      return false;
+  }
+}
+
+// The number of buckets of a perfect hash of `n` keys.
+static size_t frozen_buckets(size_t n) {
+  return n / HASHTABLE_FREEZE_BUCKET_SIZE + 1;
+}
+
+// Build a perfect hash of the `n` items among the first `end` of `source`
+// (empty ones are skipped): on success, `items` (`n` zeroed items) has each
+// at its position and `displacements` (`frozen_buckets(n)`) is filled in.
+static bool frozen_build(const rcl_allocator_t *allocator,
+                         const item_t *source, size_t end, size_t n,
+                         item_t *items, uint32_t *displacements) {
+  size_t buckets = frozen_buckets(n);
+
+  // Sort the items by bucket (a counting sort), then the buckets by size,
+  // biggest first: they're the hardest to place, so they go while most
+  // positions are still free.
+  size_t *starts = rcl_calloc(allocator, buckets + 1, sizeof(*starts));
+  item_t *sorted = rcl_alloc(allocator, (n ? n : 1) * sizeof(*sorted));
+  size_t max_size = 0;
+  for (size_t i = 0; i < end; i++) {
+    if (!is_item_empty(&source[i]))
+      starts[frozen_reduce(frozen_mix(source[i].hash), buckets) + 1]++;
+  }
+  for (size_t b = 0; b < buckets; b++) {
+    if (starts[b + 1] > max_size)
+      max_size = starts[b + 1];
+    starts[b + 1] += starts[b];
+  }
+  size_t *cursor = rcl_alloc(allocator, buckets * sizeof(*cursor));
+  memcpy(cursor, starts, buckets * sizeof(*cursor));
+  for (size_t i = 0; i < end; i++) {
+    if (is_item_empty(&source[i]))
+      continue;
+    size_t b = frozen_reduce(frozen_mix(source[i].hash), buckets);
+    sorted[cursor[b]++] = source[i];
+  }
+
+  size_t *by_size = rcl_calloc(allocator, max_size + 2, sizeof(*by_size));
+  for (size_t b = 0; b < buckets; b++)
+    by_size[max_size - (starts[b + 1] - starts[b]) + 1]++;
+  for (size_t size = 0; size <= max_size; size++)
+    by_size[size + 1] += by_size[size];
+  for (size_t b = 0; b < buckets; b++)
+    cursor[by_size[max_size - (starts[b + 1] - starts[b])]++] = b;
+
+  uint64_t *taken = rcl_calloc(allocator, n / 64 + 1, sizeof(*taken));
+  bool ok = true;
+  for (size_t i = 0; i < buckets && ok; i++) {
+    size_t b = cursor[i];
+    if (starts[b + 1] == starts[b])
+      break;
+    ok = frozen_place_bucket(items, taken, n, sorted + starts[b],
+                             starts[b + 1] - starts[b], &displacements[b]);
+  }
+
+  rcl_free(allocator, taken);
+  rcl_free(allocator, by_size);
+  rcl_free(allocator, cursor);
+  rcl_free(allocator, sorted);
+  rcl_free(allocator, starts);
+  return ok;
+}
+
+bool hashtable_freeze(hashtable_t *self) {
+  if (self->frozen)
+    return true;
+  hashtable_finish_resize(self);
+
+  size_t n = self->length;
+  size_t buckets = frozen_buckets(n);
+  const rcl_allocator_t *allocator = self->allocator;
+  item_t *items = rcl_calloc(allocator, n ? n : 1, sizeof(*items));
+  uint32_t *displacements =
+      rcl_calloc(allocator, buckets, sizeof(*displacements));
+
+  if (!frozen_build(allocator, self->items, hashtable_items_end(self), n,
+                    items, displacements)) {
+    rcl_free(allocator, items);
+    rcl_free(allocator, displacements);
+    return false;
+  }
+
+  rcl_free(allocator, self->items);
+  rcl_free(allocator, self->ctrl);
+  rcl_free(allocator, self->index);
+  self->items = items;
+  self->ctrl = NULL;
+  self->index = NULL;
+  self->capacity = n;
+  self->used = n;
+  self->items_capacity = n;
+  self->tombstones = 0;
+  self->frozen = true;
+  self->displacements = displacements;
+  self->buckets = buckets;
+
+  if (hashtable_keys_fragmented(self))
+    hashtable_compact_keys(self, 0);
+  return true;
+}
+
+// Snapshots. An image is a header, the perfect hash's displacements, one
+// record per item in position order, and a blob of the NUL-terminated keys.
+// Records are a hash, the key's offset in the blob, and the value's payload,
+// padded to 8 bytes. Sections are located by offsets from the start of the
+// file, so the image means the same wherever it's mapped.
+
+#define HASHTABLE_IMAGE_MAGIC "rclhash"
+#define HASHTABLE_IMAGE_VERSION 1
+#define HASHTABLE_IMAGE_BYTE_ORDER 0x01020304u
+// Set in a record's key offset when its value is NULL, for images whose
+// payloads are copies of what the values point to.
+#define HASHTABLE_RECORD_NULL ((uint64_t)1 << 63)
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t word_size;
+  uint32_t reserved;
+  uint64_t length;
+  uint64_t buckets;
+  uint64_t value_size;
+  uint64_t record_size;
+  // Offsets of the sections.
+  uint64_t displacements;
+  uint64_t records;
+  uint64_t keys;
+  uint64_t keys_size;
+} hashtable_image_t;
+
+typedef struct {
+  uint64_t hash;
+  uint64_t key;
+} hashtable_record_t;
+
+struct s_hashtable_mapping {
+  void *data;
+  size_t size;
+  const unsigned char *records;
+  size_t record_size;
+  size_t value_size;
+  const char *keys;
+  uint64_t keys_size;
+  // Whether the items were copied into memory, see `hashtable_load_mapped`.
+  bool loaded;
+};
+
+#define align8(n) (((n) + 7) & ~(uint64_t)7)
+
+static uint64_t hashtable_record_size(uint64_t value_size) {
+  return sizeof(hashtable_record_t) + (value_size ? align8(value_size) : 8);
+}
+
+static bool hashtable_write_zeros(FILE *file, uint64_t count) {
+  static const unsigned char zeros[8];
+  while (count > 0) {
+    size_t chunk = count < sizeof(zeros) ? count : sizeof(zeros);
+    if (fwrite(zeros, 1, chunk, file) != chunk)
+      return false;
+    count -= chunk;
+  }
+  return true;
+}
+
+static bool hashtable_write_image(FILE *file, const hashtable_image_t *header,
+                                  const item_t *items,
+                                  const uint32_t *displacements) {
+  uint64_t end = header->displacements +
+                 header->buckets * sizeof(*displacements);
+  if (fwrite(header, sizeof(*header), 1, file) != 1 ||
+      fwrite(displacements, sizeof(*displacements), header->buckets, file) !=
+          header->buckets ||
+      !hashtable_write_zeros(file, header->records - end))
+    return false;
+
+  uint64_t offset = 0;
+  for (size_t i = 0; i < header->length; i++) {
+    hashtable_record_t record = {.hash = items[i].hash, .key = offset};
+    uint64_t payload = (uintptr_t)items[i].value;
+    const void *bytes = &payload;
+    size_t size = sizeof(payload);
+    if (header->value_size) {
+      bytes = items[i].value;
+      size = items[i].value ? header->value_size : 0;
+      if (!items[i].value)
+        record.key |= HASHTABLE_RECORD_NULL;
+    }
+    offset += strlen(items[i].key) + 1;
+    if (fwrite(&record, sizeof(record), 1, file) != 1 ||
+        (size && fwrite(bytes, 1, size, file) != size) ||
+        !hashtable_write_zeros(file,
+                               header->record_size - sizeof(record) - size))
+      return false;
+  }
+
+  for (size_t i = 0; i < header->length; i++) {
+    size_t length = strlen(items[i].key) + 1;
+    if (fwrite(items[i].key, 1, length, file) != length)
+      return false;
+  }
+  return true;
+}
+
+bool hashtable_save(hashtable_t *self, const char *path, size_t value_size) {
+  hashtable_finish_resize(self);
+
+  // The image's perfect hash is always over wyhash, so any process can look
+  // keys up in it.
+  const rcl_allocator_t *allocator = self->allocator;
+  size_t n = self->length;
+  size_t buckets = frozen_buckets(n);
+  item_t *source = rcl_alloc(allocator, (n ? n : 1) * sizeof(*source));
+  item_t *items = rcl_calloc(allocator, n ? n : 1, sizeof(*items));
+  uint32_t *displacements =
+      rcl_calloc(allocator, buckets, sizeof(*displacements));
+  uint64_t keys_size = 0;
+  size_t count = 0;
+  hashtable_foreach(self, {
+    source[count] = self->items[i];
+    if (self->hash_func != hashtable_hash_wyhash)
+      source[count].hash = hashtable_hash_wyhash(key);
+    keys_size += strlen(key) + 1;
+    count++;
+  });
+
+  bool ok = frozen_build(allocator, source, n, n, items, displacements);
+  if (ok) {
+    hashtable_image_t header = {
+        .magic = HASHTABLE_IMAGE_MAGIC,
+        .version = HASHTABLE_IMAGE_VERSION,
+        .byte_order = HASHTABLE_IMAGE_BYTE_ORDER,
+        .word_size = sizeof(size_t),
+        .length = n,
+        .buckets = buckets,
+        .value_size = value_size,
+        .record_size = hashtable_record_size(value_size),
+        .displacements = sizeof(header),
+        .keys_size = keys_size,
+    };
+    header.records = align8(header.displacements +
+                            buckets * sizeof(*displacements));
+    header.keys = header.records + n * header.record_size;
+
+    // Written next to `path` and renamed over it, so readers only ever see a
+    // whole image.
+    size_t length = strlen(path);
+    char *temporary = rcl_alloc(allocator, length + sizeof(".tmp"));
+    memcpy(temporary, path, length);
+    memcpy(temporary + length, ".tmp", sizeof(".tmp"));
+    FILE *file = fopen(temporary, "wb");
+    ok = file != NULL;
+    if (ok) {
+      ok = hashtable_write_image(file, &header, items, displacements);
+      ok = fclose(file) == 0 && ok;
+      ok = ok && rename(temporary, path) == 0;
+      if (!ok)
+        remove(temporary);
+    }
+    rcl_free(allocator, temporary);
+  }
+
+  rcl_free(allocator, displacements);
+  rcl_free(allocator, items);
+  rcl_free(allocator, source);
+  return ok;
+}
+
+// Whether `count` elements of `size` bytes at `offset` fit in `file_size`.
+static bool hashtable_image_fits(uint64_t offset, uint64_t count,
+                                 uint64_t size, uint64_t file_size) {
+  return offset <= file_size && count <= (file_size - offset) / size;
+}
+
+static bool hashtable_image_valid(const hashtable_image_t *header,
+                                  size_t size) {
+  return size >= sizeof(*header) &&
+         memcmp(header->magic, HASHTABLE_IMAGE_MAGIC,
+                sizeof(HASHTABLE_IMAGE_MAGIC)) == 0 &&
+         header->version == HASHTABLE_IMAGE_VERSION &&
+         header->byte_order == HASHTABLE_IMAGE_BYTE_ORDER &&
+         header->word_size == sizeof(size_t) &&
+         header->length < UINT32_MAX &&
+         header->buckets == frozen_buckets(header->length) &&
+         header->value_size < UINT32_MAX &&
+         header->record_size == hashtable_record_size(header->value_size) &&
+         hashtable_image_fits(header->displacements, header->buckets,
+                              sizeof(uint32_t), size) &&
+         header->displacements % sizeof(uint32_t) == 0 &&
+         header->records % 8 == 0 &&
+         hashtable_image_fits(header->records, header->length,
+                              header->record_size, size) &&
+         hashtable_image_fits(header->keys, header->keys_size, 1, size) &&
+         // Every key lookups compare with ends inside the file.
+         (header->keys_size == 0
+              ? header->length == 0
+              : ((const char *)header)[header->keys + header->keys_size - 1] ==
+                    '\0');
+}
+
+hashtable_t *hashtable_open_mapped(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0 &&
+      (uint64_t)st.st_size <= SIZE_MAX)
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return NULL;
+
+  const hashtable_image_t *header = data;
+  if (!hashtable_image_valid(header, st.st_size)) {
+    munmap(data, st.st_size);
+    return NULL;
+  }
+
+  hashtable_t *self = hashtable_new_full((hashtable_init_t){.key_arena = true});
+  hashtable_mapping_t *mapping = rcl_alloc(self->allocator, sizeof(*mapping));
+  *mapping = (hashtable_mapping_t){
+      .data = data,
+      .size = st.st_size,
+      .records = (const unsigned char *)data + header->records,
+      .record_size = header->record_size,
+      .value_size = header->value_size,
+      .keys = (const char *)data + header->keys,
+      .keys_size = header->keys_size,
+  };
+  self->mapping = mapping;
+  self->length = header->length;
+  self->capacity = header->length;
+  self->frozen = true;
+  self->displacements =
+      (uint32_t *)((unsigned char *)data + header->displacements);
+  self->buckets = header->buckets;
+  return self;
+}
+
+// Whether `self` is a mapped table whose items are still only in the file.
+#define hashtable_unloaded(self) ((self)->mapping && !(self)->mapping->loaded)
+
+static void *hashtable_record_value(const hashtable_mapping_t *mapping,
+                                    const hashtable_record_t *record) {
+  if (mapping->value_size == 0) {
+    uint64_t payload;
+    memcpy(&payload, record + 1, sizeof(payload));
+    return (void *)(uintptr_t)payload;
+  }
+  if (record->key & HASHTABLE_RECORD_NULL)
+    return NULL;
+  return (void *)(record + 1);
+}
+
+// The offset of a record's key in the key blob.
+#define hashtable_record_key(record) ((record)->key & ~HASHTABLE_RECORD_NULL)
+
+// Whether a record's key starts inside the key blob. The blob ends with a
+// '\0', so the key then ends inside it too. Opening only checks the sections,
+// so it doesn't touch every record; offsets are checked where they're used.
+#define hashtable_record_key_valid(mapping, record)                            \
+  (hashtable_record_key(record) < (mapping)->keys_size)
+
+// `hashtable_lookup` on the records of an unloaded mapped table. Records of a
+// corrupt image with their key outside the key blob never match.
+static const hashtable_record_t *
+hashtable_lookup_mapped(hashtable_t *self, const char *key, size_t hash) {
+  const hashtable_mapping_t *mapping = self->mapping;
+  const hashtable_record_t *record = NULL;
+  if (self->length) {
+    record = (const hashtable_record_t *)(mapping->records +
+                                          frozen_slot(self, hash) *
+                                              mapping->record_size);
+    if (record->hash != hash || !hashtable_record_key_valid(mapping, record) ||
+        strcmp(mapping->keys + hashtable_record_key(record), key) != 0)
+      record = NULL;
+  }
+  HASHTABLE_COUNT(self, hash, NOT_FOUND, record != NULL);
+  return record;
+}
+
+// Whether every record of a mapped table has its key inside the key blob.
+static bool hashtable_records_valid(const hashtable_mapping_t *mapping,
+                                    size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    const hashtable_record_t *record =
+        (const hashtable_record_t *)(mapping->records +
+                                     i * mapping->record_size);
+    if (!hashtable_record_key_valid(mapping, record))
+      return false;
+  }
+  return true;
+}
+
+// Copy a mapped table's items into memory, keeping their positions, so it
+// works like any other frozen table. The keys go into the arena in one copy;
+// the values keep pointing into the mapping.
+//
+// A corrupt image, with a key outside the key blob, loads as an empty table:
+// there is no caller to report it to, and its records can't be trusted.
+static void hashtable_load_mapped(hashtable_t *self) {
+  hashtable_mapping_t *mapping = self->mapping;
+  size_t n = self->length;
+  if (!hashtable_records_valid(mapping, n)) {
+    self->frozen = false;
+    self->displacements = NULL;
+    self->buckets = 0;
+    self->length = 0;
+    self->capacity = 0;
+    mapping->loaded = true;
+    return;
+  }
+  item_t *items = rcl_calloc(self->allocator, n ? n : 1, sizeof(*items));
+  char *keys = NULL;
+  if (mapping->keys_size) {
+    hashtable_push_key_chunk(self, mapping->keys_size);
+    keys = self->key_chunks->data;
+    memcpy(keys, mapping->keys, mapping->keys_size);
+    self->key_chunks->used = mapping->keys_size;
+    self->key_bytes = mapping->keys_size;
+  }
+  for (size_t i = 0; i < n; i++) {
+    const hashtable_record_t *record =
+        (const hashtable_record_t *)(mapping->records +
+                                     i * mapping->record_size);
+    items[i] = (item_t){
+        .key = keys + hashtable_record_key(record),
+        .value = hashtable_record_value(mapping, record),
+        .hash = record->hash,
+    };
+  }
+
+  uint32_t *displacements =
+      rcl_alloc(self->allocator, self->buckets * sizeof(*displacements));
+  memcpy(displacements, self->displacements,
+         self->buckets * sizeof(*displacements));
+  self->displacements = displacements;
+  self->items = items;
+  self->used = n;
+  self->items_capacity = n;
+  mapping->loaded = true;
+}
+
+void hashtable_finish_resize(hashtable_t *self) {
+  if (self->old_items)
+    hashtable_migrate(self, SIZE_MAX);
+  if (hashtable_unloaded(self))
+    hashtable_load_mapped(self);
+}
+
+void hashtable_reserve(hashtable_t *self, size_t length) {
+  if (self->frozen) {
+    if (length <= self->length)
+      return;
+    hashtable_thaw(self);
+  }
+  size_t capacity =
+      hashtable_min_capacity(self, hashtable_capacity_for(length));
+  if (capacity > self->capacity)
+    hashtable_rehash(self, capacity);
+  // Compact tables take room for exactly that many items.
+  if (self->layout == HASHTABLE_LAYOUT_COMPACT && length > self->length &&
+      self->used + (length - self->length) > self->items_capacity) {
+    if (self->used > self->length)
+      hashtable_rehash(self, self->capacity);
+    if (self->items_capacity < length)
+      compact_resize_items(self, length);
+  }
+}
+
+void hashtable_shrink_to_fit(hashtable_t *self) {
+  // Already holds just its items.
+  if (self->frozen)
+    return;
+  size_t capacity =
+      self->length
+          ? hashtable_min_capacity(self, hashtable_capacity_for(self->length))
+          : 0;
+  // Rebuilding at the same size still drops deleted Swiss slots, and the
+  // holes of compact tables.
+  if (capacity < self->capacity || self->tombstones ||
+      self->used > self->length)
+    hashtable_rehash(self, capacity);
+  if (self->layout == HASHTABLE_LAYOUT_COMPACT && self->length &&
+      self->items_capacity > self->length)
+    compact_resize_items(self, self->length);
+}
+
+hashtable_stats_t hashtable_stats(hashtable_t *self) {
+  // Loads nothing from a mapped table: frozen tables need no walking.
+  if (self->old_items)
+    hashtable_finish_resize(self);
+
+  hashtable_stats_t stats = {
+      .length = self->length,
+      .capacity = self->capacity,
+      .load_factor =
+          self->capacity ? (double)self->length / self->capacity : 0,
+      .grows = self->grows,
+  };
+  if (self->layout == HASHTABLE_LAYOUT_SWISS)
+    stats.tombstones = self->tombstones;
+  else if (self->layout == HASHTABLE_LAYOUT_COMPACT && !self->frozen)
+    stats.tombstones = self->used - self->length;
+  if (self->counters)
+    stats.counters = *self->counters;
+
+  if (self->frozen) {
+    stats.probe_lengths[0] = self->length;
+    return stats;
+  }
+  for (size_t i = 0; i < hashtable_items_end(self); i++) {
+    if (is_item_empty(&self->items[i]))
+      continue;
+    size_t probes = hashtable_probe_length(self, self->items[i].hash, i);
+    if (probes - 1 > stats.max_displacement)
+      stats.max_displacement = probes - 1;
+    stats.probe_lengths[probes < HASHTABLE_STATS_PROBE_LENGTHS
+                            ? probes - 1
+                            : HASHTABLE_STATS_PROBE_LENGTHS - 1]++;
+  }
+  return stats;
+}
+
+void hashtable_set_counters(hashtable_t *self,
+                            hashtable_counters_t *counters) {
+  self->counters = counters;
+}
+
+int hashtable_stats_level(void) { return RCL_HASHTABLE_STATS; }
+
 __attribute__((always_inline)) inline void
 hashtable_set_free_func(hashtable_t *self, hashtable_free_func_t func)
 
@@ -119,46 +1658,146 @@ hashtable_set_free_func(hashtable_t *self, hashtable_free_func_t func)
   self->free_func = func;
 }
 
-// Whenever we implement hashtable_set_hash_func we need to re-hash the entire
-// table
+void hashtable_set_hash_func(hashtable_t *self, hashtable_hash_func_t func) {
+  self->hash_func = func ? func : &hashtable_hash_wyhash;
+  hashtable_finish_resize(self);
+  if (self->frozen)
+    hashtable_thaw(self);
+  for (size_t i = 0; i < hashtable_items_end(self); i++) {
+    if (!is_item_empty(&self->items[i]))
+      self->items[i].hash = self->hash_func(self->items[i].key);
+  }
+  // Also drops the deleted slots.
+  hashtable_rehash(self, self->capacity);
+}
 
 bool hashtable_exists(hashtable_t *self, const char *key) {
-  size_t index = hashtable_hash(self, key);
-  return !is_item_empty(&self->items[index]);
+  if (hashtable_unloaded(self))
+    return hashtable_lookup_mapped(self, key, self->hash_func(key)) != NULL;
+  return hashtable_lookup(self, key, self->hash_func(key)) != NULL;
 }
 
 void *hashtable_get(hashtable_t *self, const char *key) {
-  size_t index = hashtable_hash(self, key);
-  return self->items[index].value;
+  if (hashtable_unloaded(self)) {
+    const hashtable_record_t *record =
+        hashtable_lookup_mapped(self, key, self->hash_func(key));
+    return record ? hashtable_record_value(self->mapping, record) : NULL;
+  }
+  item_t *item = hashtable_lookup(self, key, self->hash_func(key));
+  return item ? item->value : NULL;
+}
+
+// Prefetch the slot (for Swiss tables, the control group, and for compact
+// ones, the index entry) a probe for `hash` starts at.
+static inline void hashtable_prefetch_home(hashtable_t *self, size_t hash) {
+  if (self->frozen) {
+    __builtin_prefetch(
+        &self->displacements[frozen_reduce(frozen_mix(hash), self->buckets)]);
+  } else if (self->layout == HASHTABLE_LAYOUT_SWISS) {
+    size_t group = swiss_h1(hash) & (self->capacity / SWISS_GROUP - 1);
+    __builtin_prefetch(self->ctrl + group * SWISS_GROUP);
+  } else if (self->layout == HASHTABLE_LAYOUT_COMPACT) {
+    __builtin_prefetch(&self->index[hash & (self->capacity - 1)]);
+  } else {
+    __builtin_prefetch(&self->items[hash & (self->capacity - 1)]);
+  }
+}
+
+// The item a lookup for `hash` most likely ends at: the first one in the
+// probe's first group whose tag matches, the one the home index entry points
+// to, or the home slot. NULL if there is none.
+static inline item_t *hashtable_candidate(hashtable_t *self, size_t hash) {
+  if (self->frozen)
+    return &self->items[frozen_slot(self, hash)];
+  if (self->layout == HASHTABLE_LAYOUT_SWISS) {
+    size_t base = (swiss_h1(hash) & (self->capacity / SWISS_GROUP - 1)) *
+                  SWISS_GROUP;
+    uint32_t m = swiss_match(self->ctrl + base, swiss_h2(hash));
+    return m ? &self->items[base + __builtin_ctz(m)] : NULL;
+  }
+  if (self->layout == HASHTABLE_LAYOUT_COMPACT) {
+    uint32_t entry = self->index[hash & (self->capacity - 1)];
+    return entry ? &self->items[entry - 1] : NULL;
+  }
+  return &self->items[hash & (self->capacity - 1)];
+}
+
+void hashtable_get_many(hashtable_t *self, const char *const *keys,
+                        size_t count, void **values) {
+  size_t hashes[HASHTABLE_GET_MANY_BATCH];
+
+  // The prefetches below index `items`, which may not exist yet.
+  if (self->length == 0 || hashtable_unloaded(self)) {
+    for (size_t i = 0; i < count; i++)
+      values[i] = self->length ? hashtable_get(self, keys[i]) : NULL;
+    return;
+  }
+
+  for (size_t start = 0; start < count; start += HASHTABLE_GET_MANY_BATCH) {
+    size_t n = count - start < HASHTABLE_GET_MANY_BATCH
+                   ? count - start
+                   : HASHTABLE_GET_MANY_BATCH;
+    const char *const *batch = keys + start;
+
+    // Each stage touches memory the previous one prefetched, so the misses of
+    // the whole batch overlap instead of following one another. The first
+    // one reads the keys, which were prefetched with the previous batch.
+    for (size_t i = start + n; i < start + 2 * n && i < count; i++)
+      __builtin_prefetch(keys[i]);
+    for (size_t i = 0; i < n; i++) {
+      hashes[i] = self->hash_func(batch[i]);
+      hashtable_prefetch_home(self, hashes[i]);
+    }
+    if (self->frozen || self->layout != HASHTABLE_LAYOUT_LINEAR) {
+      for (size_t i = 0; i < n; i++)
+        __builtin_prefetch(hashtable_candidate(self, hashes[i]));
+    }
+    for (size_t i = 0; i < n; i++) {
+      item_t *item = hashtable_candidate(self, hashes[i]);
+      if (item && item->key && item->hash == hashes[i])
+        __builtin_prefetch(item->key);
+    }
+    for (size_t i = 0; i < n; i++) {
+      item_t *item = hashtable_lookup(self, batch[i], hashes[i]);
+      values[start + i] = item ? item->value : NULL;
+    }
+  }
 }
 
 void hashtable_set_steal(hashtable_t *self, char *key, void *value) {
-  size_t index = hashtable_hash(self, key);
-  item_t *item = &self->items[index];
+  size_t hash = self->hash_func(key);
+  size_t index = hashtable_find_for_write(self, key, hash);
 
   // Set a new item
-  if (is_item_empty(item)) {
-    // Grow the table if it's more or precisely 70% full
-    if ((self->length + 1) * 10 >= self->capacity * 7) {
-      // Grow the table
-      hashtable_grow(self);
-      hashtable_set_steal(self, key, value);
-      return;
+  if (index == NOT_FOUND) {
+    if (self->frozen)
+      hashtable_thaw(self);
+    // Grow the table if it's getting too full
+    if (hashtable_needs_room(self)) {
+      hashtable_make_room(self);
+    }
+    if (self->key_arena) {
+      char *copy = hashtable_copy_key(self, key);
+      rcl_free(self->allocator, key);
+      key = copy;
     }
     self->length++;
-
-    item->value = value;
-    item->key = key; // Just take the key
+    hashtable_place(self, (item_t){.key = key, .value = value, .hash = hash});
   }
   // Replace an existing item
   else {
+    item_t *item = &self->items[index];
+
     // Here things get complicated. If the key is literally the same existing
     // pointer, we should do nothing. Otherwise, we should free the existing key
     // and take the new one. This allows the user to reuse the same key pointer
     // if they want to update the value without changing the key, but also
     // allows them to replace the key if they want to.
-    if (item->key != key) {
-      free(item->key);
+    if (item->key != key && self->key_arena) {
+      // The arena already holds an equal key; keep that one.
+      rcl_free(self->allocator, key);
+    } else if (item->key != key) {
+      rcl_free(self->allocator, item->key);
       item->key = key;
     }
 
@@ -169,28 +1808,55 @@ void hashtable_set_steal(hashtable_t *self, char *key, void *value) {
   }
 }
 
+void **hashtable_entry(hashtable_t *self, const char *key, bool *inserted) {
+  size_t hash = self->hash_func(key);
+  size_t index = hashtable_find_for_write(self, key, hash);
+
+  if (inserted)
+    *inserted = index == NOT_FOUND;
+  if (index != NOT_FOUND)
+    return &self->items[index].value;
+
+  // Only a new entry needs its own copy of the key.
+  if (self->frozen)
+    hashtable_thaw(self);
+  if (hashtable_needs_room(self))
+    hashtable_make_room(self);
+  self->length++;
+  item_t item = {.key = hashtable_copy_key(self, key), .hash = hash};
+  return &hashtable_place(self, item)->value;
+}
+
 void hashtable_set(hashtable_t *self, const char *key, void *value) {
-  return hashtable_set_steal(self, strdup(key), value);
+  if (self->key_arena) {
+    // Copies the key straight into the arena, and only if it's new.
+    void **slot = hashtable_entry(self, key, NULL);
+    if (*slot && self->free_func)
+      self->free_func(*slot);
+    *slot = value;
+    return;
+  }
+  return hashtable_set_steal(self, rcl_strdup(self->allocator, key), value);
 }
 
 bool hashtable_remove(hashtable_t *self, const char *key, void **value) {
-  size_t index = hashtable_hash(self, key);
-  item_t *item = &self->items[index];
+  if (self->frozen)
+    hashtable_thaw(self);
+  size_t index = hashtable_find_for_write(self, key, self->hash_func(key));
 
-  if (is_item_empty(item)) {
+  if (index == NOT_FOUND) {
     if (value) {
       *value = NULL;
     }
     return false;
   }
 
+  item_t *item = &self->items[index];
   if (value) {
     *value = item->value;
   }
-  free(item->key);
-  item->key = HASHTABLE_TOMBSTONE_MARKER;
-  item->value = NULL;
-  self->length--;
+  hashtable_free_key(self, item->key);
+  hashtable_erase(self, index);
   return true;
 }
 
@@ -198,19 +1864,35 @@ void hashtable_free(hashtable_t *self) {
   if (!self)
     return;
 
+  // Loading a mapped table only to free it would be wasted work.
+  if (self->old_items)
+    hashtable_finish_resize(self);
   if (self->items) {
-    for (size_t i = 0; i < self->capacity; i++) {
+    // Arena keys go with their chunks, so there may be nothing to do per item.
+    for (size_t i = 0; i < hashtable_items_end(self) &&
+                       (self->free_func || !self->key_arena);
+         i++) {
       if (!is_item_empty(&self->items[i])) {
         if (self->free_func) {
           self->free_func(self->items[i].value);
         }
-        free(self->items[i].key);
+        if (!self->key_arena)
+          rcl_free(self->allocator, self->items[i].key);
       }
     }
-    free(self->items);
+    rcl_free(self->allocator, self->items);
+  }
+  rcl_free(self->allocator, self->ctrl);
+  rcl_free(self->allocator, self->index);
+  if (!hashtable_unloaded(self))
+    rcl_free(self->allocator, self->displacements);
+  hashtable_free_key_chunks(self->key_chunks, self->allocator);
+  if (self->mapping) {
+    munmap(self->mapping->data, self->mapping->size);
+    rcl_free(self->allocator, self->mapping);
   }
 
-  free(self);
+  rcl_free(self->allocator, self);
 }
 
 void hashtable_destroy(hashtable_t **self) {
@@ -221,19 +1903,227 @@ void hashtable_destroy(hashtable_t **self) {
 }
 
 bool hashtable_delete(hashtable_t *self, const char *key) {
-  size_t index = hashtable_hash(self, key);
-  item_t *item = &self->items[index];
+  if (self->frozen)
+    hashtable_thaw(self);
+  size_t index = hashtable_find_for_write(self, key, self->hash_func(key));
 
-  if (is_item_empty(item)) {
+  if (index == NOT_FOUND) {
     return false;
   }
 
+  item_t *item = &self->items[index];
+
   if (item->value && self->free_func) {
     self->free_func(item->value);
   }
-  free(item->key);
-  item->key = HASHTABLE_TOMBSTONE_MARKER;
-  item->value = NULL;
+  hashtable_free_key(self, item->key);
+  hashtable_erase(self, index);
+  return true;
+}
+
+// Sets: the Robin Hood core over entries with no value, growing at 70% full
+// like the linear layout.
+
+static size_t hashset_find(const hashset_t *self, const char *key,
+                           size_t hash) {
+  if (self->length == 0)
+    return NOT_FOUND;
+  return set_find(self->entries, self->capacity, key, hash);
+}
+
+// The hash in `self` of an entry of `other`: the cached one, unless the sets
+// hash differently.
+static size_t hashset_hash_of(const hashset_t *self, const hashset_t *other,
+                              const hashset_entry_t *entry) {
+  if (self->hash_func == other->hash_func)
+    return entry->hash;
+  return self->hash_func(entry->key);
+}
+
+static void hashset_resize(hashset_t *self, size_t capacity) {
+  hashset_entry_t *entries =
+      rcl_calloc(self->allocator, capacity, sizeof(*entries));
+  for (size_t i = 0; i < self->capacity; i++) {
+    if (self->entries[i].key)
+      set_insert(entries, capacity, self->entries[i]);
+  }
+  rcl_free(self->allocator, self->entries);
+  self->entries = entries;
+  self->capacity = capacity;
+}
+
+// Grow so `count` more keys fit without going over 70% full.
+static void hashset_reserve(hashset_t *self, size_t count) {
+  size_t capacity =
+      self->capacity ? self->capacity : HASHTABLE_DEFAULT_CAPACITY;
+  while ((self->length + count) * 10 >= capacity * 7)
+    capacity <<= 1;
+  if (capacity != self->capacity)
+    hashset_resize(self, capacity);
+}
+
+// Add a key that isn't in the set yet. The set takes ownership of it.
+static void hashset_place(hashset_t *self, char *key, size_t hash) {
+  hashset_reserve(self, 1);
+  set_insert(self->entries, self->capacity, (hashset_entry_t){key, hash});
+  self->length++;
+}
+
+static void hashset_erase(hashset_t *self, size_t index) {
+  rcl_free(self->allocator, self->entries[index].key);
+  set_erase(self->entries, self->capacity, index);
   self->length--;
+}
+
+hashset_t *hashset_new(void) { return hashset_new_full((hashset_init_t){0}); }
+
+hashset_t *hashset_new_full(hashset_init_t init) {
+  hashset_t *self = rcl_alloc(init.allocator, sizeof(*self));
+  *self = (hashset_t){
+      .hash_func = init.hash_func ? init.hash_func : &hashtable_hash_wyhash,
+      .allocator = init.allocator,
+  };
+
+  if (init.capacity)
+    hashset_resize(self, round_capacity(init.capacity));
+
+  return self;
+}
+
+void hashset_free(hashset_t *self) {
+  if (!self)
+    return;
+
+  for (size_t i = 0; i < self->capacity; i++)
+    rcl_free(self->allocator, self->entries[i].key);
+  rcl_free(self->allocator, self->entries);
+  rcl_free(self->allocator, self);
+}
+
+void hashset_destroy(hashset_t **self) {
+  if (self) {
+    hashset_free(*self);
+    *self = NULL;
+  }
+}
+
+bool hashset_insert(hashset_t *self, const char *key) {
+  size_t hash = self->hash_func(key);
+  if (hashset_find(self, key, hash) != NOT_FOUND)
+    return false;
+
+  hashset_place(self, rcl_strdup(self->allocator, key), hash);
+  return true;
+}
+
+bool hashset_contains(const hashset_t *self, const char *key) {
+  return hashset_find(self, key, self->hash_func(key)) != NOT_FOUND;
+}
+
+bool hashset_remove(hashset_t *self, const char *key) {
+  size_t index = hashset_find(self, key, self->hash_func(key));
+  if (index == NOT_FOUND)
+    return false;
+
+  hashset_erase(self, index);
   return true;
 }
+
+size_t hashset_length(const hashset_t *self) { return self->length; }
+
+// An empty set with `like`'s hash function and allocator.
+static hashset_t *hashset_new_like(const hashset_t *like) {
+  return hashset_new_full((hashset_init_t){
+      .hash_func = like->hash_func,
+      .allocator = like->allocator,
+  });
+}
+
+// Copy `other` into a set like `like`, with room for `extra` more keys. If
+// they hash the same way, the slots are copied as they are, without probing.
+static hashset_t *hashset_copy(const hashset_t *like, const hashset_t *other,
+                               size_t extra) {
+  hashset_t *self = hashset_new_like(like);
+
+  if (self->hash_func == other->hash_func && other->capacity) {
+    self->entries =
+        rcl_calloc(self->allocator, other->capacity, sizeof(*self->entries));
+    self->capacity = other->capacity;
+    self->length = other->length;
+    for (size_t i = 0; i < other->capacity; i++) {
+      const hashset_entry_t *entry = &other->entries[i];
+      if (entry->key)
+        self->entries[i] = (hashset_entry_t){
+            rcl_strdup(self->allocator, entry->key), entry->hash};
+    }
+    hashset_reserve(self, extra);
+    return self;
+  }
+
+  hashset_reserve(self, other->length + extra);
+  for (size_t i = 0; i < other->capacity; i++) {
+    const hashset_entry_t *entry = &other->entries[i];
+    if (entry->key)
+      hashset_place(self, rcl_strdup(self->allocator, entry->key),
+                    hashset_hash_of(self, other, entry));
+  }
+  return self;
+}
+
+hashset_t *hashset_union(const hashset_t *a, const hashset_t *b) {
+  const hashset_t *larger = a->length >= b->length ? a : b;
+  const hashset_t *smaller = larger == a ? b : a;
+  hashset_t *self = hashset_copy(a, larger, smaller->length);
+
+  for (size_t i = 0; i < smaller->capacity; i++) {
+    const hashset_entry_t *entry = &smaller->entries[i];
+    if (!entry->key)
+      continue;
+    size_t hash = hashset_hash_of(self, smaller, entry);
+    if (hashset_find(self, entry->key, hash) == NOT_FOUND)
+      hashset_place(self, rcl_strdup(self->allocator, entry->key), hash);
+  }
+  return self;
+}
+
+hashset_t *hashset_intersection(const hashset_t *a, const hashset_t *b) {
+  const hashset_t *larger = a->length >= b->length ? a : b;
+  const hashset_t *smaller = larger == a ? b : a;
+  hashset_t *self = hashset_new_like(a);
+
+  for (size_t i = 0; i < smaller->capacity; i++) {
+    const hashset_entry_t *entry = &smaller->entries[i];
+    if (entry->key &&
+        hashset_find(larger, entry->key,
+                     hashset_hash_of(larger, smaller, entry)) != NOT_FOUND)
+      hashset_place(self, rcl_strdup(self->allocator, entry->key),
+                    hashset_hash_of(self, smaller, entry));
+  }
+  return self;
+}
+
+hashset_t *hashset_difference(const hashset_t *a, const hashset_t *b) {
+  if (a->length <= b->length) {
+    hashset_t *self = hashset_new_like(a);
+    for (size_t i = 0; i < a->capacity; i++) {
+      const hashset_entry_t *entry = &a->entries[i];
+      if (entry->key && hashset_find(b, entry->key,
+                                     hashset_hash_of(b, a, entry)) == NOT_FOUND)
+        hashset_place(self, rcl_strdup(self->allocator, entry->key),
+                      entry->hash);
+    }
+    return self;
+  }
+
+  hashset_t *self = hashset_copy(a, a, 0);
+  for (size_t i = 0; i < b->capacity && self->length; i++) {
+    const hashset_entry_t *entry = &b->entries[i];
+    if (!entry->key)
+      continue;
+    size_t index =
+        hashset_find(self, entry->key, hashset_hash_of(self, b, entry));
+    if (index != NOT_FOUND)
+      hashset_erase(self, index);
+  }
+  return self;
+}
@@ -0,0 +1,985 @@
+#include "rcl/chashtable.h"
+#include "rcl/hashset.h"
+#include "rcl/hashtable.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+HASHTABLE_OF(int_map, uint64_t, uint64_t, hashtable_hash_int,
+             hashtable_eq_int)
+
+// Each measurement is repeated this many times and the median reported.
+#define TRIALS 5
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+typedef struct {
+  const char *name;
+  const char *unit;
+  double value;
+} bench_entry_t;
+
+// Dynamic array of results
+static bench_entry_t *g_results = NULL;
+static int g_results_count = 0;
+static int g_results_cap = 0;
+
+static void add_result(const char *name, const char *unit, double value) {
+  if (g_results_count >= g_results_cap) {
+    g_results_cap = g_results_cap ? g_results_cap * 2 : 32;
+    g_results = realloc(g_results, g_results_cap * sizeof(bench_entry_t));
+  }
+  g_results[g_results_count++] =
+      (bench_entry_t){.name = name, .unit = unit, .value = value};
+}
+
+static void print_results(void) {
+  printf("[\n");
+  for (int i = 0; i < g_results_count; i++) {
+    printf("  {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.2f}",
+           g_results[i].name, g_results[i].unit, g_results[i].value);
+    if (i + 1 < g_results_count)
+      putchar(',');
+    putchar('\n');
+  }
+  printf("]\n");
+}
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double median(double *samples, int count) {
+  qsort(samples, count, sizeof(*samples), cmp_double);
+  return samples[count / 2];
+}
+
+// Keeps the compiler from dropping work whose result is otherwise unused.
+static volatile size_t g_sink;
+
+typedef struct {
+  const char *name;
+  hashtable_hash_func_t func;
+} hash_option_t;
+
+static const hash_option_t g_hashes[] = {
+    {"wyhash", hashtable_hash_wyhash},
+    {"seeded", hashtable_hash_seeded},
+    {"fnv1a", hashtable_hash_fnv1a},
+};
+
+#define HASH_COUNT (sizeof(g_hashes) / sizeof(g_hashes[0]))
+
+typedef struct {
+  // Used in result names, e.g. "hashtable lookup - short keys (wyhash)".
+  const char *name;
+  // Text every key starts with; a counter makes each one unique.
+  const char *prefix;
+} key_set_t;
+
+static const key_set_t g_key_sets[] = {
+    // Typical of JSON object keys and identifiers
+    {"short keys", "k"},
+    // Typical of paths and URLs
+    {"long keys", "/usr/local/share/applications/org.example.LongName/"},
+};
+
+#define KEY_SET_COUNT (sizeof(g_key_sets) / sizeof(g_key_sets[0]))
+
+// Make `count` distinct keys. `salt` keeps keys made for misses apart from the
+// ones inserted.
+static char **make_keys(const char *prefix, size_t count, char salt) {
+  char **keys = malloc(count * sizeof(*keys));
+  char buf[128];
+  for (size_t i = 0; i < count; i++) {
+    snprintf(buf, sizeof(buf), "%s%c%zu", prefix, salt, i);
+    keys[i] = strdup(buf);
+  }
+  return keys;
+}
+
+static void free_keys(char **keys, size_t count) {
+  for (size_t i = 0; i < count; i++)
+    free(keys[i]);
+  free(keys);
+}
+
+static char *result_name(const char *what, const char *keys,
+                         const char *hash) {
+  char buf[128];
+  snprintf(buf, sizeof(buf), "hashtable %s - %s (%s)", what, keys, hash);
+  return strdup(buf);
+}
+
+static hashtable_t *build(hashtable_hash_func_t func,
+                          hashtable_layout_e layout, char **keys,
+                          size_t count) {
+  hashtable_t *table = hashtable_new_full((hashtable_init_t){
+      .capacity = 16,
+      .hash_func = func,
+      .layout = layout,
+  });
+  for (size_t i = 0; i < count; i++)
+    hashtable_set(table, keys[i], keys[i]);
+  return table;
+}
+
+// Average slots a lookup hit looks at, from `hashtable_stats`. The last
+// bucket of the histogram counts as its own length, so this is a lower bound.
+static double mean_probe_length(const hashtable_stats_t *stats) {
+  size_t probes = 0;
+  for (size_t p = 0; p < HASHTABLE_STATS_PROBE_LENGTHS; p++)
+    probes += (p + 1) * stats->probe_lengths[p];
+  return stats->length ? (double)probes / stats->length : 0;
+}
+
+// Hash, insert and look up `count` keys with each hash function, and report
+// how well each spreads the keys: the mean probe length and the furthest key
+// from its home slot.
+static void bench_hash_functions(size_t count) {
+  for (size_t k = 0; k < KEY_SET_COUNT; k++) {
+    const key_set_t *set = &g_key_sets[k];
+    char **keys = make_keys(set->prefix, count, 'a');
+    char **missing = make_keys(set->prefix, count, 'b');
+
+    for (size_t h = 0; h < HASH_COUNT; h++) {
+      const hash_option_t *hash = &g_hashes[h];
+      double hashing[TRIALS], insert[TRIALS], hit[TRIALS], miss[TRIALS];
+      hashtable_stats_t stats;
+
+      for (int t = 0; t < TRIALS; t++) {
+        double start = now_ns();
+        size_t sum = 0;
+        for (size_t i = 0; i < count; i++)
+          sum += hash->func(keys[i]);
+        g_sink = sum;
+        hashing[t] = (now_ns() - start) / count;
+
+        start = now_ns();
+        hashtable_t *table =
+            build(hash->func, HASHTABLE_LAYOUT_LINEAR, keys, count);
+        insert[t] = (now_ns() - start) / count;
+
+        start = now_ns();
+        for (size_t i = 0; i < count; i++)
+          sum += (size_t)hashtable_get(table, keys[i]);
+        g_sink = sum;
+        hit[t] = (now_ns() - start) / count;
+
+        start = now_ns();
+        for (size_t i = 0; i < count; i++)
+          sum += (size_t)hashtable_get(table, missing[i]);
+        g_sink = sum;
+        miss[t] = (now_ns() - start) / count;
+
+        stats = hashtable_stats(table);
+        hashtable_free(table);
+      }
+
+      add_result(result_name("hash", set->name, hash->name), "ns/op",
+                 median(hashing, TRIALS));
+      add_result(result_name("insert", set->name, hash->name), "ns/op",
+                 median(insert, TRIALS));
+      add_result(result_name("lookup hit", set->name, hash->name), "ns/op",
+                 median(hit, TRIALS));
+      add_result(result_name("lookup miss", set->name, hash->name), "ns/op",
+                 median(miss, TRIALS));
+      add_result(result_name("probe length", set->name, hash->name), "slots",
+                 mean_probe_length(&stats));
+      add_result(result_name("max displacement", set->name, hash->name),
+                 "slots", (double)stats.max_displacement);
+    }
+
+    free_keys(keys, count);
+    free_keys(missing, count);
+  }
+}
+
+typedef struct {
+  const char *name;
+  hashtable_layout_e layout;
+} layout_option_t;
+
+static const layout_option_t g_layouts[] = {
+    {"linear", HASHTABLE_LAYOUT_LINEAR},
+    {"swiss", HASHTABLE_LAYOUT_SWISS},
+    {"compact", HASHTABLE_LAYOUT_COMPACT},
+};
+
+#define LAYOUT_COUNT (sizeof(g_layouts) / sizeof(g_layouts[0]))
+
+// Insert and look up `count` short keys with each layout. Meant for large
+// tables, where every probed slot is a potential cache miss.
+static void bench_layouts(size_t count) {
+  char **keys = make_keys("k", count, 'a');
+  char **missing = make_keys("k", count, 'b');
+  char label[32];
+  snprintf(label, sizeof(label), "%zu keys", count);
+
+  for (size_t l = 0; l < LAYOUT_COUNT; l++) {
+    const layout_option_t *layout = &g_layouts[l];
+    double insert[TRIALS], hit[TRIALS], miss[TRIALS];
+
+    for (int t = 0; t < TRIALS; t++) {
+      size_t sum = 0;
+      double start = now_ns();
+      hashtable_t *table = build(NULL, layout->layout, keys, count);
+      insert[t] = (now_ns() - start) / count;
+
+      start = now_ns();
+      for (size_t i = 0; i < count; i++)
+        sum += (size_t)hashtable_get(table, keys[i]);
+      g_sink = sum;
+      hit[t] = (now_ns() - start) / count;
+
+      start = now_ns();
+      for (size_t i = 0; i < count; i++)
+        sum += (size_t)hashtable_get(table, missing[i]);
+      g_sink = sum;
+      miss[t] = (now_ns() - start) / count;
+
+      hashtable_free(table);
+    }
+
+    add_result(result_name("insert", label, layout->name), "ns/op",
+               median(insert, TRIALS));
+    add_result(result_name("lookup hit", label, layout->name), "ns/op",
+               median(hit, TRIALS));
+    add_result(result_name("lookup miss", label, layout->name), "ns/op",
+               median(miss, TRIALS));
+  }
+
+  free_keys(keys, count);
+  free_keys(missing, count);
+}
+
+// Look up `count` short keys in a linear table and in the same table after
+// `hashtable_freeze`. Also reports how long freezing takes, and the bytes per
+// key of the table's arrays (slots or items and the perfect hash, not the
+// keys).
+static void bench_frozen(size_t count) {
+  char **keys = make_keys("k", count, 'a');
+  char **missing = make_keys("k", count, 'b');
+  const char *names[2] = {"linear", "frozen"};
+  char label[32];
+  snprintf(label, sizeof(label), "%zu keys", count);
+
+  for (int v = 0; v < 2; v++) {
+    double freeze[TRIALS], hit[TRIALS], miss[TRIALS], memory = 0;
+
+    for (int t = 0; t < TRIALS; t++) {
+      size_t sum = 0;
+      hashtable_t *table = build(NULL, HASHTABLE_LAYOUT_LINEAR, keys, count);
+      double start = now_ns();
+      if (v == 1)
+        hashtable_freeze(table);
+      freeze[t] = (now_ns() - start) / count;
+      memory = (double)(table->capacity * sizeof(item_t) +
+                        table->buckets * sizeof(uint32_t)) /
+               count;
+
+      start = now_ns();
+      for (size_t i = 0; i < count; i++)
+        sum += (size_t)hashtable_get(table, keys[i]);
+      g_sink = sum;
+      hit[t] = (now_ns() - start) / count;
+
+      start = now_ns();
+      for (size_t i = 0; i < count; i++)
+        sum += (size_t)hashtable_get(table, missing[i]);
+      g_sink = sum;
+      miss[t] = (now_ns() - start) / count;
+
+      hashtable_free(table);
+    }
+
+    if (v == 1)
+      add_result(result_name("freeze", label, names[v]), "ns/op",
+                 median(freeze, TRIALS));
+    add_result(result_name("lookup hit", label, names[v]), "ns/op",
+               median(hit, TRIALS));
+    add_result(result_name("lookup miss", label, names[v]), "ns/op",
+               median(miss, TRIALS));
+    add_result(result_name("memory", label, names[v]), "bytes/key", memory);
+  }
+
+  free_keys(keys, count);
+  free_keys(missing, count);
+}
+
+// Time until `count` keys can be looked up: building a table from them, or
+// mapping an image of it saved with `hashtable_save`. Then time hits on each,
+// which for the mapped table read the records in the file.
+static void bench_mapped(size_t count) {
+  const char *path = "hashtable_bench.img";
+  char **keys = make_keys("k", count, 'a');
+  const char *names[2] = {"built", "mapped"};
+  char label[32];
+  snprintf(label, sizeof(label), "%zu keys", count);
+
+  hashtable_t *source = build(NULL, HASHTABLE_LAYOUT_LINEAR, keys, count);
+  double save[TRIALS];
+  for (int t = 0; t < TRIALS; t++) {
+    double start = now_ns();
+    hashtable_save(source, path, 0);
+    save[t] = (now_ns() - start) / count;
+  }
+  hashtable_free(source);
+  add_result(result_name("save", label, "mapped"), "ns/op",
+             median(save, TRIALS));
+
+  for (int v = 0; v < 2; v++) {
+    double ready[TRIALS], hit[TRIALS];
+
+    for (int t = 0; t < TRIALS; t++) {
+      size_t sum = 0;
+      double start = now_ns();
+      hashtable_t *table = v == 0
+                               ? build(NULL, HASHTABLE_LAYOUT_LINEAR, keys,
+                                       count)
+                               : hashtable_open_mapped(path);
+      ready[t] = now_ns() - start;
+
+      start = now_ns();
+      for (size_t i = 0; i < count; i++)
+        sum += (size_t)hashtable_get(table, keys[i]);
+      g_sink = sum;
+      hit[t] = (now_ns() - start) / count;
+
+      hashtable_free(table);
+    }
+
+    add_result(result_name("time to ready", label, names[v]), "us",
+               median(ready, TRIALS) / 1000);
+    add_result(result_name("lookup hit", label, names[v]), "ns/op",
+               median(hit, TRIALS));
+  }
+
+  remove(path);
+  free_keys(keys, count);
+}
+
+// Session-cache style churn: keep `live` keys in the table while `ops` new
+// ones are inserted and the oldest removed, then time misses on the churned
+// table. Deleted slots that are never cleaned up show as both growing.
+static void bench_churn(size_t live, size_t ops) {
+  char **keys = make_keys("k", live + ops, 'a');
+  char **missing = make_keys("k", live, 'b');
+  char label[32];
+  snprintf(label, sizeof(label), "%zu live keys", live);
+
+  for (size_t l = 0; l < LAYOUT_COUNT; l++) {
+    const layout_option_t *layout = &g_layouts[l];
+    double churn[TRIALS], miss[TRIALS];
+
+    for (int t = 0; t < TRIALS; t++) {
+      size_t sum = 0;
+      hashtable_t *table = build(NULL, layout->layout, keys, live);
+
+      double start = now_ns();
+      for (size_t i = 0; i < ops; i++) {
+        hashtable_set(table, keys[live + i], keys[live + i]);
+        hashtable_delete(table, keys[i]);
+      }
+      churn[t] = (now_ns() - start) / ops;
+
+      start = now_ns();
+      for (size_t i = 0; i < live; i++)
+        sum += (size_t)hashtable_get(table, missing[i]);
+      g_sink = sum;
+      miss[t] = (now_ns() - start) / live;
+
+      hashtable_free(table);
+    }
+
+    add_result(result_name("churn", label, layout->name), "ns/op",
+               median(churn, TRIALS));
+    add_result(result_name("lookup miss after churn", label, layout->name),
+               "ns/op", median(miss, TRIALS));
+  }
+
+  free_keys(keys, live + ops);
+  free_keys(missing, live);
+}
+
+// Look up `count` keys in random order, one `hashtable_get` at a time and
+// with `hashtable_get_many`, with each layout. Meant for tables much bigger
+// than the cache, where every lookup misses.
+static void bench_get_many(size_t count) {
+  char **keys = make_keys("k", count, 'a');
+  // Lookups in a shuffled order, so neighbouring keys' strings aren't
+  // neighbours in memory either.
+  const char **order = malloc(count * sizeof(*order));
+  void **values = malloc(count * sizeof(*values));
+  for (size_t i = 0; i < count; i++)
+    order[i] = keys[i];
+  srand(42);
+  for (size_t i = count - 1; i > 0; i--) {
+    size_t j = ((size_t)rand() * RAND_MAX + rand()) % (i + 1);
+    const char *tmp = order[i];
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+  char label[32];
+  snprintf(label, sizeof(label), "%zu keys", count);
+
+  for (size_t l = 0; l < LAYOUT_COUNT; l++) {
+    const layout_option_t *layout = &g_layouts[l];
+    hashtable_t *table = build(NULL, layout->layout, keys, count);
+    double loop[TRIALS], many[TRIALS];
+
+    for (int t = 0; t < TRIALS; t++) {
+      size_t sum = 0;
+      double start = now_ns();
+      for (size_t i = 0; i < count; i++)
+        sum += (size_t)hashtable_get(table, order[i]);
+      g_sink = sum;
+      loop[t] = (now_ns() - start) / count;
+
+      start = now_ns();
+      hashtable_get_many(table, order, count, values);
+      g_sink = (size_t)values[count - 1];
+      many[t] = (now_ns() - start) / count;
+    }
+
+    char variant[32];
+    snprintf(variant, sizeof(variant), "%s, get", layout->name);
+    add_result(result_name("lookup hit", label, variant), "ns/op",
+               median(loop, TRIALS));
+    snprintf(variant, sizeof(variant), "%s, get_many", layout->name);
+    add_result(result_name("lookup hit", label, variant), "ns/op",
+               median(many, TRIALS));
+    hashtable_free(table);
+  }
+
+  free(order);
+  free(values);
+  free_keys(keys, count);
+}
+
+// Count `count` words drawn from a vocabulary of a tenth as many, the usual
+// get-then-set way (two probes per word, three for a new one) and with
+// `hashtable_entry` (one).
+static void bench_word_count(size_t count) {
+  size_t vocabulary = count / 10 ? count / 10 : 1;
+  char **words = make_keys("w", vocabulary, 'a');
+  char **text = malloc(count * sizeof(*text));
+  srand(42);
+  for (size_t i = 0; i < count; i++)
+    text[i] = words[rand() % vocabulary];
+  double results[2][TRIALS];
+
+  for (int t = 0; t < TRIALS; t++) {
+    hashtable_t *table = hashtable_new_with_capacity(16);
+    double start = now_ns();
+    for (size_t i = 0; i < count; i++) {
+      size_t n = (size_t)hashtable_get(table, text[i]);
+      hashtable_set(table, text[i], (void *)(n + 1));
+    }
+    results[0][t] = (now_ns() - start) / count;
+    hashtable_free(table);
+
+    table = hashtable_new_with_capacity(16);
+    start = now_ns();
+    for (size_t i = 0; i < count; i++) {
+      void **n = hashtable_entry(table, text[i], NULL);
+      *n = (void *)((size_t)*n + 1);
+    }
+    results[1][t] = (now_ns() - start) / count;
+    hashtable_free(table);
+  }
+
+  char label[32];
+  snprintf(label, sizeof(label), "%zu words", count);
+  add_result(result_name("word count", label, "get+set"), "ns/op",
+             median(results[0], TRIALS));
+  add_result(result_name("word count", label, "entry"), "ns/op",
+             median(results[1], TRIALS));
+
+  free(text);
+  free_keys(words, vocabulary);
+}
+
+// Many small maps, most of them empty: every tenth gets 3 keys. Reports the
+// bytes allocated per map, the tables' own slots and keys included, for
+// tables created with the old default of 1024 slots, with `hashtable_new`,
+// which allocates slots on the first insert, and with the compact layout.
+static void bench_small_tables(size_t count) {
+  const char *keys[] = {"id", "name", "value"};
+  const char *names[3] = {"1024 slots", "hashtable_new", "compact"};
+  hashtable_t **tables = malloc(count * sizeof(*tables));
+  char label[32];
+  snprintf(label, sizeof(label), "%zu maps", count);
+
+  for (int v = 0; v < 3; v++) {
+    rcl_counting_allocator_t counter;
+    rcl_counting_allocator_init(&counter, NULL);
+    double start = now_ns();
+    for (size_t i = 0; i < count; i++) {
+      tables[i] = hashtable_new_full((hashtable_init_t){
+          .capacity = v == 0 ? 1024 : 0,
+          .allocator = &counter.allocator,
+          .layout = v == 2 ? HASHTABLE_LAYOUT_COMPACT : HASHTABLE_LAYOUT_LINEAR,
+      });
+      for (size_t k = 0; i % 10 == 0 && k < 3; k++)
+        hashtable_set(tables[i], keys[k], NULL);
+    }
+    double elapsed = (now_ns() - start) / count;
+
+    add_result(result_name("memory", label, names[v]), "bytes/map",
+               (double)counter.live_bytes / count);
+    add_result(result_name("create", label, names[v]), "ns/op", elapsed);
+    for (size_t i = 0; i < count; i++)
+      hashtable_free(tables[i]);
+  }
+
+  free(tables);
+}
+
+// `hashtable_foreach` with each layout, over `count` tables of 1024 slots
+// holding 3 keys each, and over one table of `count * 10` keys. Other layouts
+// visit every slot; compact tables only their items.
+static void bench_iterate(size_t count) {
+  const char *keys[] = {"id", "name", "value"};
+  char **many = make_keys("k", count * 10, 'a');
+  hashtable_t **tables = malloc(count * sizeof(*tables));
+  char sparse_label[32], full_label[32];
+  snprintf(sparse_label, sizeof(sparse_label), "%zu sparse maps", count);
+  snprintf(full_label, sizeof(full_label), "%zu keys", count * 10);
+
+  for (size_t l = 0; l < LAYOUT_COUNT; l++) {
+    const layout_option_t *layout = &g_layouts[l];
+    double sparse[TRIALS], full[TRIALS];
+
+    for (size_t i = 0; i < count; i++) {
+      tables[i] = hashtable_new_full((hashtable_init_t){
+          .capacity = 1024,
+          .layout = layout->layout,
+      });
+      for (size_t k = 0; k < 3; k++)
+        hashtable_set(tables[i], keys[k], (void *)keys[k]);
+    }
+    hashtable_t *table = build(NULL, layout->layout, many, count * 10);
+
+    for (int t = 0; t < TRIALS; t++) {
+      size_t sum = 0;
+      double start = now_ns();
+      // Not `i`, which `hashtable_foreach` declares.
+      for (size_t m = 0; m < count; m++)
+        hashtable_foreach(tables[m], { sum += (size_t)value; });
+      sparse[t] = (now_ns() - start) / count;
+
+      start = now_ns();
+      hashtable_foreach(table, { sum += (size_t)value; });
+      full[t] = (now_ns() - start) / (count * 10);
+      g_sink = sum;
+    }
+
+    add_result(result_name("iterate", sparse_label, layout->name), "ns/map",
+               median(sparse, TRIALS));
+    add_result(result_name("iterate", full_label, layout->name), "ns/item",
+               median(full, TRIALS));
+    for (size_t i = 0; i < count; i++)
+      hashtable_free(tables[i]);
+    hashtable_free(table);
+  }
+
+  free(tables);
+  free_keys(many, count * 10);
+}
+
+// Freeing a big table leaves its keys in glibc's fast bins, and the next
+// mid-sized allocation merges them all at once. Do that up front, so it
+// doesn't land in the timing of whichever insert comes next.
+static void settle_allocator(void) {
+#ifdef __GLIBC__
+  malloc_trim(0);
+#endif
+}
+
+// Time every insert into a table growing from empty to `count` keys, and
+// report the slowest, which is the insert that had to grow the table, next to
+// the mean. With `.incremental`, growing is spread over later writes.
+static void bench_insert_latency(size_t count) {
+  char **keys = make_keys("k", count, 'a');
+  char label[32];
+  snprintf(label, sizeof(label), "%zu keys", count);
+
+  for (size_t l = 0; l < LAYOUT_COUNT; l++) {
+    for (int incremental = 0; incremental < 2; incremental++) {
+      const layout_option_t *layout = &g_layouts[l];
+      double worst[TRIALS], mean[TRIALS];
+      // Compact tables only rebuild their index.
+      if (incremental && layout->layout == HASHTABLE_LAYOUT_COMPACT)
+        continue;
+
+      for (int t = 0; t < TRIALS; t++) {
+        settle_allocator();
+        hashtable_t *table = hashtable_new_full((hashtable_init_t){
+            .capacity = 16,
+            .layout = layout->layout,
+            .incremental = incremental,
+        });
+        double max = 0, total = 0;
+        for (size_t i = 0; i < count; i++) {
+          double start = now_ns();
+          hashtable_set(table, keys[i], keys[i]);
+          double elapsed = now_ns() - start;
+          total += elapsed;
+          if (elapsed > max)
+            max = elapsed;
+        }
+        worst[t] = max;
+        mean[t] = total / count;
+        hashtable_free(table);
+      }
+
+      char variant[32];
+      snprintf(variant, sizeof(variant), "%s%s", layout->name,
+               incremental ? ", incremental" : "");
+      add_result(result_name("insert max", label, variant), "ns",
+                 median(worst, TRIALS));
+      add_result(result_name("insert mean", label, variant), "ns/op",
+                 median(mean, TRIALS));
+    }
+  }
+
+  free_keys(keys, count);
+}
+
+// Bytes malloc has handed out, its own headers and padding included, or 0
+// where that can't be asked.
+static size_t heap_in_use(void) {
+#ifdef __GLIBC__
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+// Build a table of `count` short keys and free it, with a `strdup` per key
+// and with `.key_arena`. Reports the heap bytes per entry (keys, slots and
+// malloc's overhead) and the build and teardown time.
+static void bench_key_arena(size_t count) {
+  char **keys = make_keys("k", count, 'a');
+  const char *names[2] = {"strdup", "key arena"};
+  char label[32];
+  snprintf(label, sizeof(label), "%zu keys", count);
+
+  for (int v = 0; v < 2; v++) {
+    double build_time[TRIALS], free_time[TRIALS], memory[TRIALS];
+
+    for (int t = 0; t < TRIALS; t++) {
+      settle_allocator();
+      size_t before = heap_in_use();
+      double start = now_ns();
+      hashtable_t *table = hashtable_new_full((hashtable_init_t){
+          .key_arena = v == 1,
+      });
+      for (size_t i = 0; i < count; i++)
+        hashtable_set(table, keys[i], keys[i]);
+      build_time[t] = (now_ns() - start) / count;
+      memory[t] = (double)(heap_in_use() - before) / count;
+
+      start = now_ns();
+      hashtable_free(table);
+      free_time[t] = (now_ns() - start) / count;
+    }
+
+    add_result(result_name("memory", label, names[v]), "bytes/entry",
+               median(memory, TRIALS));
+    add_result(result_name("build", label, names[v]), "ns/op",
+               median(build_time, TRIALS));
+    add_result(result_name("free", label, names[v]), "ns/op",
+               median(free_time, TRIALS));
+  }
+
+  free_keys(keys, count);
+}
+
+// A set of `count` short keys as a `hashtable_t` with NULL values and as a
+// `hashset_t`: heap bytes per key, keys included, and lookups. Then the
+// intersection of a set of `count / 100` keys with one of `count`, with
+// `hashset_intersection` (which walks the smaller set) and by walking the
+// larger set.
+static void bench_sets(size_t count) {
+  char **keys = make_keys("k", count, 'a');
+  char **missing = make_keys("k", count, 'b');
+  const char *names[2] = {"hashtable_t", "hashset_t"};
+  char label[32];
+  snprintf(label, sizeof(label), "%zu keys", count);
+
+  for (int v = 0; v < 2; v++) {
+    double memory[TRIALS], hit[TRIALS], miss[TRIALS];
+
+    for (int t = 0; t < TRIALS; t++) {
+      size_t sum = 0;
+      settle_allocator();
+      size_t before = heap_in_use();
+      hashtable_t *table = NULL;
+      hashset_t *set = NULL;
+      if (v == 0) {
+        table = hashtable_new();
+        for (size_t i = 0; i < count; i++)
+          hashtable_set(table, keys[i], NULL);
+      } else {
+        set = hashset_new();
+        for (size_t i = 0; i < count; i++)
+          hashset_insert(set, keys[i]);
+      }
+      memory[t] = (double)(heap_in_use() - before) / count;
+
+      double start = now_ns();
+      for (size_t i = 0; i < count; i++)
+        sum += table ? hashtable_exists(table, keys[i])
+                     : hashset_contains(set, keys[i]);
+      g_sink = sum;
+      hit[t] = (now_ns() - start) / count;
+
+      start = now_ns();
+      for (size_t i = 0; i < count; i++)
+        sum += table ? hashtable_exists(table, missing[i])
+                     : hashset_contains(set, missing[i]);
+      g_sink = sum;
+      miss[t] = (now_ns() - start) / count;
+
+      hashtable_free(table);
+      hashset_free(set);
+    }
+
+    add_result(result_name("set memory", label, names[v]), "bytes/key",
+               median(memory, TRIALS));
+    add_result(result_name("set lookup hit", label, names[v]), "ns/op",
+               median(hit, TRIALS));
+    add_result(result_name("set lookup miss", label, names[v]), "ns/op",
+               median(miss, TRIALS));
+  }
+
+  // Every other key of the small set is in the large one.
+  size_t small_count = count / 100 ? count / 100 : 1;
+  hashset_t *large = hashset_new();
+  hashset_t *small = hashset_new();
+  for (size_t i = 0; i < count; i++)
+    hashset_insert(large, keys[i]);
+  for (size_t i = 0; i < small_count; i++)
+    hashset_insert(small, i % 2 ? missing[i] : keys[i * 50]);
+
+  double walk_smaller[TRIALS], walk_larger[TRIALS];
+  for (int t = 0; t < TRIALS; t++) {
+    double start = now_ns();
+    hashset_t *result = hashset_intersection(large, small);
+    walk_smaller[t] = (now_ns() - start) / 1e3;
+    g_sink = hashset_length(result);
+    hashset_free(result);
+
+    start = now_ns();
+    result = hashset_new();
+    hashset_foreach(large, {
+      if (hashset_contains(small, key))
+        hashset_insert(result, key);
+    });
+    walk_larger[t] = (now_ns() - start) / 1e3;
+    g_sink = hashset_length(result);
+    hashset_free(result);
+  }
+  snprintf(label, sizeof(label), "%zu & %zu keys", count, small_count);
+  add_result(result_name("set intersection", label, "walk smaller"), "us",
+             median(walk_smaller, TRIALS));
+  add_result(result_name("set intersection", label, "walk larger"), "us",
+             median(walk_larger, TRIALS));
+
+  hashset_free(small);
+  hashset_free(large);
+  free_keys(keys, count);
+  free_keys(missing, count);
+}
+
+// Integer-keyed map: `HASHTABLE_OF` against `hashtable_t` with the integers
+// formatted as keys, which is what `hashtable_t` users have to do.
+static void bench_typed(size_t count) {
+  char **keys = make_keys("", count, '1');
+  uint64_t *ints = malloc(count * sizeof(*ints));
+  for (size_t i = 0; i < count; i++)
+    ints[i] = strtoull(keys[i], NULL, 10);
+  double insert[2][TRIALS], hit[2][TRIALS];
+
+  for (int t = 0; t < TRIALS; t++) {
+    size_t sum = 0;
+    double start = now_ns();
+    hashtable_t *table = build(NULL, HASHTABLE_LAYOUT_LINEAR, keys, count);
+    insert[0][t] = (now_ns() - start) / count;
+
+    start = now_ns();
+    for (size_t i = 0; i < count; i++)
+      sum += (size_t)hashtable_get(table, keys[i]);
+    g_sink = sum;
+    hit[0][t] = (now_ns() - start) / count;
+    hashtable_free(table);
+
+    start = now_ns();
+    int_map_t *map = int_map_new(NULL);
+    for (size_t i = 0; i < count; i++)
+      int_map_set(map, ints[i], ints[i]);
+    insert[1][t] = (now_ns() - start) / count;
+
+    start = now_ns();
+    for (size_t i = 0; i < count; i++)
+      sum += *int_map_get(map, ints[i]);
+    g_sink = sum;
+    hit[1][t] = (now_ns() - start) / count;
+    int_map_free(map);
+  }
+
+  const char *names[2] = {"hashtable_t", "HASHTABLE_OF"};
+  for (int v = 0; v < 2; v++) {
+    add_result(result_name("insert", "int keys", names[v]), "ns/op",
+               median(insert[v], TRIALS));
+    add_result(result_name("lookup hit", "int keys", names[v]), "ns/op",
+               median(hit[v], TRIALS));
+  }
+
+  free_keys(keys, count);
+  free(ints);
+}
+
+// Operations each thread runs in `bench_concurrent`, and how many of every 100
+// are writes.
+#define CONCURRENT_OPS 1000000
+#define CONCURRENT_WRITE_PERCENT 5
+
+typedef struct {
+  chashtable_t *ctable;
+  // Used instead of `ctable` when set, guarded by `lock`
+  hashtable_t *table;
+  pthread_mutex_t *lock;
+  char **keys;
+  size_t count;
+  unsigned seed;
+} concurrent_worker_t;
+
+static void *concurrent_main(void *arg) {
+  concurrent_worker_t *worker = arg;
+  unsigned n = worker->seed;
+  size_t sum = 0;
+
+  for (size_t i = 0; i < CONCURRENT_OPS; i++) {
+    n = n * 1103515245 + 12345;
+    char *key = worker->keys[(n >> 8) % worker->count];
+    bool write = n % 100 < CONCURRENT_WRITE_PERCENT;
+
+    if (worker->table) {
+      pthread_mutex_lock(worker->lock);
+      if (write)
+        hashtable_set(worker->table, key, key);
+      else
+        sum += (size_t)hashtable_get(worker->table, key);
+      pthread_mutex_unlock(worker->lock);
+    } else if (write) {
+      chashtable_set(worker->ctable, key, key);
+    } else {
+      chashtable_guard_t guard = chashtable_read_begin(worker->ctable);
+      sum += (size_t)chashtable_get(worker->ctable, key);
+      chashtable_read_end(worker->ctable, guard);
+    }
+  }
+  g_sink = sum;
+  return NULL;
+}
+
+// Run `threads` workers over the table and return the wall time per operation
+// across all of them; with perfect scaling it halves as threads double.
+static double run_concurrent(concurrent_worker_t base, int threads) {
+  pthread_t ids[threads];
+  concurrent_worker_t workers[threads];
+
+  double start = now_ns();
+  for (int i = 0; i < threads; i++) {
+    workers[i] = base;
+    workers[i].seed = i + 1;
+    pthread_create(&ids[i], NULL, concurrent_main, &workers[i]);
+  }
+  for (int i = 0; i < threads; i++)
+    pthread_join(ids[i], NULL);
+  return (now_ns() - start) / ((double)CONCURRENT_OPS * threads);
+}
+
+// Shared read-mostly cache: a 95/5 get/set mix from 1, 2, 4... threads, up to
+// the number of cores, on a `chashtable_t` and on a `hashtable_t` behind a
+// mutex.
+static void bench_concurrent(size_t count) {
+  char **keys = make_keys("k", count, 'a');
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+  chashtable_t *ctable = chashtable_new();
+  for (size_t i = 0; i < count; i++)
+    chashtable_set(ctable, keys[i], keys[i]);
+  hashtable_t *table = build(NULL, HASHTABLE_LAYOUT_LINEAR, keys, count);
+
+  for (int threads = 1; threads == 1 || threads <= cores; threads *= 2) {
+    double shared[TRIALS], locked[TRIALS];
+    for (int t = 0; t < TRIALS; t++) {
+      shared[t] = run_concurrent(
+          (concurrent_worker_t){.ctable = ctable, .keys = keys, .count = count},
+          threads);
+      locked[t] = run_concurrent((concurrent_worker_t){.table = table,
+                                                       .lock = &lock,
+                                                       .keys = keys,
+                                                       .count = count},
+                                 threads);
+    }
+
+    char label[32];
+    snprintf(label, sizeof(label), "%d threads", threads);
+    add_result(result_name("95/5 get/set", label, "chashtable_t"), "ns/op",
+               median(shared, TRIALS));
+    add_result(result_name("95/5 get/set", label, "mutex"), "ns/op",
+               median(locked, TRIALS));
+  }
+
+  chashtable_free(ctable);
+  hashtable_free(table);
+  free_keys(keys, count);
+}
+
+int main(int argc, char **argv) {
+  size_t count = 100000;
+  if (argc > 1) {
+    count = strtoul(argv[1], NULL, 10);
+    if (count == 0) {
+      fprintf(stderr, "Usage: %s [keys]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  bench_hash_functions(count);
+  bench_layouts(count * 10);
+  bench_frozen(count * 10);
+  bench_mapped(count * 10);
+  bench_churn(count / 10, count * 10);
+  bench_insert_latency(count * 10);
+  bench_get_many(count * 10);
+  bench_word_count(count * 10);
+  bench_small_tables(count / 10 ? count / 10 : 1);
+  bench_iterate(count / 10 ? count / 10 : 1);
+  bench_key_arena(count * 10);
+  bench_sets(count * 10);
+  bench_typed(count);
+  bench_concurrent(count);
+
+  print_results();
+  return 0;
+}
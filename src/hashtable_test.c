@@ -1,11 +1,25 @@
 #include <rcl/hashtable.h>
 #include "unity.h"
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Force loads of collisions and resizes
 // #define HASHTABLE_DEFAULT_CAPACITY 2
 
+HASHTABLE_OF(int_map, uint64_t, double, hashtable_hash_int, hashtable_eq_int)
+
+typedef struct {
+  int32_t x;
+  int32_t y;
+} point_t;
+
+HASHTABLE_OF(point_map, point_t, int, hashtable_hash_fixed, hashtable_eq_fixed)
+
+HASHTABLE_OF(str_map, hashtable_str_t, size_t, hashtable_hash_str,
+             hashtable_eq_str)
+
 void setUp(void) {}
 
 void tearDown(void) {}
@@ -339,6 +353,1189 @@ static void test_hashtable_foreach_skips_tombstones(void) {
   hashtable_free(table);
 }
 
+static void test_hashtable_allocator(void) {
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+
+  hashtable_t *table = hashtable_new_full((hashtable_init_t){
+      .capacity = 4,
+      .free_func = free,
+      .allocator = &counter.allocator,
+  });
+
+  char key[16];
+  for (int i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    hashtable_set(table, key, malloc(1));
+  }
+  // Replacing a key through set_steal frees the old key with the allocator.
+  hashtable_set_steal(table, rcl_strdup(&counter.allocator, "key_0"),
+                      malloc(1));
+  hashtable_delete(table, "key_1");
+  TEST_ASSERT_EQUAL_size_t(99, table->length);
+  TEST_ASSERT_TRUE(counter.allocations > 100);
+
+  hashtable_free(table);
+  TEST_ASSERT_EQUAL_size_t(0, counter.live_bytes);
+}
+
+static size_t hash_calls = 0;
+
+static size_t counting_hash(const char *key) {
+  hash_calls++;
+  // A poor hash so that many keys share a stored hash and strcmp still has to
+  // tell them apart.
+  return (size_t)key[0];
+}
+
+static void test_hashtable_caches_hashes(void) {
+  hashtable_t *table = hashtable_new_full((hashtable_init_t){
+      .capacity = 4,
+      .hash_func = counting_hash,
+  });
+
+  char key[16];
+  for (int i = 0; i < 200; i++) {
+    snprintf(key, sizeof(key), "%c%d", 'a' + i % 3, i);
+    hashtable_set(table, key, (void *)(size_t)(i + 1));
+  }
+  // One hash per insert: growing reuses the stored hashes.
+  TEST_ASSERT_EQUAL_size_t(200, hash_calls);
+
+  for (int i = 0; i < 200; i++) {
+    snprintf(key, sizeof(key), "%c%d", 'a' + i % 3, i);
+    TEST_ASSERT_EQUAL_PTR((void *)(size_t)(i + 1), hashtable_get(table, key));
+  }
+  hashtable_foreach(table, {
+    TEST_ASSERT_EQUAL_size_t((size_t)key[0], table->items[i].hash);
+  });
+
+  hashtable_free(table);
+}
+
+static void test_hashtable_power_of_two_capacity(void) {
+  hashtable_t *table = hashtable_new_with_capacity(100);
+  TEST_ASSERT_EQUAL_size_t(128, table->capacity);
+
+  char key[16];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    hashtable_set(table, key, NULL);
+  }
+  TEST_ASSERT_EQUAL_size_t(0, table->capacity & (table->capacity - 1));
+  hashtable_free(table);
+
+  // Exactly enough room for the given number of items
+  TEST_ASSERT_EQUAL_size_t(16, hashtable_capacity_for(11));
+  TEST_ASSERT_EQUAL_size_t(32, hashtable_capacity_for(12));
+  table = hashtable_new_with_capacity(hashtable_capacity_for(11));
+  for (int i = 0; i < 11; i++) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    hashtable_set(table, key, NULL);
+  }
+  TEST_ASSERT_EQUAL_size_t(16, table->capacity);
+  hashtable_free(table);
+}
+
+static void test_hashtable_hash_functions(void) {
+  const char *keys[] = {
+      "", "a", "ab", "abc", "abcd", "abcdefgh", "abcdefghijklmnop",
+      "abcdefghijklmnopq",
+      "a key long enough to be hashed in several 48 byte rounds, and then "
+      "some more to take the 16 byte loop too",
+  };
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+    TEST_ASSERT_EQUAL_size_t(hashtable_hash_bytes(keys[i], strlen(keys[i])),
+                             hashtable_hash_wyhash(keys[i]));
+    for (size_t j = 0; j < i; j++) {
+      TEST_ASSERT_NOT_EQUAL(hashtable_hash_wyhash(keys[j]),
+                            hashtable_hash_wyhash(keys[i]));
+    }
+  }
+  // Bytes past the length don't count
+  TEST_ASSERT_EQUAL_size_t(hashtable_hash_wyhash("abc"),
+                           hashtable_hash_bytes("abcdef", 3));
+
+  // The seeded hash is stable within a process, and unrelated to the
+  // unseeded one.
+  for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+    TEST_ASSERT_EQUAL_size_t(hashtable_hash_seeded(keys[i]),
+                             hashtable_hash_seeded(keys[i]));
+    TEST_ASSERT_NOT_EQUAL(hashtable_hash_wyhash(keys[i]),
+                          hashtable_hash_seeded(keys[i]));
+    for (size_t j = 0; j < i; j++) {
+      TEST_ASSERT_NOT_EQUAL(hashtable_hash_seeded(keys[j]),
+                            hashtable_hash_seeded(keys[i]));
+    }
+  }
+}
+
+static void test_hashtable_hash_flooding(void) {
+  // Keys whose unseeded hashes all share their low 10 bits: every one of them
+  // starts its probe at the same slot of a table of up to 1024 slots.
+  char keys[64][16];
+  size_t count = 0;
+  for (unsigned n = 0; count < 64; n++) {
+    snprintf(keys[count], sizeof(keys[count]), "k%x", n);
+    if ((hashtable_hash_wyhash(keys[count]) & 1023) == 0)
+      count++;
+  }
+
+  hashtable_hash_func_t funcs[] = {hashtable_hash_wyhash,
+                                   hashtable_hash_seeded};
+  for (int f = 0; f < 2; f++) {
+    hashtable_t *table = hashtable_new_full((hashtable_init_t){
+        .hash_func = funcs[f],
+    });
+    for (size_t i = 0; i < count; i++)
+      hashtable_set(table, keys[i], NULL);
+    hashtable_stats_t stats = hashtable_stats(table);
+    if (f == 0)
+      TEST_ASSERT_EQUAL_size_t(63, stats.max_displacement);
+    else
+      TEST_ASSERT_TRUE(stats.max_displacement < 16);
+    hashtable_free(table);
+  }
+}
+
+static void test_hashtable_set_hash_func(void) {
+  hashtable_t *table = hashtable_new_with_capacity(8);
+  TEST_ASSERT_EQUAL_PTR(hashtable_hash_wyhash, table->hash_func);
+
+  char key[16];
+  for (int i = 0; i < 50; i++) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    hashtable_set(table, key, (void *)(size_t)(i + 1));
+  }
+  hashtable_delete(table, "key_7");
+
+  hash_calls = 0;
+  hashtable_set_hash_func(table, counting_hash);
+  TEST_ASSERT_EQUAL_size_t(49, hash_calls);
+  TEST_ASSERT_EQUAL_size_t(49, table->length);
+
+  for (int i = 0; i < 50; i++) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    TEST_ASSERT_EQUAL_PTR(i == 7 ? NULL : (void *)(size_t)(i + 1),
+                          hashtable_get(table, key));
+  }
+
+  hashtable_set_hash_func(table, hashtable_hash_fnv1a);
+  TEST_ASSERT_EQUAL_PTR((void *)(size_t)43, hashtable_get(table, "key_42"));
+  hashtable_foreach(table, {
+    TEST_ASSERT_EQUAL_size_t(hashtable_hash_fnv1a(key), table->items[i].hash);
+  });
+
+  hashtable_free(table);
+}
+
+static void test_hashtable_swiss_layout(void) {
+  hashtable_t *table = hashtable_new_full((hashtable_init_t){
+      .capacity = 4,
+      .free_func = free,
+      .layout = HASHTABLE_LAYOUT_SWISS,
+  });
+  TEST_ASSERT_EQUAL_size_t(16, table->capacity);
+
+  char key[16];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    int *value = malloc(sizeof(int));
+    *value = i;
+    hashtable_set(table, key, value);
+  }
+  TEST_ASSERT_EQUAL_size_t(1000, table->length);
+
+  for (int i = 0; i < 1000; i += 2) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    TEST_ASSERT_TRUE(hashtable_delete(table, key));
+  }
+  TEST_ASSERT_EQUAL_size_t(500, table->length);
+  TEST_ASSERT_EQUAL_size_t(500, table->tombstones);
+
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key_%d", i);
+    int *value = hashtable_get(table, key);
+    if (i % 2) {
+      TEST_ASSERT_NOT_NULL(value);
+      TEST_ASSERT_EQUAL_INT(i, *value);
+    } else {
+      TEST_ASSERT_NULL(value);
+      TEST_ASSERT_FALSE(hashtable_exists(table, key));
+    }
+  }
+
+  int count = 0;
+  hashtable_foreach(table, {
+    TEST_ASSERT_EQUAL_INT(1, *(int *)value % 2);
+    count++;
+  });
+  TEST_ASSERT_EQUAL_INT(500, count);
+
+  // Replacing keeps a single entry
+  hashtable_set(table, "key_1", NULL);
+  TEST_ASSERT_EQUAL_size_t(500, table->length);
+  TEST_ASSERT_TRUE(hashtable_exists(table, "key_1"));
+
+  hashtable_free(table);
+}
+
+static void test_hashtable_swiss_churn(void) {
+  // Every key shares its control tag and most share a group, and deleted
+  // slots pile up; lookups must still end and the table must not grow
+  // without bound.
+  hashtable_t *table = hashtable_new_full((hashtable_init_t){
+      .capacity = 16,
+      .hash_func = counting_hash,
+      .layout = HASHTABLE_LAYOUT_SWISS,
+  });
+
+  char key[16];
+  for (int i = 0; i < 5000; i++) {
+    snprintf(key, sizeof(key), "a%d", i);
+    hashtable_set(table, key, (void *)(size_t)(i + 1));
+    if (i >= 8) {
+      snprintf(key, sizeof(key), "a%d", i - 8);
+      TEST_ASSERT_TRUE(hashtable_delete(table, key));
+    }
+    TEST_ASSERT_FALSE(hashtable_exists(table, "missing"));
+  }
+  TEST_ASSERT_EQUAL_size_t(8, table->length);
+  TEST_ASSERT_TRUE(table->capacity <= 32);
+  TEST_ASSERT_EQUAL_PTR((void *)5000, hashtable_get(table, "a4999"));
+
+  hashtable_set_hash_func(table, NULL);
+  TEST_ASSERT_EQUAL_size_t(0, table->tombstones);
+  TEST_ASSERT_EQUAL_PTR((void *)4993, hashtable_get(table, "a4992"));
+
+  hashtable_free(table);
+}
+
+// Robin Hood invariant: an item is never further from home than the item
+// before it plus one, and never past an empty slot.
+static void assert_robin_hood(hashtable_t *table) {
+  size_t mask = table->capacity - 1;
+  for (size_t i = 0; i < table->capacity; i++) {
+    item_t *item = &table->items[i];
+    if (!item->key)
+      continue;
+    size_t dist = (i - item->hash) & mask;
+    if (dist == 0)
+      continue;
+    item_t *prev = &table->items[(i - 1) & mask];
+    TEST_ASSERT_NOT_NULL(prev->key);
+    TEST_ASSERT_TRUE(((i - 1 - prev->hash) & mask) + 1 >= dist);
+  }
+}
+
+static void test_hashtable_churn(void) {
+  // Heavy insert/delete churn with a poor hash: removal must not leave
+  // tombstones behind, so misses stay short and the table doesn't grow.
+  hashtable_t *table = hashtable_new_full((hashtable_init_t){
+      .capacity = 16,
+      .hash_func = counting_hash,
+  });
+
+  char key[16];
+  for (int i = 0; i < 5000; i++) {
+    snprintf(key, sizeof(key), "%c%d", 'a' + i % 5, i);
+    hashtable_set(table, key, (void *)(size_t)(i + 1));
+    if (i >= 8) {
+      snprintf(key, sizeof(key), "%c%d", 'a' + (i - 8) % 5, i - 8);
+      TEST_ASSERT_TRUE(hashtable_delete(table, key));
+    }
+    TEST_ASSERT_FALSE(hashtable_exists(table, "b-missing"));
+  }
+  assert_robin_hood(table);
+  TEST_ASSERT_EQUAL_size_t(8, table->length);
+  TEST_ASSERT_EQUAL_size_t(0, table->tombstones);
+  TEST_ASSERT_EQUAL_size_t(16, table->capacity);
+  for (int i = 4992; i < 5000; i++) {
+    snprintf(key, sizeof(key), "%c%d", 'a' + i % 5, i);
+    TEST_ASSERT_EQUAL_PTR((void *)(size_t)(i + 1), hashtable_get(table, key));
+  }
+
+  hashtable_free(table);
+}
+
+static void test_hashtable_robin_hood(void) {
+  hashtable_t *table = hashtable_new_with_capacity(64);
+
+  char key[16];
+  for (int round = 0; round < 20; round++) {
+    for (int i = 0; i < 500; i++) {
+      snprintf(key, sizeof(key), "k%d", (i * 7919 + round * 31) % 1000);
+      if ((i + round) % 3)
+        hashtable_set(table, key, NULL);
+      else
+        hashtable_delete(table, key);
+    }
+    assert_robin_hood(table);
+  }
+
+  size_t count = 0;
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    count += hashtable_exists(table, key);
+  }
+  TEST_ASSERT_EQUAL_size_t(table->length, count);
+
+  hashtable_free(table);
+}
+
+static void test_hashtable_incremental(void) {
+  hashtable_layout_e layouts[] = {HASHTABLE_LAYOUT_LINEAR,
+                                  HASHTABLE_LAYOUT_SWISS};
+
+  for (int l = 0; l < 2; l++) {
+    hashtable_t *table = hashtable_new_full((hashtable_init_t){
+        .capacity = 16,
+        .free_func = counting_free,
+        .layout = layouts[l],
+        .incremental = true,
+    });
+    free_count = 0;
+
+    char key[16];
+    bool resized = false;
+    for (int i = 0; i < 3000; i++) {
+      snprintf(key, sizeof(key), "k%d", i);
+      hashtable_set(table, key, malloc(1));
+      if (!table->old_items)
+        continue;
+      // Mid-resize: items are spread over both arrays and all findable.
+      resized = true;
+      TEST_ASSERT_TRUE(table->migrate_index <= table->old_capacity);
+      TEST_ASSERT_TRUE(hashtable_exists(table, "k0"));
+      snprintf(key, sizeof(key), "k%d", i / 2);
+      TEST_ASSERT_NOT_NULL(hashtable_get(table, key));
+    }
+    TEST_ASSERT_TRUE(resized);
+    TEST_ASSERT_EQUAL_size_t(3000, table->length);
+
+    // Start another resize, then write to keys still in the old arrays.
+    for (int i = 3000; table->old_items == NULL; i++) {
+      snprintf(key, sizeof(key), "k%d", i);
+      hashtable_set(table, key, malloc(1));
+    }
+    char old_keys[2][16];
+    for (size_t i = table->old_capacity - 1, found = 0; found < 2; i--) {
+      if (table->old_items[i].key)
+        strcpy(old_keys[found++], table->old_items[i].key);
+    }
+    hashtable_set(table, old_keys[0], malloc(1));
+    TEST_ASSERT_EQUAL(1, free_count);
+    TEST_ASSERT_TRUE(hashtable_delete(table, old_keys[1]));
+    TEST_ASSERT_FALSE(hashtable_exists(table, old_keys[1]));
+    TEST_ASSERT_EQUAL(2, free_count);
+    if (layouts[l] == HASHTABLE_LAYOUT_LINEAR)
+      assert_robin_hood(table);
+
+    // foreach finishes the resize and sees every item once.
+    size_t length = table->length;
+    size_t count = 0;
+    hashtable_foreach(table, { count++; });
+    TEST_ASSERT_NULL(table->old_items);
+    TEST_ASSERT_EQUAL_size_t(length, count);
+    for (int i = 0; i < 3000; i++) {
+      snprintf(key, sizeof(key), "k%d", i);
+      TEST_ASSERT_EQUAL(strcmp(key, old_keys[1]) != 0,
+                        hashtable_exists(table, key));
+    }
+
+    hashtable_free(table);
+    TEST_ASSERT_EQUAL(length + 2, free_count);
+  }
+}
+
+static void test_hashtable_get_many(void) {
+  hashtable_layout_e layouts[] = {HASHTABLE_LAYOUT_LINEAR,
+                                  HASHTABLE_LAYOUT_SWISS};
+
+  for (int l = 0; l < 2; l++) {
+    hashtable_t *table = hashtable_new_full((hashtable_init_t){
+        .capacity = 16,
+        .layout = layouts[l],
+        .incremental = true,
+    });
+
+    // Every other key is missing; the count isn't a multiple of the batch.
+    char names[1001][16];
+    const char *keys[1001];
+    for (int i = 0; i < 1001; i++) {
+      snprintf(names[i], sizeof(names[i]), "k%d", i);
+      keys[i] = names[i];
+      if (i % 2 == 0)
+        hashtable_set(table, keys[i], (void *)(size_t)(i + 1));
+    }
+    // Check mid-resize too, with items in both arrays.
+    for (int i = 1001; table->old_items == NULL; i++) {
+      char key[16];
+      snprintf(key, sizeof(key), "k%d", i);
+      hashtable_set(table, key, (void *)(size_t)(i + 1));
+    }
+
+    void *values[1001];
+    hashtable_get_many(table, keys, 1001, values);
+    for (int i = 0; i < 1001; i++) {
+      TEST_ASSERT_EQUAL_PTR(hashtable_get(table, keys[i]), values[i]);
+      TEST_ASSERT_EQUAL_PTR(i % 2 ? NULL : (void *)(size_t)(i + 1), values[i]);
+    }
+    hashtable_get_many(table, keys, 0, NULL);
+
+    hashtable_free(table);
+  }
+}
+
+static void test_hashtable_entry(void) {
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+  hashtable_t *table = hashtable_new_full((hashtable_init_t){
+      .capacity = 64,
+      .hash_func = counting_hash,
+      .allocator = &counter.allocator,
+  });
+  size_t allocations = counter.allocations;
+  hash_calls = 0;
+
+  const char *words[] = {"the", "cat", "the", "hat", "the", "cat"};
+  bool inserted;
+  for (int i = 0; i < 6; i++) {
+    void **count = hashtable_entry(table, words[i], &inserted);
+    TEST_ASSERT_EQUAL(i == 0 || i == 1 || i == 3, inserted);
+    *count = (void *)((size_t)*count + 1);
+  }
+  // One hash per call, and a key copy only for each new word.
+  TEST_ASSERT_EQUAL_size_t(6, hash_calls);
+  TEST_ASSERT_EQUAL_size_t(allocations + 3, counter.allocations);
+  TEST_ASSERT_EQUAL_size_t(3, table->length);
+  TEST_ASSERT_EQUAL_PTR((void *)3, hashtable_get(table, "the"));
+  TEST_ASSERT_EQUAL_PTR((void *)2, hashtable_get(table, "cat"));
+  TEST_ASSERT_EQUAL_PTR((void *)1, hashtable_get(table, "hat"));
+  hashtable_free(table);
+  TEST_ASSERT_EQUAL_size_t(0, counter.live_bytes);
+
+  // The returned pointer is the new key's, even when placing it pushes other
+  // items along or grows the table.
+  hashtable_layout_e layouts[] = {HASHTABLE_LAYOUT_LINEAR,
+                                  HASHTABLE_LAYOUT_SWISS};
+  for (int l = 0; l < 2; l++) {
+    table = hashtable_new_full((hashtable_init_t){
+        .capacity = 16,
+        .hash_func = counting_hash,
+        .layout = layouts[l],
+    });
+    char key[16];
+    for (int i = 0; i < 2000; i++) {
+      snprintf(key, sizeof(key), "%c%d", 'a' + i % 7, i);
+      void **value = hashtable_entry(table, key, NULL);
+      TEST_ASSERT_NULL(*value);
+      *value = (void *)(size_t)(i + 1);
+    }
+    for (int i = 0; i < 2000; i++) {
+      snprintf(key, sizeof(key), "%c%d", 'a' + i % 7, i);
+      TEST_ASSERT_EQUAL_PTR((void *)(size_t)(i + 1),
+                            hashtable_get(table, key));
+    }
+    hashtable_free(table);
+  }
+}
+
+static void test_hashtable_lazy(void) {
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+  hashtable_t *table = hashtable_new_full((hashtable_init_t){
+      .allocator = &counter.allocator,
+  });
+
+  // Only the table itself until the first insert.
+  TEST_ASSERT_EQUAL_size_t(1, counter.allocations);
+  TEST_ASSERT_EQUAL_size_t(0, table->capacity);
+  TEST_ASSERT_NULL(hashtable_get(table, "a"));
+  TEST_ASSERT_FALSE(hashtable_delete(table, "a"));
+  const char *keys[] = {"a", "b"};
+  void *values[2] = {(void *)1, (void *)1};
+  hashtable_get_many(table, keys, 2, values);
+  TEST_ASSERT_NULL(values[0]);
+  size_t count = 0;
+  hashtable_foreach(table, { count++; });
+  TEST_ASSERT_EQUAL_size_t(0, count);
+  TEST_ASSERT_EQUAL_size_t(1, counter.allocations);
+
+  hashtable_set(table, "a", (void *)1);
+  TEST_ASSERT_EQUAL_size_t(8, table->capacity);
+  TEST_ASSERT_EQUAL_PTR((void *)1, hashtable_get(table, "a"));
+
+  hashtable_reserve(table, 100);
+  TEST_ASSERT_EQUAL_size_t(hashtable_capacity_for(100), table->capacity);
+  size_t capacity = table->capacity;
+  char key[16];
+  for (int i = 0; i < 99; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    hashtable_set(table, key, (void *)(size_t)(i + 1));
+  }
+  TEST_ASSERT_EQUAL_size_t(capacity, table->capacity);
+  hashtable_reserve(table, 10);
+  TEST_ASSERT_EQUAL_size_t(capacity, table->capacity);
+
+  for (int i = 10; i < 99; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    hashtable_delete(table, key);
+  }
+  hashtable_shrink_to_fit(table);
+  TEST_ASSERT_EQUAL_size_t(hashtable_capacity_for(11), table->capacity);
+  TEST_ASSERT_EQUAL_PTR((void *)10, hashtable_get(table, "k9"));
+  TEST_ASSERT_EQUAL_PTR((void *)1, hashtable_get(table, "a"));
+
+  hashtable_delete(table, "a");
+  for (int i = 0; i < 10; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    hashtable_delete(table, key);
+  }
+  hashtable_shrink_to_fit(table);
+  TEST_ASSERT_EQUAL_size_t(0, table->capacity);
+  TEST_ASSERT_NULL(table->items);
+  TEST_ASSERT_EQUAL_size_t(sizeof(*table), counter.live_bytes);
+  hashtable_set(table, "b", NULL);
+  TEST_ASSERT_TRUE(hashtable_exists(table, "b"));
+  hashtable_free(table);
+  TEST_ASSERT_EQUAL_size_t(0, counter.live_bytes);
+
+  // Swiss tables start at a whole group.
+  table = hashtable_new_full((hashtable_init_t){
+      .layout = HASHTABLE_LAYOUT_SWISS,
+  });
+  TEST_ASSERT_NULL(table->ctrl);
+  hashtable_set(table, "a", NULL);
+  TEST_ASSERT_EQUAL_size_t(16, table->capacity);
+  hashtable_shrink_to_fit(table);
+  TEST_ASSERT_EQUAL_size_t(16, table->capacity);
+  TEST_ASSERT_TRUE(hashtable_exists(table, "a"));
+  hashtable_free(table);
+}
+
+static void test_hashtable_key_arena(void) {
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+  hashtable_layout_e layouts[] = {HASHTABLE_LAYOUT_LINEAR,
+                                  HASHTABLE_LAYOUT_SWISS,
+                                  HASHTABLE_LAYOUT_COMPACT};
+
+  for (int l = 0; l < 6; l++) {
+    hashtable_t *table = hashtable_new_full((hashtable_init_t){
+        .capacity = 16,
+        .free_func = free,
+        .allocator = &counter.allocator,
+        .layout = layouts[l % 3],
+        .incremental = l >= 3,
+        .key_arena = true,
+    });
+    rcl_counting_allocator_reset(&counter);
+
+    char key[16];
+    for (int i = 0; i < 1000; i++) {
+      snprintf(key, sizeof(key), "k%d", i);
+      hashtable_set(table, key, malloc(1));
+    }
+    // A few chunks and item arrays instead of an allocation per key.
+    TEST_ASSERT_TRUE(counter.allocations < 40);
+    // Replacing a value doesn't copy the key again.
+    size_t allocations = counter.allocations;
+    hashtable_set(table, "k1", malloc(1));
+    TEST_ASSERT_EQUAL_size_t(allocations, counter.allocations);
+    hashtable_set_steal(table, rcl_strdup(&counter.allocator, "k2"),
+                        malloc(1));
+    hashtable_set_steal(table, rcl_strdup(&counter.allocator, "new"),
+                        malloc(1));
+    TEST_ASSERT_TRUE(hashtable_exists(table, "new"));
+
+    // Churn: removed keys' bytes are reclaimed by compaction.
+    for (int i = 1000; i < 20000; i++) {
+      snprintf(key, sizeof(key), "k%d", i);
+      hashtable_set(table, key, malloc(1));
+      snprintf(key, sizeof(key), "k%d", i - 1000);
+      TEST_ASSERT_TRUE(hashtable_delete(table, key));
+    }
+    // Without compaction, all 20000 keys' bytes would still be there.
+    size_t live = table->key_bytes - table->key_garbage;
+    TEST_ASSERT_TRUE(table->key_bytes < 4 * live + 2 * 4096);
+    for (int i = 19000; i < 20000; i++) {
+      snprintf(key, sizeof(key), "k%d", i);
+      void *value;
+      TEST_ASSERT_TRUE(hashtable_remove(table, key, &value));
+      free(value);
+    }
+    TEST_ASSERT_EQUAL_size_t(1, table->length);
+    hashtable_shrink_to_fit(table);
+    TEST_ASSERT_EQUAL_size_t(0, table->key_garbage);
+    TEST_ASSERT_TRUE(hashtable_exists(table, "new"));
+
+    size_t count = 0;
+    hashtable_foreach(table, {
+      TEST_ASSERT_EQUAL_STRING("new", key);
+      count++;
+    });
+    TEST_ASSERT_EQUAL_size_t(1, count);
+    hashtable_free(table);
+    TEST_ASSERT_EQUAL_size_t(0, counter.live_bytes);
+  }
+}
+
+// Visits the keys of a compact table in order, checking they are "k<i>" for
+// the `i`s in `expected`.
+static void assert_compact_order(hashtable_t *table, const int *expected,
+                                 size_t count) {
+  char key_buf[16];
+  size_t n = 0;
+  hashtable_foreach(table, {
+    TEST_ASSERT_TRUE(n < count);
+    snprintf(key_buf, sizeof(key_buf), "k%d", expected[n]);
+    TEST_ASSERT_EQUAL_STRING(key_buf, key);
+    TEST_ASSERT_EQUAL_PTR((void *)(size_t)(expected[n] + 1), value);
+    n++;
+  });
+  TEST_ASSERT_EQUAL_size_t(count, n);
+}
+
+static void test_hashtable_compact(void) {
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+  hashtable_t *table = hashtable_new_full((hashtable_init_t){
+      .allocator = &counter.allocator,
+      .layout = HASHTABLE_LAYOUT_COMPACT,
+      .incremental = true,
+  });
+  TEST_ASSERT_FALSE(table->incremental);
+
+  int expected[300];
+  char key[16];
+  for (int i = 0; i < 300; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    hashtable_set(table, key, (void *)(size_t)(i + 1));
+    expected[i] = i;
+  }
+  // Items are dense: only the index is sized by the load factor.
+  TEST_ASSERT_EQUAL_size_t(hashtable_capacity_for(300), table->capacity);
+  TEST_ASSERT_EQUAL_size_t(300, table->used);
+  TEST_ASSERT_TRUE(table->items_capacity < 2 * 300);
+  assert_compact_order(table, expected, 300);
+
+  // Removing leaves the others in order; a new key goes last, even if it was
+  // removed before.
+  for (int i = 1; i < 300; i += 2) {
+    snprintf(key, sizeof(key), "k%d", i);
+    TEST_ASSERT_TRUE(hashtable_delete(table, key));
+  }
+  TEST_ASSERT_FALSE(hashtable_exists(table, "k1"));
+  hashtable_set(table, "k1", (void *)2);
+  for (int i = 0; i < 150; i++)
+    expected[i] = 2 * i;
+  expected[150] = 1;
+  assert_compact_order(table, expected, 151);
+  // Replacing a value keeps its place.
+  hashtable_set(table, "k0", (void *)1);
+  assert_compact_order(table, expected, 151);
+
+  // The last item's slot is given back.
+  size_t used = table->used;
+  TEST_ASSERT_TRUE(hashtable_delete(table, "k1"));
+  TEST_ASSERT_EQUAL_size_t(used - 1, table->used);
+
+  hashtable_shrink_to_fit(table);
+  TEST_ASSERT_EQUAL_size_t(150, table->used);
+  TEST_ASSERT_EQUAL_size_t(150, table->items_capacity);
+  TEST_ASSERT_EQUAL_size_t(hashtable_capacity_for(150), table->capacity);
+  assert_compact_order(table, expected, 150);
+
+  // Churn: holes are squeezed out instead of piling up.
+  for (int i = 300; i < 20000; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    hashtable_set(table, key, (void *)(size_t)(i + 1));
+    snprintf(key, sizeof(key), "k%d", i - 300);
+    hashtable_delete(table, key);
+  }
+  TEST_ASSERT_EQUAL_size_t(300, table->length);
+  TEST_ASSERT_TRUE(table->used < 3 * table->length);
+  TEST_ASSERT_TRUE(table->capacity <= hashtable_capacity_for(600));
+  for (int i = 0; i < 300; i++)
+    expected[i] = 19700 + i;
+  assert_compact_order(table, expected, 300);
+
+  const char *keys[] = {"k19700", "k0", "k19999"};
+  void *values[3];
+  hashtable_get_many(table, keys, 3, values);
+  TEST_ASSERT_EQUAL_PTR((void *)19701, values[0]);
+  TEST_ASSERT_NULL(values[1]);
+  TEST_ASSERT_EQUAL_PTR((void *)20000, values[2]);
+
+  bool inserted;
+  void **slot = hashtable_entry(table, "k19800", &inserted);
+  TEST_ASSERT_FALSE(inserted);
+  TEST_ASSERT_EQUAL_PTR((void *)19801, *slot);
+
+  // Rehashing keeps the order too.
+  hashtable_set_hash_func(table, hashtable_hash_fnv1a);
+  assert_compact_order(table, expected, 300);
+  TEST_ASSERT_EQUAL_PTR((void *)19851, hashtable_get(table, "k19850"));
+
+  // Reserving takes room for exactly that many items.
+  hashtable_free(table);
+  table = hashtable_new_full((hashtable_init_t){
+      .allocator = &counter.allocator,
+      .layout = HASHTABLE_LAYOUT_COMPACT,
+  });
+  hashtable_reserve(table, 3);
+  TEST_ASSERT_EQUAL_size_t(3, table->items_capacity);
+  TEST_ASSERT_EQUAL_size_t(hashtable_capacity_for(3), table->capacity);
+  size_t allocations = counter.allocations + counter.reallocations;
+  for (int i = 0; i < 3; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    hashtable_set(table, key, (void *)(size_t)(i + 1));
+  }
+  // Just the keys.
+  TEST_ASSERT_EQUAL_size_t(allocations + 3,
+                           counter.allocations + counter.reallocations);
+  assert_compact_order(table, (int[]){0, 1, 2}, 3);
+
+  hashtable_free(table);
+  TEST_ASSERT_EQUAL_size_t(0, counter.live_bytes);
+}
+
+static size_t first_char_hash(const char *key) { return (size_t)key[0]; }
+
+static void test_hashtable_freeze(void) {
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+  hashtable_layout_e layouts[] = {HASHTABLE_LAYOUT_LINEAR,
+                                  HASHTABLE_LAYOUT_SWISS,
+                                  HASHTABLE_LAYOUT_COMPACT};
+  char key[16];
+
+  for (int l = 0; l < 6; l++) {
+    hashtable_t *table = hashtable_new_full((hashtable_init_t){
+        .free_func = free,
+        .allocator = &counter.allocator,
+        .layout = layouts[l % 3],
+        .incremental = l >= 3,
+        .key_arena = l >= 3,
+    });
+    for (int i = 0; i < 5000; i++) {
+      snprintf(key, sizeof(key), "k%d", i);
+      int *value = malloc(sizeof(*value));
+      *value = i;
+      hashtable_set(table, key, value);
+    }
+    // A few removed keys, and with `.incremental` a resize in progress.
+    for (int i = 0; i < 50; i++) {
+      snprintf(key, sizeof(key), "k%d", i * 7);
+      hashtable_delete(table, key);
+    }
+
+    TEST_ASSERT_TRUE(hashtable_freeze(table));
+    TEST_ASSERT_TRUE(table->frozen);
+    TEST_ASSERT_EQUAL_size_t(4950, table->length);
+    TEST_ASSERT_EQUAL_size_t(4950, table->capacity);
+    TEST_ASSERT_NULL(table->old_items);
+    for (int i = 0; i < 5000; i++) {
+      snprintf(key, sizeof(key), "k%d", i);
+      int *value = hashtable_get(table, key);
+      if (i % 7 == 0 && i / 7 < 50) {
+        TEST_ASSERT_NULL(value);
+      } else {
+        TEST_ASSERT_NOT_NULL(value);
+        TEST_ASSERT_EQUAL_INT(i, *value);
+      }
+      snprintf(key, sizeof(key), "x%d", i);
+      TEST_ASSERT_FALSE(hashtable_exists(table, key));
+    }
+    const char *keys[] = {"k1", "k0", "k4999", "nope"};
+    void *values[4];
+    hashtable_get_many(table, keys, 4, values);
+    TEST_ASSERT_EQUAL_INT(1, *(int *)values[0]);
+    TEST_ASSERT_NULL(values[1]);
+    TEST_ASSERT_EQUAL_INT(4999, *(int *)values[2]);
+    TEST_ASSERT_NULL(values[3]);
+    size_t count = 0;
+    hashtable_foreach(table, { count++; });
+    TEST_ASSERT_EQUAL_size_t(4950, count);
+
+    // Replacing a value keeps it frozen.
+    int *value = malloc(sizeof(*value));
+    *value = -1;
+    hashtable_set(table, "k1", value);
+    bool inserted;
+    TEST_ASSERT_EQUAL_PTR(value, *hashtable_entry(table, "k1", &inserted));
+    TEST_ASSERT_FALSE(inserted);
+    TEST_ASSERT_TRUE(table->frozen);
+
+    // Adding or removing keys thaws it.
+    hashtable_set(table, "new", malloc(1));
+    TEST_ASSERT_FALSE(table->frozen);
+    TEST_ASSERT_EQUAL_INT(-1, *(int *)hashtable_get(table, "k1"));
+    TEST_ASSERT_TRUE(hashtable_exists(table, "new"));
+    TEST_ASSERT_TRUE(hashtable_freeze(table));
+    TEST_ASSERT_TRUE(hashtable_delete(table, "new"));
+    TEST_ASSERT_FALSE(table->frozen);
+    TEST_ASSERT_EQUAL_size_t(4950, table->length);
+    TEST_ASSERT_EQUAL_INT(4999, *(int *)hashtable_get(table, "k4999"));
+
+    hashtable_free(table);
+    TEST_ASSERT_EQUAL_size_t(0, counter.live_bytes);
+  }
+
+  // Empty tables freeze too.
+  hashtable_t *table = hashtable_new();
+  TEST_ASSERT_TRUE(hashtable_freeze(table));
+  TEST_ASSERT_NULL(hashtable_get(table, "a"));
+  hashtable_set(table, "a", (void *)1);
+  TEST_ASSERT_EQUAL_PTR((void *)1, hashtable_get(table, "a"));
+  hashtable_free(table);
+
+  // Keys with the same hash can't be told apart; the table stays usable.
+  table = hashtable_new_full((hashtable_init_t){
+      .hash_func = first_char_hash,
+  });
+  hashtable_set(table, "ab", (void *)1);
+  hashtable_set(table, "ac", (void *)2);
+  TEST_ASSERT_FALSE(hashtable_freeze(table));
+  TEST_ASSERT_FALSE(table->frozen);
+  TEST_ASSERT_EQUAL_PTR((void *)2, hashtable_get(table, "ac"));
+  hashtable_free(table);
+}
+
+typedef struct {
+  int id;
+  double weight;
+  char tag[5];
+} record_t;
+
+static void test_hashtable_save(void) {
+  const char *path = "hashtable_test.img";
+  char key[16];
+
+  // Integer values, from a table with its own hash function.
+  hashtable_t *table = hashtable_new_full((hashtable_init_t){
+      .hash_func = hashtable_hash_fnv1a,
+      .layout = HASHTABLE_LAYOUT_SWISS,
+  });
+  for (intptr_t i = 0; i < 3000; i++) {
+    snprintf(key, sizeof(key), "k%d", (int)i);
+    hashtable_set(table, key, (void *)i);
+  }
+  TEST_ASSERT_TRUE(hashtable_save(table, path, 0));
+  hashtable_free(table);
+
+  table = hashtable_open_mapped(path);
+  TEST_ASSERT_NOT_NULL(table);
+  TEST_ASSERT_TRUE(table->frozen);
+  TEST_ASSERT_EQUAL_size_t(3000, table->length);
+  for (intptr_t i = 0; i < 3000; i++) {
+    snprintf(key, sizeof(key), "k%d", (int)i);
+    TEST_ASSERT_EQUAL_PTR((void *)i, hashtable_get(table, key));
+    snprintf(key, sizeof(key), "x%d", (int)i);
+    TEST_ASSERT_FALSE(hashtable_exists(table, key));
+  }
+  const char *keys[] = {"k1", "k2999", "nope"};
+  void *values[3];
+  hashtable_get_many(table, keys, 3, values);
+  TEST_ASSERT_EQUAL_PTR((void *)1, values[0]);
+  TEST_ASSERT_EQUAL_PTR((void *)2999, values[1]);
+  TEST_ASSERT_NULL(values[2]);
+  // Lookups read the file; nothing is loaded yet.
+  TEST_ASSERT_NULL(table->items);
+
+  // Iterating loads the items, and then the table works like any other.
+  intptr_t sum = 0;
+  hashtable_foreach(table, { sum += (intptr_t)value; });
+  TEST_ASSERT_EQUAL_INT64(3000 * 2999 / 2, sum);
+  TEST_ASSERT_NOT_NULL(table->items);
+  TEST_ASSERT_EQUAL_PTR((void *)7, hashtable_get(table, "k7"));
+  hashtable_set(table, "new", (void *)-1);
+  TEST_ASSERT_TRUE(hashtable_delete(table, "k7"));
+  TEST_ASSERT_EQUAL_size_t(3000, table->length);
+  TEST_ASSERT_EQUAL_PTR((void *)-1, hashtable_get(table, "new"));
+  TEST_ASSERT_EQUAL_PTR((void *)8, hashtable_get(table, "k8"));
+  hashtable_free(table);
+
+  // Writing first loads them too.
+  table = hashtable_open_mapped(path);
+  hashtable_set(table, "k3", (void *)-3);
+  TEST_ASSERT_EQUAL_PTR((void *)-3, hashtable_get(table, "k3"));
+  TEST_ASSERT_TRUE(hashtable_delete(table, "k4"));
+  TEST_ASSERT_EQUAL_size_t(2999, table->length);
+  TEST_ASSERT_EQUAL_PTR((void *)5, hashtable_get(table, "k5"));
+  hashtable_free(table);
+
+  // Struct values are copied into the file, NULL ones included.
+  table = hashtable_new();
+  record_t records[100];
+  for (int i = 0; i < 100; i++) {
+    records[i] = (record_t){.id = i, .weight = i / 4.0};
+    snprintf(records[i].tag, sizeof(records[i].tag), "t%02d", i % 100);
+    snprintf(key, sizeof(key), "r%d", i);
+    hashtable_set(table, key, i % 10 ? &records[i] : NULL);
+  }
+  TEST_ASSERT_TRUE(hashtable_save(table, path, sizeof(record_t)));
+  hashtable_free(table);
+
+  table = hashtable_open_mapped(path);
+  TEST_ASSERT_NOT_NULL(table);
+  for (int i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "r%d", i);
+    TEST_ASSERT_TRUE(hashtable_exists(table, key));
+    const record_t *record = hashtable_get(table, key);
+    if (i % 10 == 0) {
+      TEST_ASSERT_NULL(record);
+      continue;
+    }
+    TEST_ASSERT_NOT_NULL(record);
+    TEST_ASSERT_EQUAL_INT(i, record->id);
+    TEST_ASSERT_EQUAL_DOUBLE(i / 4.0, record->weight);
+    TEST_ASSERT_EQUAL_STRING(records[i].tag, record->tag);
+  }
+  // Loading keeps the values pointing into the file.
+  const record_t *before = hashtable_get(table, "r5");
+  hashtable_foreach(table, {});
+  TEST_ASSERT_EQUAL_PTR(before, hashtable_get(table, "r5"));
+  hashtable_free(table);
+
+  // Empty tables, and keys whose own hashes collide.
+  table = hashtable_new();
+  TEST_ASSERT_TRUE(hashtable_save(table, path, 0));
+  hashtable_free(table);
+  table = hashtable_open_mapped(path);
+  TEST_ASSERT_NOT_NULL(table);
+  TEST_ASSERT_EQUAL_size_t(0, table->length);
+  TEST_ASSERT_NULL(hashtable_get(table, "a"));
+  hashtable_set(table, "a", (void *)1);
+  TEST_ASSERT_EQUAL_PTR((void *)1, hashtable_get(table, "a"));
+  hashtable_free(table);
+
+  table = hashtable_new_full((hashtable_init_t){.hash_func = first_char_hash});
+  hashtable_set(table, "ab", (void *)1);
+  hashtable_set(table, "ac", (void *)2);
+  TEST_ASSERT_TRUE(hashtable_save(table, path, 0));
+  hashtable_free(table);
+  table = hashtable_open_mapped(path);
+  TEST_ASSERT_EQUAL_PTR((void *)2, hashtable_get(table, "ac"));
+  hashtable_free(table);
+
+  // A record whose key offset points past the keys, in an otherwise valid
+  // image. The offsets are those of the header `hashtable_save` writes.
+  table = hashtable_new();
+  hashtable_set(table, "only", (void *)1);
+  TEST_ASSERT_TRUE(hashtable_save(table, path, 0));
+  hashtable_free(table);
+  FILE *file = fopen(path, "r+b");
+  uint64_t records_offset, bad_key = 1 << 20;
+  fseek(file, 64, SEEK_SET);
+  TEST_ASSERT_EQUAL_size_t(
+      1, fread(&records_offset, sizeof(records_offset), 1, file));
+  fseek(file, (long)records_offset + 8, SEEK_SET);
+  fwrite(&bad_key, sizeof(bad_key), 1, file);
+  fclose(file);
+  table = hashtable_open_mapped(path);
+  TEST_ASSERT_NOT_NULL(table);
+  TEST_ASSERT_NULL(hashtable_get(table, "only"));
+  size_t visited = 0;
+  hashtable_foreach(table, { visited++; });
+  TEST_ASSERT_EQUAL_size_t(0, visited);
+  TEST_ASSERT_EQUAL_size_t(0, table->length);
+  hashtable_set(table, "only", (void *)2);
+  TEST_ASSERT_EQUAL_PTR((void *)2, hashtable_get(table, "only"));
+  hashtable_free(table);
+
+  // Files that aren't images, and paths that can't be written.
+  file = fopen(path, "wb");
+  fputs("not an image, but long enough to hold a header of one...........",
+        file);
+  fclose(file);
+  TEST_ASSERT_NULL(hashtable_open_mapped(path));
+  remove(path);
+  TEST_ASSERT_NULL(hashtable_open_mapped(path));
+  table = hashtable_new();
+  TEST_ASSERT_FALSE(hashtable_save(table, "no/such/dir/table.img", 0));
+  hashtable_free(table);
+}
+
+static size_t constant_hash(const char *key) { return key ? 42 : 0; }
+
+static void test_hashtable_stats(void) {
+  hashtable_layout_e layouts[] = {HASHTABLE_LAYOUT_LINEAR,
+                                  HASHTABLE_LAYOUT_SWISS,
+                                  HASHTABLE_LAYOUT_COMPACT};
+  char key[16];
+
+  for (int l = 0; l < 3; l++) {
+    hashtable_counters_t counters = {0};
+    hashtable_t *table = hashtable_new_full((hashtable_init_t){
+        .layout = layouts[l],
+        .counters = &counters,
+    });
+    hashtable_stats_t stats = hashtable_stats(table);
+    TEST_ASSERT_EQUAL_size_t(0, stats.capacity);
+    TEST_ASSERT_EQUAL_size_t(0, stats.grows);
+    TEST_ASSERT_TRUE(stats.load_factor == 0);
+
+    for (int i = 0; i < 1000; i++) {
+      snprintf(key, sizeof(key), "k%d", i);
+      hashtable_set(table, key, NULL);
+    }
+    for (int i = 0; i < 100; i++) {
+      snprintf(key, sizeof(key), "k%d", i);
+      hashtable_delete(table, key);
+    }
+
+    stats = hashtable_stats(table);
+    TEST_ASSERT_EQUAL_size_t(900, stats.length);
+    TEST_ASSERT_EQUAL_size_t(table->capacity, stats.capacity);
+    TEST_ASSERT_TRUE(stats.load_factor == 900.0 / table->capacity);
+    TEST_ASSERT_TRUE(stats.grows >= 7);
+    TEST_ASSERT_EQUAL_size_t(l == 0 ? 0 : 100, stats.tombstones);
+    size_t keys = 0;
+    size_t longest = 0;
+    for (int p = 0; p < HASHTABLE_STATS_PROBE_LENGTHS; p++) {
+      keys += stats.probe_lengths[p];
+      if (stats.probe_lengths[p])
+        longest = p;
+    }
+    TEST_ASSERT_EQUAL_size_t(900, keys);
+    // A good hash finds most keys in their home slot.
+    TEST_ASSERT_TRUE(stats.probe_lengths[0] > 450);
+    TEST_ASSERT_EQUAL_size_t(longest, stats.max_displacement);
+
+    for (int i = 0; i < 1000; i++) {
+      snprintf(key, sizeof(key), "k%d", i);
+      hashtable_get(table, key);
+    }
+    stats = hashtable_stats(table);
+    if (hashtable_stats_level() == 0) {
+      TEST_ASSERT_EQUAL_size_t(0, stats.counters.lookups);
+    } else {
+      TEST_ASSERT_EQUAL_size_t(1000, stats.counters.lookups);
+      TEST_ASSERT_EQUAL_size_t(900, stats.counters.hits);
+      TEST_ASSERT_EQUAL_size_t(100, stats.counters.misses);
+      TEST_ASSERT_TRUE(stats.counters.probes >= 1000);
+      TEST_ASSERT_TRUE(stats.counters.probes < 2000);
+    }
+
+    // Frozen tables find every key in one probe.
+    TEST_ASSERT_TRUE(hashtable_freeze(table));
+    stats = hashtable_stats(table);
+    TEST_ASSERT_EQUAL_size_t(900, stats.probe_lengths[0]);
+    TEST_ASSERT_EQUAL_size_t(0, stats.max_displacement);
+    TEST_ASSERT_EQUAL_size_t(0, stats.tombstones);
+    TEST_ASSERT_TRUE(stats.load_factor == 1);
+    hashtable_free(table);
+  }
+
+  // A hash that sends every key to the same slot shows as one long cluster.
+  hashtable_counters_t counters = {0};
+  hashtable_t *table =
+      hashtable_new_full((hashtable_init_t){.hash_func = constant_hash});
+  hashtable_set_counters(table, &counters);
+  for (int i = 0; i < 40; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    hashtable_set(table, key, NULL);
+  }
+  hashtable_stats_t stats = hashtable_stats(table);
+  TEST_ASSERT_EQUAL_size_t(39, stats.max_displacement);
+  for (int p = 0; p < HASHTABLE_STATS_PROBE_LENGTHS - 1; p++)
+    TEST_ASSERT_EQUAL_size_t(1, stats.probe_lengths[p]);
+  TEST_ASSERT_EQUAL_size_t(40 - (HASHTABLE_STATS_PROBE_LENGTHS - 1),
+                           stats.probe_lengths[HASHTABLE_STATS_PROBE_LENGTHS -
+                                               1]);
+  hashtable_get(table, "nope");
+  if (hashtable_stats_level() != 0) {
+    TEST_ASSERT_EQUAL_size_t(1, counters.misses);
+    TEST_ASSERT_EQUAL_size_t(41, counters.probes);
+  }
+  hashtable_free(table);
+}
+
+static void test_hashtable_of_int_keys(void) {
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+  int_map_t *map = int_map_new(&counter.allocator);
+
+  TEST_ASSERT_NULL(int_map_get(map, 0));
+  for (uint64_t i = 0; i < 10000; i++)
+    TEST_ASSERT_TRUE(int_map_set(map, i * 3, i / 2.0));
+  TEST_ASSERT_FALSE(int_map_set(map, 0, -1));
+  TEST_ASSERT_EQUAL_size_t(10000, map->length);
+  // One allocation for the map, the rest are the slot array growing.
+  TEST_ASSERT_TRUE(counter.allocations < 20);
+
+  double removed;
+  for (uint64_t i = 1; i < 10000; i += 2)
+    TEST_ASSERT_TRUE(int_map_remove(map, i * 3, &removed));
+  TEST_ASSERT_EQUAL_DOUBLE(9999 / 2.0, removed);
+  TEST_ASSERT_FALSE(int_map_remove(map, 3, NULL));
+
+  for (uint64_t i = 0; i < 10000; i++) {
+    double *value = int_map_get(map, i * 3);
+    if (i % 2) {
+      TEST_ASSERT_NULL(value);
+    } else {
+      TEST_ASSERT_NOT_NULL(value);
+      TEST_ASSERT_EQUAL_DOUBLE(i ? i / 2.0 : -1, *value);
+    }
+    TEST_ASSERT_FALSE(int_map_exists(map, i * 3 + 1));
+  }
+
+  size_t count = 0;
+  hashtable_of_foreach(map, {
+    TEST_ASSERT_EQUAL_UINT64(0, key % 6);
+    *value += 1;
+    count++;
+  });
+  TEST_ASSERT_EQUAL_size_t(5000, count);
+  TEST_ASSERT_EQUAL_DOUBLE(3, *int_map_get(map, 12));
+
+  int_map_free(map);
+  TEST_ASSERT_EQUAL_size_t(0, counter.live_bytes);
+}
+
+static void test_hashtable_of_fixed_keys(void) {
+  point_map_t *map = point_map_new(NULL);
+
+  for (int32_t x = -20; x < 20; x++) {
+    for (int32_t y = -20; y < 20; y++)
+      point_map_set(map, (point_t){x, y}, x * 100 + y);
+  }
+  TEST_ASSERT_EQUAL_size_t(1600, map->length);
+  TEST_ASSERT_EQUAL_INT(-1917, *point_map_get(map, (point_t){-19, 83 - 100}));
+  TEST_ASSERT_FALSE(point_map_exists(map, (point_t){20, 0}));
+
+  point_map_free(map);
+}
+
+static void test_hashtable_of_str_keys(void) {
+  // Keys point into a larger buffer without copies or terminators.
+  const char *text = "one two three two one four";
+  str_map_t *map = str_map_new(NULL);
+
+  for (const char *p = text; *p;) {
+    size_t length = strcspn(p, " ");
+    hashtable_str_t word = {.data = p, .length = length};
+    size_t *count = str_map_get(map, word);
+    if (count)
+      (*count)++;
+    else
+      str_map_set(map, word, 1);
+    p += length + (p[length] == ' ');
+  }
+
+  TEST_ASSERT_EQUAL_size_t(4, map->length);
+  TEST_ASSERT_EQUAL_size_t(2, *str_map_get(map, hashtable_str("one")));
+  TEST_ASSERT_EQUAL_size_t(2, *str_map_get(map, hashtable_str("two")));
+  TEST_ASSERT_EQUAL_size_t(1, *str_map_get(map, hashtable_str("four")));
+  TEST_ASSERT_NULL(str_map_get(map, hashtable_str("on")));
+  TEST_ASSERT_NULL(str_map_get(map, hashtable_str("")));
+
+  str_map_free(map);
+}
+
 int main(void) {
   UNITY_BEGIN();
 
@@ -361,5 +1558,29 @@ int main(void) {
   RUN_TEST(test_hashtable_tombstone_saturation);
   RUN_TEST(test_hashtable_foreach_skips_tombstones);
 
+  RUN_TEST(test_hashtable_allocator);
+  RUN_TEST(test_hashtable_caches_hashes);
+  RUN_TEST(test_hashtable_power_of_two_capacity);
+  RUN_TEST(test_hashtable_hash_functions);
+  RUN_TEST(test_hashtable_hash_flooding);
+  RUN_TEST(test_hashtable_set_hash_func);
+  RUN_TEST(test_hashtable_swiss_layout);
+  RUN_TEST(test_hashtable_swiss_churn);
+  RUN_TEST(test_hashtable_churn);
+  RUN_TEST(test_hashtable_robin_hood);
+  RUN_TEST(test_hashtable_incremental);
+  RUN_TEST(test_hashtable_get_many);
+  RUN_TEST(test_hashtable_entry);
+  RUN_TEST(test_hashtable_lazy);
+  RUN_TEST(test_hashtable_key_arena);
+  RUN_TEST(test_hashtable_compact);
+  RUN_TEST(test_hashtable_freeze);
+  RUN_TEST(test_hashtable_save);
+  RUN_TEST(test_hashtable_stats);
+
+  RUN_TEST(test_hashtable_of_int_keys);
+  RUN_TEST(test_hashtable_of_fixed_keys);
+  RUN_TEST(test_hashtable_of_str_keys);
+
   return UNITY_END();
 }
@@ -7,6 +7,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -14,8 +15,70 @@
 #define DEFAULT_JSON_ARRAY_CAPACITY 4
 #endif
 
+// Number of keys objects whose size isn't known ahead get room for. 0 leaves
+// the allocation to the first key, so empty objects allocate nothing.
 #ifndef DEFAULT_JSON_OBJECT_CAPACITY
-#define DEFAULT_JSON_OBJECT_CAPACITY 13
+#define DEFAULT_JSON_OBJECT_CAPACITY 0
+#endif
+
+// Number of nodes in each of a parser's node slabs.
+#ifndef JSON_PARSER_SLAB_NODES
+#define JSON_PARSER_SLAB_NODES 256
+#endif
+
+// Minimum size of each of a parser's string arena chunks.
+#ifndef JSON_PARSER_CHUNK_SIZE
+#define JSON_PARSER_CHUNK_SIZE 16384
+#endif
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+// Statistics level: 0 collects nothing, 1 collects counters, 2 also collects
+// per-stage cycle counts. See `json_parse_stats_t`.
+#ifndef RCL_JSON_STATS
+#define RCL_JSON_STATS 0
+#endif
+
+#if RCL_JSON_STATS
+#define JSON_STAT_ADD(owner, field, n) ((owner)->stats->field += (n))
+#define JSON_STAT_ENTER(ctx)                                                   \
+  do {                                                                         \
+    if (++(ctx)->depth > (ctx)->stats->max_depth)                              \
+      (ctx)->stats->max_depth = (ctx)->depth;                                  \
+  } while (0)
+#define JSON_STAT_LEAVE(ctx) ((ctx)->depth--)
+#else
+#define JSON_STAT_ADD(owner, field, n) ((void)(owner))
+#define JSON_STAT_ENTER(ctx) ((void)0)
+#define JSON_STAT_LEAVE(ctx) ((void)0)
+#endif
+
+#if RCL_JSON_STATS >= 2
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline unsigned long long _json_cycles(void) { return __rdtsc(); }
+#elif defined(__aarch64__)
+static inline unsigned long long _json_cycles(void) {
+  unsigned long long ticks;
+  __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+}
+#else
+#include <time.h>
+static inline unsigned long long _json_cycles(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+#endif
+#define JSON_STAT_CYCLES_START(name) unsigned long long name = _json_cycles()
+#define JSON_STAT_CYCLES_STOP(owner, field, name)                              \
+  JSON_STAT_ADD(owner, field, _json_cycles() - (name))
+#else
+#define JSON_STAT_CYCLES_START(name)                                           \
+  do {                                                                         \
+  } while (0)
+#define JSON_STAT_CYCLES_STOP(owner, field, name) ((void)(owner))
 #endif
 
 // Locale-independent strtod. JSON mandates '.' as the decimal separator, but
@@ -59,15 +122,82 @@ typedef enum {
   JSON_TOKEN_END = -2,
 } json_token_type_e;
 
-json_value_t *json_parse_token(const char *src, const char **ptr,
+typedef struct json_chunk_s {
+  size_t size;
+  char data[];
+} json_chunk_t;
+
+struct json_parser_s {
+  const rcl_allocator_t *allocator;
+  size_t max_retained;
+  // Bytes held after the last parse. Measured when a parse finishes, since
+  // containers may have grown while it ran.
+  size_t retained;
+
+  // Node pool: slabs of JSON_PARSER_SLAB_NODES nodes handed out in order.
+  array_t *slabs;
+  size_t slab_index;
+  size_t slab_used;
+
+  // String arena: chunks of at least JSON_PARSER_CHUNK_SIZE bytes.
+  array_t *chunks;
+  size_t chunk_index;
+  size_t chunk_used;
+
+  // Containers handed out by previous parses. The first `*_used` belong to the
+  // current tree; the rest are recycled (and cleared) on demand.
+  array_t *arrays;
+  size_t arrays_used;
+  array_t *objects;
+  size_t objects_used;
+
+  // Key cache. Maps every key seen so far to its own (owned) copy, which all
+  // parser objects share. Survives resets, so steady-state parses of the same
+  // kind of document never allocate keys.
+  hashtable_t *keys;
+  size_t key_bytes;
+
+  // Scratch buffer keys are decoded into before looking them up in the cache.
+  char *scratch;
+  size_t scratch_capacity;
+
+  // Buffers reused by `_json_prescan`.
+  array_t *sizes;
+  array_t *open;
+
+  // Statistics of the parse in progress, if any.
+  json_parse_stats_t *stats;
+};
+
+// State shared by every function involved in a single parse.
+typedef struct json_parse_ctx_s {
+  const char *src;
+  // The parser that owns the tree being built, or NULL if every node is
+  // allocated on its own and freed with `json_value_free`.
+  json_parser_t *parser;
+  // Where nodes come from when there is no parser. Recorded in every node.
+  const rcl_allocator_t *allocator;
+  // Where statistics go. Never NULL: points to a throwaway struct if the caller
+  // didn't ask for them.
+  json_parse_stats_t *stats;
+  size_t depth;
+  // Direct child counts of every container, in the order they are opened, if
+  // the input was prescanned. `next_size` is the next one to hand out.
+  array_t *sizes;
+  size_t next_size;
+  // Whether number nodes keep their source text instead of being converted.
+  bool lazy_numbers;
+} json_parse_ctx_t;
+
+json_value_t *json_parse_token(json_parse_ctx_t *ctx, const char **ptr,
                                json_error_t out *error);
-json_value_t *json_parse_string(const char *src, const char **ptr,
+json_value_t *json_parse_string(json_parse_ctx_t *ctx, const char **ptr,
                                 json_error_t out *error);
-json_value_t *json_parse_number(const char *src, const char **ptr,
+json_value_t *json_parse_number(json_parse_ctx_t *ctx, const char **ptr,
                                 json_error_t out *error);
-json_value_t *json_parse_array(const char *src, const char **ptr,
+json_value_t *json_parse_array(json_parse_ctx_t *ctx, const char **ptr,
                                json_error_t out *error);
-json_value_t *json_parse_object(const char *src, const char **ptr,
+json_value_t *json_parse_object(json_parse_ctx_t *ctx, const char **ptr,
                                 json_error_t out *error);
 
 json_token_type_e _get_token_type(const char *ptr) {
@@ -157,26 +287,24 @@ const char *_get_string_end(const char *start) {
   return NULL; // Unterminated string
 }
 
-// Decodes a JSON string token into a clean C string. The input `start` points
-// to the opening quote and `length` includes both quotes. Escape sequences are
-// resolved into their actual characters. The lexer has already validated the
-// input, so we trust it here.
-char *decode_json_string(const char *start, size_t length,
-                         size_t out decoded_length) {
+// Decodes a JSON string token into `dst`, which must hold at least `length - 1`
+// bytes. The input `start` points to the opening quote and `length` includes
+// both quotes. Escape sequences are resolved into their actual characters. The
+// lexer has already validated the input, so we trust it here. Returns the
+// decoded length, not counting the null terminator.
+size_t decode_json_string_into(char *dst, const char *start, size_t length) {
   // Skip opening and closing quotes
   const char *src = start + 1;
   const char *end = start + length - 1;
-  char *ptr;
 
-  if (!(ptr = memchr(src, '\\', end - src))) {
+  if (!memchr(src, '\\', end - src)) {
     // Fast path: no escapes, just copy the substring
-    char *result = strndup(src, end - src);
-    set_out_value(decoded_length, end - src);
-    return result;
+    memcpy(dst, src, end - src);
+    dst[end - src] = '\0';
+    return end - src;
   }
 
-  // Allocate worst case (same length minus quotes), will be smaller if escapes
-  char *result = malloc(length - 1);
+  char *result = dst;
   size_t pos = 0;
 
   while (src < end) {
@@ -241,6 +369,26 @@ char *decode_json_string(const char *start, size_t length,
   }
 
   result[pos] = '\0';
+  return pos;
+}
+
+// Decodes a JSON string token into a C string allocated from `allocator`. See
+// `decode_json_string_into`.
+char *decode_json_string(const rcl_allocator_t *allocator, const char *start,
+                         size_t length, size_t out decoded_length) {
+  const char *src = start + 1;
+  const char *end = start + length - 1;
+
+  if (!memchr(src, '\\', end - src)) {
+    // Fast path: no escapes, just copy the substring
+    char *result = rcl_strndup(allocator, src, end - src);
+    set_out_value(decoded_length, end - src);
+    return result;
+  }
+
+  // Allocate worst case (same length minus quotes), will be smaller if escapes
+  char *result = rcl_alloc(allocator, length - 1);
+  size_t pos = decode_json_string_into(result, start, length);
   set_out_value(decoded_length, pos);
   return result;
 }
@@ -329,12 +477,394 @@ return_error:
   return JSON_TOKEN_INVALID;
 }
 
-json_value_t *json_parse_token(const char *src, const char **ptr,
+// Characters `_json_prescan` stops at outside strings and inside them.
+#define JSON_PRESCAN_STRUCTURAL 1
+#define JSON_PRESCAN_STRING 2
+
+static const unsigned char _json_prescan_stops[256] = {
+    ['\0'] = JSON_PRESCAN_STRUCTURAL | JSON_PRESCAN_STRING,
+    ['"'] = JSON_PRESCAN_STRUCTURAL | JSON_PRESCAN_STRING,
+    ['\\'] = JSON_PRESCAN_STRING,
+    ['['] = JSON_PRESCAN_STRUCTURAL,
+    [']'] = JSON_PRESCAN_STRUCTURAL,
+    ['{'] = JSON_PRESCAN_STRUCTURAL,
+    ['}'] = JSON_PRESCAN_STRUCTURAL,
+    [','] = JSON_PRESCAN_STRUCTURAL,
+};
+
+// Count the direct children of every array and object in `src`, appending the
+// counts to `sizes` in the order the containers are opened. The counts are only
+// capacity hints, so this doesn't validate anything: it agrees with the parser
+// on valid input, and malformed input just gets useless hints.
+static void _json_prescan(const char *src, array_t *sizes, array_t *open) {
+  ARRAY_OF(uint32_t) *counts = (void *)sizes;
+  ARRAY_OF(size_t) *stack = (void *)open;
+  const unsigned char *ptr = (const unsigned char *)src;
+
+  while (true) {
+    while (!(_json_prescan_stops[*ptr] & JSON_PRESCAN_STRUCTURAL))
+      ptr++;
+
+    switch (*ptr++) {
+    case '\0':
+      return;
+    case '"':
+      while (true) {
+        while (!(_json_prescan_stops[*ptr] & JSON_PRESCAN_STRING))
+          ptr++;
+        if (*ptr == '"')
+          break;
+        if (!*ptr || !ptr[1])
+          return; // Unterminated string
+        ptr += 2; // Skip the backslash and the escaped character
+      }
+      ptr++;
+      break;
+    case '[':
+    case '{':
+      while (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r')
+        ptr++;
+      if (*ptr == ']' || *ptr == '}') {
+        array_push(sizes, (uint32_t)0);
+        ptr++;
+      } else {
+        array_push(open, (size_t)counts->length);
+        array_push(sizes, (uint32_t)1);
+      }
+      break;
+    case ']':
+    case '}':
+      if (stack->length > 0)
+        stack->length--;
+      break;
+    case ',':
+      if (stack->length > 0)
+        counts->data[stack->data[stack->length - 1]]++;
+      break;
+    }
+  }
+}
+
+// Get the number of children the prescan counted for the container being
+// opened. Returns false if the input wasn't prescanned.
+static bool _json_next_size(json_parse_ctx_t *ctx, size_t *children) {
+  if (!ctx->sizes || ctx->next_size >= ctx->sizes->length)
+    return false;
+  *children = ((uint32_t *)ctx->sizes->data)[ctx->next_size++];
+  return true;
+}
+
+static json_value_t *_json_parser_node(json_parser_t *self) {
+  if (self->slab_used == JSON_PARSER_SLAB_NODES) {
+    self->slab_index++;
+    self->slab_used = 0;
+  }
+  if (self->slab_index == self->slabs->length) {
+    json_value_t *slab =
+        rcl_alloc(self->allocator, JSON_PARSER_SLAB_NODES * sizeof(*slab));
+    JSON_STAT_ADD(self, allocations,
+                  1 + (self->slabs->length == self->slabs->capacity));
+    array_push(self->slabs, slab);
+  }
+  return &((json_value_t **)self->slabs->data)[self->slab_index]
+                                              [self->slab_used++];
+}
+
+static char *_json_parser_bytes(json_parser_t *self, size_t size) {
+  json_chunk_t **chunks = self->chunks->data;
+
+  // Skip chunks that can't fit `size`. Their tails are wasted until the next
+  // reset, which is fine as long as strings are small compared to chunks.
+  while (self->chunk_index < self->chunks->length &&
+         chunks[self->chunk_index]->size - self->chunk_used < size) {
+    self->chunk_index++;
+    self->chunk_used = 0;
+  }
+
+  if (self->chunk_index == self->chunks->length) {
+    size_t chunk_size = MAX(JSON_PARSER_CHUNK_SIZE, size);
+    json_chunk_t *chunk =
+        rcl_alloc(self->allocator, sizeof(*chunk) + chunk_size);
+    chunk->size = chunk_size;
+    JSON_STAT_ADD(self, allocations,
+                  1 + (self->chunks->length == self->chunks->capacity));
+    array_push(self->chunks, chunk);
+    chunks = self->chunks->data;
+  }
+
+  char *bytes = chunks[self->chunk_index]->data + self->chunk_used;
+  self->chunk_used += size;
+  return bytes;
+}
+
+static char *_json_parser_key(json_parser_t *self, const char *start,
+                              size_t length) {
+  if (self->scratch_capacity < length - 1) {
+    self->scratch_capacity = MAX(self->scratch_capacity * 2, length - 1);
+    self->scratch =
+        rcl_realloc(self->allocator, self->scratch, self->scratch_capacity);
+    JSON_STAT_ADD(self, allocations, 1);
+  }
+  size_t key_length = decode_json_string_into(self->scratch, start, length);
+  JSON_STAT_ADD(self, string_bytes, key_length);
+
+  char *key = hashtable_get(self->keys, self->scratch);
+  if (!key) {
+    key = rcl_strdup(self->allocator, self->scratch);
+#if RCL_JSON_STATS
+    size_t capacity = self->keys->capacity;
+#endif
+    hashtable_set_steal(self->keys, key, key);
+    // A grow allocates the new items array.
+    JSON_STAT_ADD(self, allocations, 1 + (self->keys->capacity != capacity));
+    self->key_bytes += key_length + 1;
+  }
+  return key;
+}
+
+// Parser objects never own their keys (the key cache does), so they must be
+// emptied without `hashtable_free`'s key cleanup. Their index and items are
+// kept for the next parse.
+static void _json_parser_forget_object(hashtable_t *object) {
+  if (object->index)
+    memset(object->index, 0, object->capacity * sizeof(*object->index));
+  object->used = 0;
+  object->length = 0;
+}
+
+static array_t *_json_parser_array(json_parser_t *self, size_t capacity) {
+  if (self->arrays_used < self->arrays->length) {
+    array_t *array = ((array_t **)self->arrays->data)[self->arrays_used++];
+    array->length = 0;
+    if (array->capacity < capacity) {
+      array->data = rcl_realloc(self->allocator, array->data,
+                                capacity * sizeof(json_value_t *));
+      array->capacity = capacity;
+      JSON_STAT_ADD(self, allocations, 1);
+    }
+    return array;
+  }
+
+  array_t *array = array_new(json_value_t *, .capacity = capacity,
+                             .allocator = self->allocator);
+  JSON_STAT_ADD(self, allocations,
+                2 + (self->arrays->length == self->arrays->capacity));
+  array_push(self->arrays, array);
+  self->arrays_used++;
+  return array;
+}
+
+static hashtable_t *_json_parser_object(json_parser_t *self) {
+  if (self->objects_used < self->objects->length) {
+    hashtable_t *object =
+        ((hashtable_t **)self->objects->data)[self->objects_used++];
+    _json_parser_forget_object(object);
+    return object;
+  }
+
+  hashtable_t *object = hashtable_new_full((hashtable_init_t){
+      .hash_func = hashtable_hash_seeded,
+      .allocator = self->allocator,
+      .layout = HASHTABLE_LAYOUT_COMPACT,
+  });
+  JSON_STAT_ADD(self, allocations,
+                1 + (self->objects->length == self->objects->capacity));
+  array_push(self->objects, object);
+  self->objects_used++;
+  return object;
+}
+
+static json_value_t *_json_value_alloc(json_parse_ctx_t *ctx) {
+  JSON_STAT_CYCLES_START(cycles);
+  json_value_t *value;
+  if (ctx->parser) {
+    value = _json_parser_node(ctx->parser);
+  } else {
+    value = rcl_alloc(ctx->allocator, sizeof(*value));
+    JSON_STAT_ADD(ctx, allocations, 1);
+  }
+  JSON_STAT_CYCLES_STOP(ctx, build_cycles, cycles);
+  return value;
+}
+
+static void _json_value_release(json_parse_ctx_t *ctx, json_value_t **value) {
+  if (!ctx->parser)
+    json_value_destroy(value);
+}
+
+#if RCL_JSON_STATS
+// Count escape sequences in a string token that the lexer already validated.
+static size_t _json_count_escapes(const char *start, size_t length) {
+  const char *ptr = start + 1;
+  const char *end = start + length - 1;
+  size_t count = 0;
+  while ((ptr = memchr(ptr, '\\', end - ptr))) {
+    count++;
+    ptr += 2; // Skip the backslash and the escaped character
+  }
+  return count;
+}
+
+// Number of reallocations `array_push` made to grow from `from` to `to`.
+static size_t _json_doublings(size_t from, size_t to) {
+  size_t count = 0;
+  for (; from < to; from *= 2)
+    count++;
+  return count;
+}
+#endif
+
+static char *_json_string_new(json_parse_ctx_t *ctx, const char *start,
+                              size_t length) {
+  JSON_STAT_CYCLES_START(cycles);
+  JSON_STAT_ADD(ctx, escapes, _json_count_escapes(start, length));
+  char *str;
+  __attribute__((unused)) size_t decoded_length;
+  if (!ctx->parser) {
+    str = decode_json_string(ctx->allocator, start, length, &decoded_length);
+    JSON_STAT_ADD(ctx, allocations, 1);
+  } else {
+    str = _json_parser_bytes(ctx->parser, length - 1);
+    decoded_length = decode_json_string_into(str, start, length);
+  }
+  JSON_STAT_ADD(ctx, string_bytes, decoded_length);
+  JSON_STAT_CYCLES_STOP(ctx, string_cycles, cycles);
+  return str;
+}
+
+static char *_json_key_new(json_parse_ctx_t *ctx, const char *start,
+                           size_t length) {
+  JSON_STAT_CYCLES_START(cycles);
+  JSON_STAT_ADD(ctx, escapes, _json_count_escapes(start, length));
+  char *key;
+  if (!ctx->parser) {
+    __attribute__((unused)) size_t decoded_length;
+    key = decode_json_string(ctx->allocator, start, length, &decoded_length);
+    JSON_STAT_ADD(ctx, string_bytes, decoded_length);
+    JSON_STAT_ADD(ctx, allocations, 1);
+  } else {
+    key = _json_parser_key(ctx->parser, start, length);
+  }
+  JSON_STAT_CYCLES_STOP(ctx, string_cycles, cycles);
+  return key;
+}
+
+static void _json_key_release(json_parse_ctx_t *ctx, char *key) {
+  if (!ctx->parser)
+    rcl_free(ctx->allocator, key);
+}
+
+static array_t *_json_array_new(json_parse_ctx_t *ctx) {
+  JSON_STAT_CYCLES_START(cycles);
+  size_t children;
+  size_t capacity = _json_next_size(ctx, &children)
+                        ? MAX(children, 1)
+                        : DEFAULT_JSON_ARRAY_CAPACITY;
+  array_t *array;
+  if (ctx->parser) {
+    array = _json_parser_array(ctx->parser, capacity);
+  } else {
+    array = array_new(json_value_t *, .capacity = capacity,
+                      .free_func = (array_free_func *)json_value_free,
+                      .allocator = ctx->allocator);
+    JSON_STAT_ADD(ctx, allocations, 2);
+  }
+  JSON_STAT_CYCLES_STOP(ctx, build_cycles, cycles);
+  return array;
+}
+
+static void _json_array_append(json_parse_ctx_t *ctx, array_t *array,
+                               json_value_t *value) {
+  JSON_STAT_CYCLES_START(cycles);
+  JSON_STAT_ADD(ctx, array_reallocs, array->length == array->capacity);
+  JSON_STAT_ADD(ctx, allocations, array->length == array->capacity);
+  array_push(array, value);
+  JSON_STAT_CYCLES_STOP(ctx, build_cycles, cycles);
+}
+
+static void _json_array_release(json_parse_ctx_t *ctx, array_t **array) {
+  if (!ctx->parser)
+    array_destroy(array);
+}
+
+// Objects use the compact layout, so they keep their keys in document order
+// and take one item per key (plus a 4-byte index slot per slot) rather than an
+// item per slot.
+static hashtable_t *_json_object_new(json_parse_ctx_t *ctx) {
+  JSON_STAT_CYCLES_START(cycles);
+  size_t children;
+  if (!_json_next_size(ctx, &children))
+    children = DEFAULT_JSON_OBJECT_CAPACITY;
+  hashtable_t *object;
+  if (ctx->parser) {
+    object = _json_parser_object(ctx->parser);
+  } else {
+    object = hashtable_new_full((hashtable_init_t){
+        .free_func = (hashtable_free_func_t)json_value_free,
+        .hash_func = hashtable_hash_seeded,
+        .allocator = ctx->allocator,
+        .layout = HASHTABLE_LAYOUT_COMPACT,
+    });
+    JSON_STAT_ADD(ctx, allocations, 1);
+  }
+#if RCL_JSON_STATS
+  size_t capacity = object->capacity;
+  size_t items_capacity = object->items_capacity;
+#endif
+  // Room for exactly the keys the prescan counted; a recycled object usually
+  // has it already.
+  hashtable_reserve(object, children);
+  JSON_STAT_ADD(ctx, allocations,
+                (object->capacity != capacity) +
+                    (object->items_capacity != items_capacity));
+  JSON_STAT_CYCLES_STOP(ctx, build_cycles, cycles);
+  return object;
+}
+
+static void _json_object_insert(json_parse_ctx_t *ctx, hashtable_t *object,
+                                char *key, json_value_t *value) {
+  JSON_STAT_CYCLES_START(cycles);
+#if RCL_JSON_STATS
+  size_t capacity = object->capacity;
+  size_t items_capacity = object->items_capacity;
+#endif
+  hashtable_set_steal(object, key, value);
+  // A grow reallocates the items, and sometimes the index too.
+  JSON_STAT_ADD(ctx, hashtable_grows,
+                object->items_capacity != items_capacity);
+  JSON_STAT_ADD(ctx, allocations,
+                (object->capacity != capacity) +
+                    (object->items_capacity != items_capacity));
+  JSON_STAT_CYCLES_STOP(ctx, build_cycles, cycles);
+}
+
+static json_token_type_e _json_lex(json_parse_ctx_t *ctx, const char **ptr,
+                                   json_error_t out *error) {
+  JSON_STAT_CYCLES_START(cycles);
+  json_token_type_e token_type = _json_lex_get_next_token(ctx->src, ptr, error);
+  JSON_STAT_CYCLES_STOP(ctx, lex_cycles, cycles);
+  return token_type;
+}
+
+static const char *_json_string_end(json_parse_ctx_t *ctx, const char *start) {
+  JSON_STAT_CYCLES_START(cycles);
+  const char *end = _get_string_end(start);
+  JSON_STAT_CYCLES_STOP(ctx, string_cycles, cycles);
+  return end;
+}
+
+static void _json_object_release(json_parse_ctx_t *ctx,
+                                 hashtable_t **object) {
+  if (!ctx->parser)
+    hashtable_destroy(object);
+}
+
+json_value_t *json_parse_token(json_parse_ctx_t *ctx, const char **ptr,
                                json_error_t out *error) {
   set_out_value(error, NULL);
   json_error_t *_error = NULL;
 
-  __auto_type token_type = _json_lex_get_next_token(src, ptr, &_error);
+  __auto_type token_type = _json_lex(ctx, ptr, &_error);
   if (_error)
     goto return_error;
 
@@ -344,37 +874,50 @@ json_value_t *json_parse_token(const char *src, const char **ptr,
     return NULL;
   }
 
+  json_value_t *value = NULL;
   switch (token_type) {
   case JSON_TOKEN_STRING:
-    return json_parse_string(src, ptr, error);
+    value = json_parse_string(ctx, ptr, error);
+    break;
   case JSON_TOKEN_NUMBER:
-    return json_parse_number(src, ptr, error);
+    value = json_parse_number(ctx, ptr, error);
+    break;
   case JSON_TOKEN_TRUE:
-  case JSON_TOKEN_FALSE: {
-    json_value_t *value = malloc(sizeof(*value));
+  case JSON_TOKEN_FALSE:
+    value = _json_value_alloc(ctx);
     *value = (json_value_t){
         .type = JSON_VALUE_TYPE_BOOL,
+        .allocator = ctx->allocator,
         .value.boolean = token_type == JSON_TOKEN_TRUE,
     };
-    return value;
-  }
-  case JSON_TOKEN_NULL: {
-    json_value_t *value = malloc(sizeof(*value));
+    break;
+  case JSON_TOKEN_NULL:
+    value = _json_value_alloc(ctx);
     *value = (json_value_t){
         .type = JSON_VALUE_TYPE_NULL,
+        .allocator = ctx->allocator,
         .value = {0},
     };
-    return value;
-  }
+    break;
   case JSON_TOKEN_LBRACK:
-    return json_parse_array(src, ptr, error);
+    JSON_STAT_ENTER(ctx);
+    value = json_parse_array(ctx, ptr, error);
+    JSON_STAT_LEAVE(ctx);
+    break;
   case JSON_TOKEN_LBRACE:
-    return json_parse_object(src, ptr, error);
+    JSON_STAT_ENTER(ctx);
+    value = json_parse_object(ctx, ptr, error);
+    JSON_STAT_LEAVE(ctx);
+    break;
   default:
     _error = json_error_new(strdup("Unexpected token"), 0);
     goto return_error;
   }
 
+  if (value)
+    JSON_STAT_ADD(ctx, nodes[value->type], 1);
+  return value;
+
 return_error:
   set_out_value(error, _error);
   if (!error)
@@ -382,19 +925,16 @@ return_error:
   return NULL;
 }
 
-json_value_t *json_parse_object(const char *src, const char **ptr,
+json_value_t *json_parse_object(json_parse_ctx_t *ctx, const char **ptr,
                                 json_error_t out *error) {
   set_out_value(error, NULL);
-  hashtable_t *object =
-      hashtable_new_with_capacity(DEFAULT_JSON_OBJECT_CAPACITY);
+  hashtable_t *object = _json_object_new(ctx);
   json_error_t *_error = NULL;
 
-  object->free_func = (hashtable_free_func_t)json_value_free;
-
   // Check for empty object
   {
     const char *peek = *ptr;
-    __auto_type first = _json_lex_get_next_token(src, &peek, &_error);
+    __auto_type first = _json_lex(ctx, &peek, &_error);
     if (_error)
       goto return_error;
     if (first == JSON_TOKEN_RBRACE) {
@@ -404,7 +944,7 @@ json_value_t *json_parse_object(const char *src, const char **ptr,
   }
 
   while (true) {
-    __auto_type token_type = _json_lex_get_next_token(src, ptr, &_error);
+    __auto_type token_type = _json_lex(ctx, ptr, &_error);
     if (_error)
       goto return_error;
 
@@ -412,33 +952,33 @@ json_value_t *json_parse_object(const char *src, const char **ptr,
       _error = json_error_new(strdup("Expected string key in object"), 0);
       goto return_error;
     }
-    const char *end = _get_string_end(*ptr + 1);
+    const char *end = _json_string_end(ctx, *ptr + 1);
     if (!end) {
       _error = json_error_new(strdup("Unterminated string in object key"), 0);
       goto return_error;
     }
     size_t key_length = end - *ptr + 1; // This includes both quotes.
-    char *key = decode_json_string(*ptr, key_length, NULL);
+    char *key = _json_key_new(ctx, *ptr, key_length);
     *ptr += key_length;
 
-    token_type = _json_lex_get_next_token(src, ptr, &_error);
+    token_type = _json_lex(ctx, ptr, &_error);
     if (token_type != JSON_TOKEN_COLON) {
       _error = json_error_new(strdup("Expected ':' after key in object"), 0);
-      free(key);
+      _json_key_release(ctx, key);
       goto return_error;
     }
 
-    json_value_t *value = json_parse_token(src, ptr, &_error);
+    json_value_t *value = json_parse_token(ctx, ptr, &_error);
     if (!value) {
       if (!_error)
         _error = json_error_new(strdup("Unexpected end of input in object"), 0);
-      free(key);
+      _json_key_release(ctx, key);
       goto return_error;
     }
 
-    hashtable_set_steal(object, key, value);
+    _json_object_insert(ctx, object, key, value);
 
-    token_type = _json_lex_get_next_token(src, ptr, &_error);
+    token_type = _json_lex(ctx, ptr, &_error);
     if (_error)
       goto return_error;
 
@@ -452,38 +992,40 @@ json_value_t *json_parse_object(const char *src, const char **ptr,
   }
 
 done:;
-  json_value_t *self = malloc(sizeof(*self));
+  json_value_t *self = _json_value_alloc(ctx);
   *self = (json_value_t){
       .type = JSON_VALUE_TYPE_OBJECT,
+      .allocator = ctx->allocator,
       .value.object = object,
   };
   return self;
 
 return_error:
-  hashtable_destroy(&object);
+  _json_object_release(ctx, &object);
   set_out_value(error, _error);
   if (!error)
     json_error_destroy(&_error);
   return NULL;
 }
 
-json_value_t *json_parse_string(const char *src, const char **ptr,
+json_value_t *json_parse_string(json_parse_ctx_t *ctx, const char **ptr,
                                 json_error_t out *error) {
   set_out_value(error, NULL);
   json_error_t *_error = NULL;
 
-  const char *end = _get_string_end(*ptr + 1);
+  const char *end = _json_string_end(ctx, *ptr + 1);
   if (!end) {
-    _error = json_error_new(strdup("Unterminated string"), *ptr - src);
+    _error = json_error_new(strdup("Unterminated string"), *ptr - ctx->src);
     goto return_error;
   }
   size_t length = end - *ptr + 1; // This includes both quotes.
-  char *str = decode_json_string(*ptr, length, NULL);
+  char *str = _json_string_new(ctx, *ptr, length);
   *ptr += length;
 
-  json_value_t *self = malloc(sizeof(*self));
+  json_value_t *self = _json_value_alloc(ctx);
   *self = (json_value_t){
       .type = JSON_VALUE_TYPE_STRING,
+      .allocator = ctx->allocator,
       .value.string = str,
   };
   return self;
@@ -495,39 +1037,64 @@ return_error:
   return NULL;
 }
 
-json_value_t *json_parse_number(__attribute__((unused)) const char *src,
-                                const char **ptr, json_error_t out *error) {
+json_value_t *json_parse_number(json_parse_ctx_t *ctx, const char **ptr,
+                                json_error_t out *error) {
   set_out_value(error, NULL);
-  // json_error_t *_error = NULL;
+  json_error_t *_error = NULL;
 
+  if (ctx->lazy_numbers) {
+    JSON_STAT_CYCLES_START(cycles);
+    const char *start = *ptr;
+    const char *end = _get_number_end(start);
+    JSON_STAT_CYCLES_STOP(ctx, number_cycles, cycles);
+    if (!end) {
+      _error = json_error_new(strdup("Invalid number"), start - ctx->src);
+      goto return_error;
+    }
+    *ptr = end;
+
+    // Absurdly long numbers don't fit `number_length`, convert those now.
+    if (end - start < INT32_MAX) {
+      json_value_t *self = _json_value_alloc(ctx);
+      *self = (json_value_t){
+          .type = JSON_VALUE_TYPE_NUMBER,
+          .number_length = end - start,
+          .allocator = ctx->allocator,
+          .number_text = start,
+      };
+      return self;
+    }
+    *ptr = start;
+  }
+
+  JSON_STAT_CYCLES_START(cycles);
   double value = json_strtod(*ptr, (char **)ptr);
+  JSON_STAT_CYCLES_STOP(ctx, number_cycles, cycles);
 
-  json_value_t *self = malloc(sizeof(*self));
+  json_value_t *self = _json_value_alloc(ctx);
   *self = (json_value_t){
       .type = JSON_VALUE_TYPE_NUMBER,
+      .allocator = ctx->allocator,
       .value.number = value,
   };
   return self;
 
-  // return_error:
-  //   set_out_value(error, _error);
-  //   if (!error)
-  //     json_error_destroy(&_error);
-  //   return NULL;
+return_error:
+  set_out_value(error, _error);
+  if (!error)
+    json_error_destroy(&_error);
+  return NULL;
 }
 
-json_value_t *json_parse_array(const char *src, const char **ptr,
+json_value_t *json_parse_array(json_parse_ctx_t *ctx, const char **ptr,
                                json_error_t out *error) {
   set_out_value(error, NULL);
-  array_t *array =
-      array_new(json_value_t *, .capacity = DEFAULT_JSON_ARRAY_CAPACITY);
+  array_t *array = _json_array_new(ctx);
   json_error_t *_error = NULL;
 
-  array->free_func = (array_free_func *)json_value_free;
-
   // Check for empty array
   const char *peek = *ptr;
-  __auto_type first = _json_lex_get_next_token(src, &peek, &_error);
+  __auto_type first = _json_lex(ctx, &peek, &_error);
   if (_error)
     goto return_error;
   if (first == JSON_TOKEN_RBRACK) {
@@ -536,16 +1103,16 @@ json_value_t *json_parse_array(const char *src, const char **ptr,
   }
 
   while (true) {
-    json_value_t *value = json_parse_token(src, ptr, &_error);
+    json_value_t *value = json_parse_token(ctx, ptr, &_error);
     if (!value) {
       if (!_error)
         _error = json_error_new(strdup("Unexpected end of input in array"), 0);
       goto return_error;
     }
 
-    array_push(array, value);
+    _json_array_append(ctx, array, value);
 
-    __auto_type token_type = _json_lex_get_next_token(src, ptr, &_error);
+    __auto_type token_type = _json_lex(ctx, ptr, &_error);
     if (_error)
       goto return_error;
 
@@ -559,15 +1126,16 @@ json_value_t *json_parse_array(const char *src, const char **ptr,
   }
 
 done:;
-  json_value_t *self = malloc(sizeof(*self));
+  json_value_t *self = _json_value_alloc(ctx);
   *self = (json_value_t){
       .type = JSON_VALUE_TYPE_ARRAY,
+      .allocator = ctx->allocator,
       .value.array = array,
   };
   return self;
 
 return_error:
-  array_destroy(&array);
+  _json_array_release(ctx, &array);
   set_out_value(error, _error);
   if (!error)
     json_error_destroy(&_error);
@@ -579,7 +1147,7 @@ void json_value_free(json_value_t *self) {
     return;
   switch (self->type) {
   case JSON_VALUE_TYPE_STRING:
-    free(self->value.string);
+    rcl_free(self->allocator, self->value.string);
     break;
   case JSON_VALUE_TYPE_ARRAY:
     array_destroy(&self->value.array);
@@ -590,7 +1158,7 @@ void json_value_free(json_value_t *self) {
   default:
     break;
   }
-  free(self);
+  rcl_free(self->allocator, self);
 }
 
 void json_value_destroy(json_value_t **ptr) {
@@ -600,15 +1168,16 @@ void json_value_destroy(json_value_t **ptr) {
   }
 }
 
-bool json_parse_safe(const char *src, json_value_t out *result,
-                     json_error_t out *error) {
+static bool _json_parse(json_parse_ctx_t *ctx, json_value_t out *result,
+                        json_error_t out *error) {
   set_out_value(result, NULL);
   set_out_value(error, NULL);
 
   json_error_t *_error = NULL;
 
+  const char *src = ctx->src;
   const char **ptr = &src;
-  json_value_t *root = json_parse_token(src, ptr, &_error);
+  json_value_t *root = json_parse_token(ctx, ptr, &_error);
 
   if (_error)
     goto return_error;
@@ -618,7 +1187,7 @@ bool json_parse_safe(const char *src, json_value_t out *result,
     goto return_error;
   }
 
-  __auto_type token_type = _json_lex_get_next_token(src, ptr, &_error);
+  __auto_type token_type = _json_lex(ctx, ptr, &_error);
   if (_error || token_type != JSON_TOKEN_END) {
     if (!_error)
       _error =
@@ -629,18 +1198,220 @@ bool json_parse_safe(const char *src, json_value_t out *result,
   if (result)
     *result = root;
   else
-    json_value_destroy(&root);
+    _json_value_release(ctx, &root);
   return true;
 
 return_error:
   if (root)
-    json_value_destroy(&root);
+    _json_value_release(ctx, &root);
   set_out_value(error, _error);
   if (!error)
     json_error_destroy(&_error);
   return false;
 }
 
+bool json_parse_safe(const char *src, json_value_t out *result,
+                     json_error_t out *error) {
+  return json_parse_full(src, result, error,
+                         (json_parse_options_t){.parser = NULL});
+}
+
+static hashtable_t *
+_json_parser_key_cache_new(const rcl_allocator_t *allocator) {
+  return hashtable_new_full((hashtable_init_t){
+      .capacity = DEFAULT_JSON_OBJECT_CAPACITY,
+      .hash_func = hashtable_hash_seeded,
+      .allocator = allocator,
+  });
+}
+
+json_parser_t *json_parser_new_full(json_parser_init_t init) {
+  const rcl_allocator_t *allocator = init.allocator;
+  json_parser_t *self = rcl_alloc(allocator, sizeof(*self));
+
+  *self = (json_parser_t){
+      .allocator = allocator,
+      .max_retained = init.max_retained ? init.max_retained
+                                        : JSON_PARSER_DEFAULT_MAX_RETAINED,
+      .slabs = array_new(json_value_t *, .capacity = 4, .allocator = allocator),
+      .chunks =
+          array_new(json_chunk_t *, .capacity = 4, .allocator = allocator),
+      .arrays = array_new(array_t *, .allocator = allocator),
+      .objects = array_new(hashtable_t *, .allocator = allocator),
+      .keys = _json_parser_key_cache_new(allocator),
+      .sizes = array_new(uint32_t, .allocator = allocator),
+      .open = array_new(size_t, .allocator = allocator),
+  };
+
+  return self;
+}
+
+// Release everything the parser holds, but keep the parser usable.
+static void _json_parser_release(json_parser_t *self) {
+  ARRAY_OF(json_value_t *) *slabs = (void *)self->slabs;
+  for (size_t i = 0; i < slabs->length; i++)
+    rcl_free(self->allocator, slabs->data[i]);
+  slabs->length = 0;
+
+  ARRAY_OF(json_chunk_t *) *chunks = (void *)self->chunks;
+  for (size_t i = 0; i < chunks->length; i++)
+    rcl_free(self->allocator, chunks->data[i]);
+  chunks->length = 0;
+
+  ARRAY_OF(array_t *) *arrays = (void *)self->arrays;
+  for (size_t i = 0; i < arrays->length; i++)
+    array_free(arrays->data[i]);
+  arrays->length = 0;
+
+  ARRAY_OF(hashtable_t *) *objects = (void *)self->objects;
+  for (size_t i = 0; i < objects->length; i++) {
+    _json_parser_forget_object(objects->data[i]);
+    hashtable_free(objects->data[i]);
+  }
+  objects->length = 0;
+
+  hashtable_free(self->keys);
+  self->keys = _json_parser_key_cache_new(self->allocator);
+  self->key_bytes = 0;
+
+  rcl_free(self->allocator, self->scratch);
+  self->scratch = NULL;
+  self->scratch_capacity = 0;
+
+  array_free(self->sizes);
+  array_free(self->open);
+  self->sizes = array_new(uint32_t, .allocator = self->allocator);
+  self->open = array_new(size_t, .allocator = self->allocator);
+
+  self->retained = 0;
+}
+
+// Measure how much memory the parser holds. Containers may have grown during
+// the parse, so this has to look at each of them.
+static size_t _json_parser_measure(json_parser_t *self) {
+  size_t total = self->slabs->length * JSON_PARSER_SLAB_NODES *
+                 sizeof(json_value_t);
+
+  ARRAY_OF(json_chunk_t *) *chunks = (void *)self->chunks;
+  for (size_t i = 0; i < chunks->length; i++)
+    total += sizeof(json_chunk_t) + chunks->data[i]->size;
+
+  ARRAY_OF(array_t *) *arrays = (void *)self->arrays;
+  for (size_t i = 0; i < arrays->length; i++)
+    total += sizeof(array_t) + arrays->data[i]->capacity * sizeof(void *);
+
+  ARRAY_OF(hashtable_t *) *objects = (void *)self->objects;
+  for (size_t i = 0; i < objects->length; i++)
+    total += sizeof(hashtable_t) +
+             objects->data[i]->capacity * sizeof(uint32_t) +
+             objects->data[i]->items_capacity * sizeof(item_t);
+
+  total += self->keys->capacity * sizeof(item_t) + self->key_bytes;
+  total += self->scratch_capacity;
+  total += self->sizes->capacity * sizeof(uint32_t);
+  total += self->open->capacity * sizeof(size_t);
+  return total;
+}
+
+void json_parser_reset(json_parser_t *self) {
+  if (self->retained > self->max_retained)
+    _json_parser_release(self);
+
+  self->slab_index = 0;
+  self->slab_used = 0;
+  self->chunk_index = 0;
+  self->chunk_used = 0;
+  self->arrays_used = 0;
+  self->objects_used = 0;
+}
+
+bool json_parser_parse(json_parser_t *self, const char *src,
+                       json_value_t out *result, json_error_t out *error) {
+  return json_parse_full(src, result, error,
+                         (json_parse_options_t){.parser = self});
+}
+
+bool json_parse_full(const char *src, json_value_t out *result,
+                     json_error_t out *error, json_parse_options_t options) {
+  json_parse_stats_t discarded_stats = {0};
+  json_parse_ctx_t ctx = {
+      .src = src,
+      .parser = options.parser,
+      .allocator =
+          options.parser ? options.parser->allocator : options.allocator,
+      .stats = options.stats ? options.stats : &discarded_stats,
+      .lazy_numbers = options.lazy_numbers,
+  };
+  if (options.stats)
+    memset(options.stats, 0, sizeof(*options.stats));
+
+  if (ctx.parser) {
+    json_parser_reset(ctx.parser);
+    ctx.parser->stats = ctx.stats;
+  }
+
+  array_t *open = NULL;
+  if (options.prescan) {
+    JSON_STAT_CYCLES_START(cycles);
+    if (ctx.parser) {
+      ctx.sizes = ctx.parser->sizes;
+      open = ctx.parser->open;
+      ctx.sizes->length = 0;
+      open->length = 0;
+    } else {
+      ctx.sizes = array_new(uint32_t, .allocator = ctx.allocator);
+      open = array_new(size_t, .allocator = ctx.allocator);
+      JSON_STAT_ADD(&ctx, allocations, 4);
+    }
+#if RCL_JSON_STATS
+    size_t sizes_capacity = ctx.sizes->capacity;
+    size_t open_capacity = open->capacity;
+#endif
+    _json_prescan(src, ctx.sizes, open);
+    JSON_STAT_ADD(&ctx, allocations,
+                  _json_doublings(sizes_capacity, ctx.sizes->capacity) +
+                      _json_doublings(open_capacity, open->capacity));
+    JSON_STAT_CYCLES_STOP(&ctx, prescan_cycles, cycles);
+  }
+
+  bool ok = _json_parse(&ctx, result, error);
+
+  if (ctx.parser) {
+    ctx.parser->stats = NULL;
+    ctx.parser->retained = _json_parser_measure(ctx.parser);
+  } else if (options.prescan) {
+    array_free(ctx.sizes);
+    array_free(open);
+  }
+  return ok;
+}
+
+int json_parse_stats_level(void) { return RCL_JSON_STATS; }
+
+size_t json_parser_retained(json_parser_t *self) { return self->retained; }
+
+void json_parser_free(json_parser_t *self) {
+  if (!self)
+    return;
+
+  _json_parser_release(self);
+  array_free(self->slabs);
+  array_free(self->chunks);
+  array_free(self->arrays);
+  array_free(self->objects);
+  hashtable_free(self->keys);
+  array_free(self->sizes);
+  array_free(self->open);
+  rcl_free(self->allocator, self);
+}
+
+void json_parser_destroy(json_parser_t **self) {
+  if (self) {
+    json_parser_free(*self);
+    *self = NULL;
+  }
+}
+
 void _json_dump(json_value_t *val, int indent_size, int indent_level) {
   if (!val) {
     printf("null");
@@ -655,7 +1426,10 @@ void _json_dump(json_value_t *val, int indent_size, int indent_level) {
     printf("%s", val->value.boolean ? "true" : "false");
     break;
   case JSON_VALUE_TYPE_NUMBER:
-    printf("%g", val->value.number);
+    if (val->number_text)
+      printf("%.*s", (int)val->number_length, val->number_text);
+    else
+      printf("%g", val->value.number);
     break;
   case JSON_VALUE_TYPE_STRING:
     // TODO: re-encode escape sequences
@@ -719,14 +1493,98 @@ json_value_t *json_parse_assert(const char *src) {
   return result;
 }
 
+// Convert a number parsed with `lazy_numbers` and cache the result.
+static void _json_number_convert(json_value_t *self) {
+  // The text isn't null-terminated, and strtod could read past its end (e.g.
+  // hex floats), so convert a copy.
+  char buffer[64];
+  char *text = buffer;
+  if (self->number_length >= sizeof(buffer))
+    text = rcl_alloc(self->allocator, self->number_length + 1);
+  memcpy(text, self->number_text, self->number_length);
+  text[self->number_length] = '\0';
+
+  self->value.number = json_strtod(text, NULL);
+  self->number_converted = true;
+
+  if (text != buffer)
+    rcl_free(self->allocator, text);
+}
+
 double json_value_get_double(json_value_t *self) {
 #if RCL_JSON_ASSERT_GETS
   assert(self);
   assert(self->type == JSON_VALUE_TYPE_NUMBER);
 #endif
+  if (self->number_text && !self->number_converted)
+    _json_number_convert(self);
   return self->value.number;
 }
 
+// Convert the text of an integer without a fraction or exponent, saturating on
+// overflow. Returns false if the text isn't such an integer.
+static bool _json_parse_int64(const char *text, size_t length,
+                              int64_t *result) {
+  const char *end = text + length;
+  bool negative = text < end && *text == '-';
+  const char *ptr = text + negative;
+  if (ptr == end)
+    return false;
+
+  // Accumulate as a negative number, since INT64_MIN has no positive match.
+  int64_t value = 0;
+  bool overflow = false;
+  for (; ptr < end; ptr++) {
+    if (!isdigit(*ptr))
+      return false;
+    int digit = *ptr - '0';
+    if (value < (INT64_MIN + digit) / 10)
+      overflow = true;
+    else
+      value = value * 10 - digit;
+  }
+
+  if (overflow)
+    *result = negative ? INT64_MIN : INT64_MAX;
+  else if (negative)
+    *result = value;
+  else
+    *result = value == INT64_MIN ? INT64_MAX : -value;
+  return true;
+}
+
+int64_t json_value_get_int64(json_value_t *self) {
+#if RCL_JSON_ASSERT_GETS
+  assert(self);
+  assert(self->type == JSON_VALUE_TYPE_NUMBER);
+#endif
+  int64_t value;
+  if (self->number_text &&
+      _json_parse_int64(self->number_text, self->number_length, &value))
+    return value;
+
+  double number = json_value_get_double(self);
+  // Casting an out of range double is undefined, so saturate first. 2^63 is
+  // exactly representable, INT64_MAX isn't.
+  if (number >= 9223372036854775808.0)
+    return INT64_MAX;
+  if (number < -9223372036854775808.0)
+    return INT64_MIN;
+  if (number != number) // NaN
+    return 0;
+  return (int64_t)number;
+}
+
+const char *json_value_get_number_text(json_value_t *self,
+                                       size_t *length) {
+#if RCL_JSON_ASSERT_GETS
+  assert(self);
+  assert(self->type == JSON_VALUE_TYPE_NUMBER);
+#endif
+  set_out_value(length, self->number_text ? self->number_length : 0);
+  return self->number_text;
+}
+
 bool json_value_get_bool(json_value_t *self) {
 #if RCL_JSON_ASSERT_GETS
   assert(self);
@@ -1,10 +1,24 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
 #include "rcl/json.h"
+#include "rcl/hashtable.h"
 #include <cJSON.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 static char *read_file(const char *path) {
   FILE *f = fopen(path, "rb");
   if (!f) {
@@ -26,10 +40,28 @@ static double time_diff_us(struct timespec start, struct timespec end) {
          (end.tv_nsec - start.tv_nsec) / 1e3;
 }
 
+// Command line options. See `usage`.
+static struct {
+  // Untimed parses before each measurement. -1 means a tenth of the
+  // iterations.
+  int warmup;
+  // Number of timed samples each measurement is split into.
+  int trials;
+  // CPU to pin the process to, or -1.
+  int cpu;
+  // Whether to read hardware counters.
+  bool perf;
+  // Run the scaling benchmark on up to this many threads instead, if not 0.
+  int threads;
+} g_config = {
+    .warmup = -1, .trials = 100, .cpu = -1, .perf = false, .threads = 0};
+
 typedef struct {
   const char *name;
   const char *unit;
   double value;
+  // Free-form details shown next to the value, or NULL.
+  const char *extra;
 } bench_entry_t;
 
 // Dynamic array of results
@@ -37,13 +69,18 @@ static bench_entry_t *g_results = NULL;
 static int g_results_count = 0;
 static int g_results_cap = 0;
 
-static void add_result(const char *name, const char *unit, double value) {
+static void add_result_extra(const char *name, const char *unit, double value,
+                             const char *extra) {
   if (g_results_count >= g_results_cap) {
     g_results_cap = g_results_cap ? g_results_cap * 2 : 32;
     g_results = realloc(g_results, g_results_cap * sizeof(bench_entry_t));
   }
-  g_results[g_results_count++] =
-      (bench_entry_t){.name = name, .unit = unit, .value = value};
+  g_results[g_results_count++] = (bench_entry_t){
+      .name = name, .unit = unit, .value = value, .extra = extra};
+}
+
+static void add_result(const char *name, const char *unit, double value) {
+  add_result_extra(name, unit, value, NULL);
 }
 
 static void print_json_string(const char *s) {
@@ -73,7 +110,12 @@ static void print_results(void) {
     print_json_string(g_results[i].name);
     printf(", \"unit\": ");
     print_json_string(g_results[i].unit);
-    printf(", \"value\": %.2f}", g_results[i].value);
+    printf(", \"value\": %.2f", g_results[i].value);
+    if (g_results[i].extra) {
+      printf(", \"extra\": ");
+      print_json_string(g_results[i].extra);
+    }
+    putchar('}');
     if (i + 1 < g_results_count)
       putchar(',');
     putchar('\n');
@@ -81,36 +123,457 @@ static void print_results(void) {
   printf("]\n");
 }
 
-static void run_bench(const char *label, const char *src, int iterations) {
-  struct timespec start, end;
+// Hardware counters, read with perf_event_open(2) when `--perf` is given. Each
+// counter is opened on its own so that one the CPU doesn't support doesn't take
+// the others down with it.
+typedef struct {
+  // Used in result names, e.g. "rcl - canada.json (cycles/byte)".
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+  int fd;
+} perf_counter_t;
 
-  // rcl
-  clock_gettime(CLOCK_MONOTONIC, &start);
-  for (int i = 0; i < iterations; i++) {
-    json_value_t *val = NULL;
-    json_parse_safe(src, &val, NULL);
-    json_value_free(val);
+#if defined(__linux__)
+#define PERF_CACHE_MISS(cache)                                                 \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) |                              \
+   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static perf_counter_t g_counters[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1},
+    {"branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1},
+    {"L1 misses", PERF_TYPE_HW_CACHE, PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_L1D),
+     -1},
+    {"LLC misses", PERF_TYPE_HW_CACHE, PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_LL),
+     -1},
+};
+#define PERF_COUNTERS (sizeof(g_counters) / sizeof(g_counters[0]))
+
+static void perf_open(void) {
+  for (size_t i = 0; i < PERF_COUNTERS; i++) {
+    struct perf_event_attr attr = {
+        .type = g_counters[i].type,
+        .size = sizeof(attr),
+        .config = g_counters[i].config,
+        .disabled = 1,
+        .exclude_kernel = 1,
+        .exclude_hv = 1,
+        .read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING,
+    };
+    g_counters[i].fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (g_counters[i].fd < 0)
+      fprintf(stderr, "perf: %s unavailable\n", g_counters[i].name);
   }
-  clock_gettime(CLOCK_MONOTONIC, &end);
-  double rcl_us = time_diff_us(start, end) / iterations;
+}
 
-  // cJSON
-  clock_gettime(CLOCK_MONOTONIC, &start);
-  for (int i = 0; i < iterations; i++) {
-    cJSON *val = cJSON_Parse(src);
-    cJSON_Delete(val);
+static void perf_close(void) {
+  for (size_t i = 0; i < PERF_COUNTERS; i++) {
+    if (g_counters[i].fd >= 0)
+      close(g_counters[i].fd);
+    g_counters[i].fd = -1;
+  }
+}
+
+static void perf_start(void) {
+  for (size_t i = 0; i < PERF_COUNTERS; i++) {
+    if (g_counters[i].fd >= 0) {
+      ioctl(g_counters[i].fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(g_counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+// Stop the counters and store their values in `values`, or -1 for counters
+// that aren't available.
+static void perf_stop(double *values) {
+  for (size_t i = 0; i < PERF_COUNTERS; i++) {
+    values[i] = -1;
+    if (g_counters[i].fd < 0)
+      continue;
+    ioctl(g_counters[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t data[3]; // value, time enabled, time running
+    if (read(g_counters[i].fd, data, sizeof(data)) != (ssize_t)sizeof(data) ||
+        data[2] == 0)
+      continue;
+    // Scale up if the kernel had to multiplex the counters.
+    values[i] = (double)data[0] * data[1] / data[2];
   }
+}
+
+static bool pin_cpu(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+#else
+static perf_counter_t g_counters[1];
+#define PERF_COUNTERS 0
+
+static void perf_open(void) {
+  fprintf(stderr, "perf: hardware counters are only supported on Linux\n");
+}
+static void perf_close(void) {}
+static void perf_start(void) {}
+static void perf_stop(double *values) { (void)values; }
+static bool pin_cpu(int cpu) {
+  (void)cpu;
+  return false;
+}
+#endif
+
+// Parse `src` once. For the rcl functions that don't use a parser context,
+// `data` is the allocator to parse with.
+typedef void (*parse_func_t)(const char *src, void *data);
+
+static void parse_rcl(const char *src, void *data) {
+  json_value_t *val = NULL;
+  json_parse(src, &val, NULL, .allocator = data);
+  json_value_free(val);
+}
+
+static void parse_rcl_prescan(const char *src, void *data) {
+  json_value_t *val = NULL;
+  json_parse(src, &val, NULL, .allocator = data, .prescan = true);
+  json_value_free(val);
+}
+
+static void parse_rcl_lazy(const char *src, void *data) {
+  json_value_t *val = NULL;
+  json_parse(src, &val, NULL, .allocator = data, .lazy_numbers = true);
+  json_value_free(val);
+}
+
+static void parse_rcl_parser(const char *src, void *data) {
+  json_value_t *val = NULL;
+  json_parser_parse(data, src, &val, NULL);
+}
+
+static void parse_cjson(const char *src, void *data) {
+  (void)data;
+  cJSON *val = cJSON_Parse(src);
+  cJSON_Delete(val);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Time `iterations` calls of `parse` on `src`, split into trials, and record
+// the median and p99 time per parse, the throughput and (with `--perf`) the
+// hardware counters per input byte.
+static void measure(const char *name, const char *label, const char *src,
+                    int iterations, parse_func_t parse, void *data) {
+  int warmup = g_config.warmup >= 0 ? g_config.warmup : iterations / 10;
+  for (int i = 0; i < warmup; i++)
+    parse(src, data);
+
+  int trials = g_config.trials < iterations ? g_config.trials : iterations;
+  if (trials < 1)
+    trials = 1;
+  int batch = iterations / trials;
+  if (batch < 1)
+    batch = 1;
+  double *samples = malloc(trials * sizeof(*samples));
+
+  if (g_config.perf)
+    perf_start();
+  for (int t = 0; t < trials; t++) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < batch; i++)
+      parse(src, data);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    samples[t] = time_diff_us(start, end) / batch;
+  }
+  double counters[PERF_COUNTERS + 1];
+  if (g_config.perf)
+    perf_stop(counters);
+
+  qsort(samples, trials, sizeof(*samples), compare_doubles);
+  double median = trials % 2
+                      ? samples[trials / 2]
+                      : (samples[trials / 2 - 1] + samples[trials / 2]) / 2;
+  double p99 = samples[(trials * 99 + 99) / 100 - 1];
+  free(samples);
+
+  // Names like "rcl - Small object". strdup so the pointers stay valid.
+  char buf[256];
+  size_t bytes = strlen(src);
+  snprintf(buf, sizeof(buf), "%.1f MB/s, %.0f docs/s", bytes / median,
+           1e6 / median);
+  char *extra = strdup(buf);
+  snprintf(buf, sizeof(buf), "%s - %s", name, label);
+  add_result_extra(strdup(buf), "us/op", median, extra);
+  snprintf(buf, sizeof(buf), "%s - %s (p99)", name, label);
+  add_result(strdup(buf), "us/op", p99);
+
+  if (!g_config.perf)
+    return;
+  double parses = (double)trials * batch;
+  for (size_t i = 0; i < PERF_COUNTERS; i++) {
+    if (counters[i] < 0)
+      continue;
+    snprintf(buf, sizeof(buf), "%s - %s (%s/byte)", name, label,
+             g_counters[i].name);
+    char unit[64];
+    snprintf(unit, sizeof(unit), "%s/byte", g_counters[i].name);
+    add_result(strdup(buf), strdup(unit), counters[i] / (parses * bytes));
+  }
+}
+
+// Allocations made by cJSON while memory is being measured. cJSON only takes
+// global malloc/free hooks, so they forward to this.
+static rcl_counting_allocator_t *g_cjson_counter = NULL;
+
+static void *cjson_counting_malloc(size_t size) {
+  return rcl_alloc(&g_cjson_counter->allocator, size);
+}
+
+static void cjson_counting_free(void *ptr) {
+  rcl_free(&g_cjson_counter->allocator, ptr);
+}
+
+static size_t count_nodes(json_value_t *val) {
+  size_t count = 1;
+  if (val->type == JSON_VALUE_TYPE_ARRAY) {
+    ARRAY_OF(json_value_t *) *items = (void *)val->value.array;
+    for (size_t i = 0; i < items->length; i++)
+      count += count_nodes(items->data[i]);
+  } else if (val->type == JSON_VALUE_TYPE_OBJECT) {
+    hashtable_foreach(val->value.object, { count += count_nodes(value); });
+  }
+  return count;
+}
+
+// Count what a single parse of `src` allocates: allocator calls per JSON node
+// and peak live bytes per input byte, with the totals alongside. `counter`
+// must be the allocator `parse` allocates from; anything it already holds
+// (e.g. a parser context's retained memory) counts towards the peak.
+static void measure_memory(const char *name, const char *label,
+                           const char *src, size_t nodes, parse_func_t parse,
+                           void *data, rcl_counting_allocator_t *counter) {
+  rcl_counting_allocator_reset(counter);
+  parse(src, data);
+
+  size_t allocations = counter->allocations + counter->reallocations;
+  size_t bytes = strlen(src);
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%zu allocations, %zu bytes allocated, %zu peak",
+           allocations, counter->bytes, counter->peak_bytes);
+  char *extra = strdup(buf);
+
+  snprintf(buf, sizeof(buf), "%s - %s (allocs/node)", name, label);
+  add_result(strdup(buf), "allocs/node", (double)allocations / nodes);
+  snprintf(buf, sizeof(buf), "%s - %s (peak bytes/byte)", name, label);
+  add_result_extra(strdup(buf), "bytes/byte",
+                   (double)counter->peak_bytes / bytes, extra);
+}
+
+static void run_memory(const char *label, const char *src) {
+  json_value_t *root = NULL;
+  if (!json_parse_safe(src, &root, NULL))
+    return;
+  size_t nodes = count_nodes(root);
+  json_value_free(root);
+
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+  measure_memory("rcl", label, src, nodes, parse_rcl, &counter.allocator,
+                 &counter);
+  measure_memory("rcl (prescan)", label, src, nodes, parse_rcl_prescan,
+                 &counter.allocator, &counter);
+  measure_memory("rcl (lazy numbers)", label, src, nodes, parse_rcl_lazy,
+                 &counter.allocator, &counter);
+
+  // The steady state: the parser has already seen a similar document. No cap,
+  // so big documents (canada.json holds ~11 MB) aren't released every reset.
+  json_parser_t *parser = json_parser_new(.max_retained = SIZE_MAX,
+                                          .allocator = &counter.allocator);
+  parse_rcl_parser(src, parser);
+  measure_memory("rcl (parser)", label, src, nodes, parse_rcl_parser, parser,
+                 &counter);
+  json_parser_free(parser);
+
+  g_cjson_counter = &counter;
+  cJSON_InitHooks(&(cJSON_Hooks){.malloc_fn = cjson_counting_malloc,
+                                 .free_fn = cjson_counting_free});
+  measure_memory("cJSON", label, src, nodes, parse_cjson, NULL, &counter);
+  cJSON_InitHooks(NULL);
+  g_cjson_counter = NULL;
+}
+
+// Threads of the scaling benchmark wait at this gate until all of them exist,
+// so thread creation isn't timed.
+static pthread_mutex_t g_gate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_gate_cond = PTHREAD_COND_INITIALIZER;
+static bool g_gate_open = false;
+
+typedef struct {
+  const char *src;
+  int warmup;
+  int iterations;
+  parse_func_t parse;
+  void *data;
+} thread_job_t;
+
+static void *run_thread(void *arg) {
+  thread_job_t *job = arg;
+  for (int i = 0; i < job->warmup; i++)
+    job->parse(job->src, job->data);
+
+  pthread_mutex_lock(&g_gate_lock);
+  while (!g_gate_open)
+    pthread_cond_wait(&g_gate_cond, &g_gate_lock);
+  pthread_mutex_unlock(&g_gate_lock);
+
+  for (int i = 0; i < job->iterations; i++)
+    job->parse(job->src, job->data);
+  return NULL;
+}
+
+// Parse `src` `iterations` times on each of `threads` threads at once, giving
+// each thread its own parser context if `use_parser` is set. Returns the wall
+// time in microseconds.
+static double time_threads(int threads, const char *src, int iterations,
+                           parse_func_t parse, bool use_parser) {
+  pthread_t *ids = malloc(threads * sizeof(*ids));
+  thread_job_t *jobs = malloc(threads * sizeof(*jobs));
+  int warmup = g_config.warmup >= 0 ? g_config.warmup : iterations / 10;
+
+  g_gate_open = false;
+  for (int t = 0; t < threads; t++) {
+    jobs[t] = (thread_job_t){
+        .src = src,
+        .warmup = warmup,
+        .iterations = iterations,
+        .parse = parse,
+        .data = use_parser ? json_parser_new(.max_retained = SIZE_MAX) : NULL,
+    };
+    pthread_create(&ids[t], NULL, run_thread, &jobs[t]);
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pthread_mutex_lock(&g_gate_lock);
+  g_gate_open = true;
+  pthread_cond_broadcast(&g_gate_cond);
+  pthread_mutex_unlock(&g_gate_lock);
+  for (int t = 0; t < threads; t++)
+    pthread_join(ids[t], NULL);
   clock_gettime(CLOCK_MONOTONIC, &end);
-  double cjson_us = time_diff_us(start, end) / iterations;
 
-  // Build names like "rcl - Small object"
-  char rcl_name[256], cjson_name[256];
-  snprintf(rcl_name, sizeof(rcl_name), "rcl - %s", label);
-  snprintf(cjson_name, sizeof(cjson_name), "cJSON - %s", label);
+  for (int t = 0; t < threads; t++)
+    json_parser_free(jobs[t].data);
+  free(jobs);
+  free(ids);
+  return time_diff_us(start, end);
+}
+
+// Measure aggregate throughput on 1, 2, 4, ... up to `max_threads` threads,
+// and its efficiency: the throughput divided by `threads` times the
+// single-threaded throughput.
+static void measure_scaling(const char *name, const char *label,
+                            const char *src, int iterations, int max_threads,
+                            parse_func_t parse, bool use_parser) {
+  size_t bytes = strlen(src);
+  double single = 0;
+
+  for (int threads = 1;;) {
+    double us = time_threads(threads, src, iterations, parse, use_parser);
+    double parses = (double)threads * iterations;
+    double throughput = parses * bytes / us; // MB/s
+    if (threads == 1)
+      single = throughput;
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "%.0f docs/s", parses * 1e6 / us);
+    char *extra = strdup(buf);
+    snprintf(buf, sizeof(buf), "%s - %s (%d threads)", name, label, threads);
+    add_result_extra(strdup(buf), "MB/s", throughput, extra);
+    snprintf(buf, sizeof(buf), "%s - %s (%d threads, efficiency)", name, label,
+             threads);
+    add_result(strdup(buf), "%", 100 * throughput / (threads * single));
+
+    if (threads >= max_threads)
+      break;
+    // Double, but always end with `max_threads` even if it isn't a power of 2.
+    threads = threads * 2 < max_threads ? threads * 2 : max_threads;
+  }
+}
+
+static void run_scaling(const char *label, const char *src, int iterations) {
+  int threads = g_config.threads;
+  measure_scaling("rcl", label, src, iterations, threads, parse_rcl, false);
+  measure_scaling("rcl (parser)", label, src, iterations, threads,
+                  parse_rcl_parser, true);
+  measure_scaling("cJSON", label, src, iterations, threads, parse_cjson,
+                  false);
+}
+
+// Print parse statistics to stderr, so stdout stays valid JSON.
+static void print_stats(const char *label, const char *src) {
+  if (json_parse_stats_level() == 0)
+    return;
+
+  json_parse_stats_t stats;
+  json_value_t *val = NULL;
+  json_parse(src, &val, NULL, .stats = &stats);
+  json_value_free(val);
 
-  // strdup so the pointers stay valid
-  add_result(strdup(rcl_name), "us/op", rcl_us);
-  add_result(strdup(cjson_name), "us/op", cjson_us);
+  fprintf(stderr, "%s:\n", label);
+  fprintf(stderr,
+          "  nodes: %zu null, %zu bool, %zu number, %zu string, %zu array, "
+          "%zu object\n",
+          stats.nodes[JSON_VALUE_TYPE_NULL], stats.nodes[JSON_VALUE_TYPE_BOOL],
+          stats.nodes[JSON_VALUE_TYPE_NUMBER],
+          stats.nodes[JSON_VALUE_TYPE_STRING],
+          stats.nodes[JSON_VALUE_TYPE_ARRAY],
+          stats.nodes[JSON_VALUE_TYPE_OBJECT]);
+  fprintf(stderr, "  max depth: %zu, string bytes: %zu, escapes: %zu\n",
+          stats.max_depth, stats.string_bytes, stats.escapes);
+  fprintf(stderr,
+          "  hashtable grows: %zu, array reallocs: %zu, allocations: %zu\n",
+          stats.hashtable_grows, stats.array_reallocs, stats.allocations);
+  if (json_parse_stats_level() < 2)
+    return;
+
+  // Only a parse with `.prescan` spends any time prescanning.
+  json_parse_stats_t prescan_stats;
+  json_parse(src, &val, NULL, .stats = &prescan_stats, .prescan = true);
+  json_value_free(val);
+  fprintf(stderr,
+          "  cycles: lex %llu, string %llu, number %llu, build %llu, "
+          "prescan %llu\n",
+          stats.lex_cycles, stats.string_cycles, stats.number_cycles,
+          stats.build_cycles, prescan_stats.prescan_cycles);
+}
+
+static void run_bench(const char *label, const char *src, int iterations) {
+  if (g_config.threads > 0) {
+    run_scaling(label, src, iterations);
+    return;
+  }
+
+  print_stats(label, src);
+
+  measure("rcl", label, src, iterations, parse_rcl, NULL);
+  // Presizing containers with a prescan
+  measure("rcl (prescan)", label, src, iterations, parse_rcl_prescan, NULL);
+  // Leaving numbers unconverted
+  measure("rcl (lazy numbers)", label, src, iterations, parse_rcl_lazy, NULL);
+
+  // Reusing a parser context across iterations, with no cap on what it keeps
+  json_parser_t *parser = json_parser_new(.max_retained = SIZE_MAX);
+  measure("rcl (parser)", label, src, iterations, parse_rcl_parser, parser);
+  json_parser_free(parser);
+
+  measure("cJSON", label, src, iterations, parse_cjson, NULL);
+
+  run_memory(label, src);
 }
 
 // Generate a JSON string with many key-value pairs
@@ -128,6 +591,29 @@ static char *generate_flat_object(int num_keys) {
   return buf;
 }
 
+// Generate an object whose keys all hash to the same slot of any table of up
+// to 2048 slots under the unseeded `hashtable_hash_wyhash`, as a client could
+// craft them against a parser that used it: each insert would probe past
+// every key before it.
+static char *generate_colliding_object(int num_keys) {
+  size_t cap = 64 + num_keys * 40;
+  char *buf = malloc(cap);
+  size_t pos = 0;
+  char key[32];
+  unsigned n = 0;
+  pos += snprintf(buf + pos, cap - pos, "{");
+  for (int i = 0; i < num_keys; i++) {
+    do
+      snprintf(key, sizeof(key), "key_%x", n++);
+    while (hashtable_hash_wyhash(key) & 2047);
+    if (i > 0)
+      pos += snprintf(buf + pos, cap - pos, ",");
+    pos += snprintf(buf + pos, cap - pos, "\"%s\":%d", key, i);
+  }
+  pos += snprintf(buf + pos, cap - pos, "}");
+  return buf;
+}
+
 // Generate a deeply nested JSON array
 static char *generate_nested_array(int depth) {
   size_t cap = depth * 4 + 16;
@@ -180,6 +666,22 @@ static void run_single(const char *parser, const char *path, int iterations) {
   free(src);
 }
 
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [options] [file [iterations]]\n"
+          "       %s --parser <rcl|cjson> <file> [iterations]\n"
+          "\n"
+          "  --warmup N   untimed parses before each measurement\n"
+          "               (default: a tenth of the iterations)\n"
+          "  --trials N   timed samples per measurement (default: 100)\n"
+          "  --pin CPU    pin the process to a CPU\n"
+          "  --perf       report hardware counters per input byte\n"
+          "  --threads N  measure throughput on 1, 2, 4, ... N threads\n"
+          "               instead\n",
+          argv0, argv0);
+  exit(1);
+}
+
 int main(int argc, char **argv) {
   // --parser <name> <file> [iterations] — run a single parser (for memory
   // profiling)
@@ -189,34 +691,60 @@ int main(int argc, char **argv) {
     return 0;
   }
 
+  int arg = 1;
+  for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+    if (strcmp(argv[arg], "--perf") == 0)
+      g_config.perf = true;
+    else if (arg + 1 >= argc)
+      usage(argv[0]);
+    else if (strcmp(argv[arg], "--warmup") == 0)
+      g_config.warmup = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "--trials") == 0)
+      g_config.trials = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "--pin") == 0)
+      g_config.cpu = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "--threads") == 0)
+      g_config.threads = atoi(argv[++arg]);
+    else
+      usage(argv[0]);
+  }
+
+  if (g_config.cpu >= 0 && !pin_cpu(g_config.cpu))
+    fprintf(stderr, "Could not pin to CPU %d\n", g_config.cpu);
+  if (g_config.perf)
+    perf_open();
+
   // If a file path is provided, benchmark that file
-  if (argc > 1) {
-    char *src = read_file(argv[1]);
-    int iterations = argc > 2 ? atoi(argv[2]) : 20;
-    run_bench(argv[1], src, iterations);
+  if (arg < argc) {
+    char *src = read_file(argv[arg]);
+    int iterations = arg + 1 < argc ? atoi(argv[arg + 1]) : 20;
+    run_bench(argv[arg], src, iterations);
     free(src);
-    print_results();
-    free(g_results);
-    return 0;
-  }
+  } else {
+    // Otherwise, run synthetic benchmarks
+    char *small = "{\"name\":\"test\",\"value\":42,\"active\":true}";
+    run_bench("Small object", small, 100000);
 
-  // Otherwise, run synthetic benchmarks
-  char *small = "{\"name\":\"test\",\"value\":42,\"active\":true}";
-  run_bench("Small object", small, 100000);
+    char *flat = generate_flat_object(1000);
+    run_bench("Flat object (1000 keys)", flat, 1000);
 
-  char *flat = generate_flat_object(1000);
-  run_bench("Flat object (1000 keys)", flat, 1000);
+    char *colliding = generate_colliding_object(1000);
+    run_bench("Colliding keys (1000 keys)", colliding, 1000);
 
-  char *nested = generate_nested_array(100);
-  run_bench("Nested arrays (depth 100)", nested, 50000);
+    char *nested = generate_nested_array(100);
+    run_bench("Nested arrays (depth 100)", nested, 50000);
 
-  char *mixed = generate_mixed_array(500);
-  run_bench("Mixed array (500 objects)", mixed, 1000);
+    char *mixed = generate_mixed_array(500);
+    run_bench("Mixed array (500 objects)", mixed, 1000);
 
-  free(flat);
-  free(nested);
-  free(mixed);
+    free(flat);
+    free(colliding);
+    free(nested);
+    free(mixed);
+  }
 
+  if (g_config.perf)
+    perf_close();
   print_results();
   free(g_results);
 
@@ -1,6 +1,7 @@
 #include "unity.h"
 #include <rcl/json.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -238,6 +239,326 @@ static void test_parse_safe_invalid(void) {
   json_error_destroy(&error);
 }
 
+static void test_parser_reuse(void) {
+  json_parser_t *parser = json_parser_new();
+  json_value_t *val = NULL;
+
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_TRUE(json_parser_parse(parser, VALID_JSON_1, &val, NULL));
+
+    hashtable_t *obj = json_value_get_object(val);
+    TEST_ASSERT_EQUAL_size_t(4, obj->length);
+    TEST_ASSERT_EQUAL_STRING("value",
+                             json_value_get_string(hashtable_get(obj, "key")));
+
+    array_t *arr = json_value_get_array(hashtable_get(obj, "arr"));
+    TEST_ASSERT_EQUAL_size_t(3, arr->length);
+    ARRAY_OF(json_value_t *) *items = (void *)arr;
+    TEST_ASSERT_EQUAL_FLOAT(3.0, json_value_get_double(items->data[0]));
+    TEST_ASSERT_TRUE(json_value_is_null(hashtable_get(obj, "foo")));
+  }
+
+  // A differently shaped document reuses the same containers.
+  TEST_ASSERT_TRUE(
+      json_parser_parse(parser, "[{\"key\": \"a\\nb\"}, []]", &val, NULL));
+  ARRAY_OF(json_value_t *) *items = (void *)json_value_get_array(val);
+  TEST_ASSERT_EQUAL_size_t(2, items->length);
+  hashtable_t *obj = json_value_get_object(items->data[0]);
+  TEST_ASSERT_EQUAL_size_t(1, obj->length);
+  TEST_ASSERT_EQUAL_STRING("a\nb",
+                           json_value_get_string(hashtable_get(obj, "key")));
+  TEST_ASSERT_EQUAL_size_t(0, json_value_get_array(items->data[1])->length);
+
+  json_parser_destroy(&parser);
+  TEST_ASSERT_NULL(parser);
+}
+
+static void test_parser_duplicate_keys(void) {
+  json_parser_t *parser = json_parser_new();
+  json_value_t *val = NULL;
+
+  TEST_ASSERT_TRUE(
+      json_parser_parse(parser, "{\"a\": 1, \"a\": 2}", &val, NULL));
+  hashtable_t *obj = json_value_get_object(val);
+  TEST_ASSERT_EQUAL_size_t(1, obj->length);
+  TEST_ASSERT_EQUAL_FLOAT(2.0, json_value_get_double(hashtable_get(obj, "a")));
+
+  json_parser_free(parser);
+}
+
+static void test_parse_object_order(void) {
+  const char *src = "{\"b\": 1, \"a\": 2, \"c\": {\"z\": 0, \"y\": 0}, "
+                    "\"a\": 4}";
+  json_parser_t *parser = json_parser_new();
+  json_value_t *val = NULL;
+
+  // Keys come out in document order; a duplicate keeps its first place.
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_TRUE(json_parse_full(
+        src, &val, NULL,
+        (json_parse_options_t){.parser = i ? parser : NULL,
+                               .prescan = i == 2}));
+    hashtable_t *obj = json_value_get_object(val);
+    char keys[8] = "";
+    hashtable_foreach(obj, { strcat(keys, key); });
+    TEST_ASSERT_EQUAL_STRING("bac", keys);
+    TEST_ASSERT_EQUAL_DOUBLE(4, json_value_get_double(hashtable_get(obj, "a")));
+    // Keys come from the document, so they're hashed with a secret.
+    TEST_ASSERT_EQUAL_PTR(hashtable_hash_seeded, obj->hash_func);
+
+    keys[0] = '\0';
+    hashtable_foreach(json_value_get_object(hashtable_get(obj, "c")),
+                      { strcat(keys, key); });
+    TEST_ASSERT_EQUAL_STRING("zy", keys);
+    if (!i)
+      json_value_destroy(&val);
+  }
+
+  json_parser_free(parser);
+}
+
+static void test_parser_errors(void) {
+  json_parser_t *parser = json_parser_new();
+  json_value_t *val = NULL;
+  json_error_t *error = NULL;
+
+  TEST_ASSERT_FALSE(json_parser_parse(parser, "{\"a\": [1, 2", &val, &error));
+  TEST_ASSERT_NULL(val);
+  TEST_ASSERT_NOT_NULL(error);
+  json_error_destroy(&error);
+
+  // The parser is still usable after an error.
+  TEST_ASSERT_TRUE(json_parser_parse(parser, "[1, 2]", &val, &error));
+  TEST_ASSERT_NULL(error);
+  TEST_ASSERT_EQUAL_size_t(2, json_value_get_array(val)->length);
+
+  json_parser_free(parser);
+}
+
+static void test_parser_max_retained(void) {
+  json_parser_t *parser = json_parser_new(.max_retained = 1);
+  json_value_t *val = NULL;
+
+  TEST_ASSERT_TRUE(json_parser_parse(parser, VALID_JSON_1, &val, NULL));
+  TEST_ASSERT_TRUE(json_parser_retained(parser) > 1);
+
+  // Going over the cap releases everything on the next reset.
+  json_parser_reset(parser);
+  TEST_ASSERT_EQUAL_size_t(0, json_parser_retained(parser));
+
+  TEST_ASSERT_TRUE(json_parser_parse(parser, "\"still works\"", &val, NULL));
+  TEST_ASSERT_EQUAL_STRING("still works", json_value_get_string(val));
+
+  json_parser_free(parser);
+
+  // A zero cap means the default one, not releasing on every reset.
+  parser = json_parser_new_full((json_parser_init_t){0});
+  TEST_ASSERT_TRUE(json_parser_parse(parser, VALID_JSON_1, &val, NULL));
+  size_t retained = json_parser_retained(parser);
+  json_parser_reset(parser);
+  TEST_ASSERT_EQUAL_size_t(retained, json_parser_retained(parser));
+  json_parser_free(parser);
+}
+
+static void test_parse_stats(void) {
+  json_parse_stats_t stats;
+  json_value_t *val = NULL;
+
+  TEST_ASSERT_TRUE(json_parse(
+      "{\"a\": [1, \"x\\ny\", true], \"b\": {\"c\": null}}", &val, NULL,
+      .stats = &stats));
+
+  if (json_parse_stats_level() == 0) {
+    // Stats are compiled out, so they must be left zeroed.
+    TEST_ASSERT_EQUAL_size_t(0, stats.nodes[JSON_VALUE_TYPE_OBJECT]);
+    TEST_ASSERT_EQUAL_size_t(0, stats.allocations);
+  } else {
+    TEST_ASSERT_EQUAL_size_t(2, stats.nodes[JSON_VALUE_TYPE_OBJECT]);
+    TEST_ASSERT_EQUAL_size_t(1, stats.nodes[JSON_VALUE_TYPE_ARRAY]);
+    TEST_ASSERT_EQUAL_size_t(1, stats.nodes[JSON_VALUE_TYPE_NUMBER]);
+    TEST_ASSERT_EQUAL_size_t(1, stats.nodes[JSON_VALUE_TYPE_STRING]);
+    TEST_ASSERT_EQUAL_size_t(1, stats.nodes[JSON_VALUE_TYPE_BOOL]);
+    TEST_ASSERT_EQUAL_size_t(1, stats.nodes[JSON_VALUE_TYPE_NULL]);
+    TEST_ASSERT_EQUAL_size_t(2, stats.max_depth);
+    // "a", "x\ny", "b" and "c"
+    TEST_ASSERT_EQUAL_size_t(6, stats.string_bytes);
+    TEST_ASSERT_EQUAL_size_t(1, stats.escapes);
+    TEST_ASSERT_TRUE(stats.allocations > 0);
+  }
+
+  json_value_destroy(&val);
+}
+
+static void test_parse_stats_allocations(void) {
+  // Enough distinct keys to grow a parser's key cache several times.
+  char src[300 * 32];
+  size_t pos = 0;
+  pos += snprintf(src + pos, sizeof(src) - pos, "[");
+  for (int i = 0; i < 300; i++)
+    pos += snprintf(src + pos, sizeof(src) - pos, "%s{\"id\": %d, \"k%d\": []}",
+                    i ? "," : "", i, i);
+  snprintf(src + pos, sizeof(src) - pos, "]");
+
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+  json_parser_t *parser = json_parser_new(.allocator = &counter.allocator);
+
+  // Plain, prescan and parser parses.
+  for (int i = 0; i < 3; i++) {
+    json_parse_stats_t stats;
+    json_value_t *val = NULL;
+    rcl_counting_allocator_reset(&counter);
+    TEST_ASSERT_TRUE(json_parse_full(
+        src, &val, NULL,
+        (json_parse_options_t){.parser = i == 2 ? parser : NULL,
+                               .prescan = i == 1,
+                               .stats = &stats,
+                               .allocator = &counter.allocator}));
+
+    // Every allocator call the parse makes is counted, and nothing else.
+    if (json_parse_stats_level() == 0)
+      TEST_ASSERT_EQUAL_size_t(0, stats.allocations);
+    else
+      TEST_ASSERT_EQUAL_size_t(counter.allocations + counter.reallocations,
+                               stats.allocations);
+    if (i != 2)
+      json_value_free(val);
+  }
+
+  json_parser_free(parser);
+}
+
+static void test_parse_with_allocator(void) {
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+  json_value_t *val = NULL;
+
+  TEST_ASSERT_TRUE(
+      json_parse(VALID_JSON_1, &val, NULL, .allocator = &counter.allocator));
+  TEST_ASSERT_TRUE(counter.allocations > 0);
+  TEST_ASSERT_EQUAL_PTR(&counter.allocator, val->allocator);
+  json_value_destroy(&val);
+  TEST_ASSERT_EQUAL_size_t(0, counter.live_bytes);
+
+  // Errors don't leak anything allocated from the parse's allocator.
+  json_error_t *error = NULL;
+  TEST_ASSERT_FALSE(json_parse("{\"a\": [1, {\"b\": \"c\"}", &val, &error,
+                               .allocator = &counter.allocator));
+  json_error_destroy(&error);
+  TEST_ASSERT_EQUAL_size_t(0, counter.live_bytes);
+}
+
+static void test_parse_prescan(void) {
+  const char *src =
+      "[1, \"a,]\\\"[{\", [], {\"a\": 1, \"b\": [1, 2]}, [[]], {}]";
+  json_value_t *val = NULL;
+
+  TEST_ASSERT_TRUE(json_parse(src, &val, NULL, .prescan = true));
+  ARRAY_OF(json_value_t *) *root = (void *)json_value_get_array(val);
+  TEST_ASSERT_EQUAL_size_t(6, root->length);
+  TEST_ASSERT_EQUAL_size_t(6, root->capacity);
+  TEST_ASSERT_EQUAL_STRING("a,]\"[{", json_value_get_string(root->data[1]));
+  TEST_ASSERT_EQUAL_size_t(1, json_value_get_array(root->data[2])->capacity);
+
+  hashtable_t *object = json_value_get_object(root->data[3]);
+  TEST_ASSERT_EQUAL_size_t(2, object->length);
+  TEST_ASSERT_EQUAL_size_t(hashtable_capacity_for(2), object->capacity);
+  TEST_ASSERT_EQUAL_size_t(2, object->items_capacity);
+  array_t *inner = json_value_get_array(hashtable_get(object, "b"));
+  TEST_ASSERT_EQUAL_size_t(2, inner->length);
+  TEST_ASSERT_EQUAL_size_t(2, inner->capacity);
+
+  array_t *nested = json_value_get_array(root->data[4]);
+  TEST_ASSERT_EQUAL_size_t(1, nested->capacity);
+  // An empty object allocates no slots.
+  TEST_ASSERT_NULL(json_value_get_object(root->data[5])->items);
+  json_value_destroy(&val);
+
+  // Malformed input still fails normally.
+  TEST_ASSERT_FALSE(json_parse("[1, {\"a\": ]", &val, NULL, .prescan = true));
+  TEST_ASSERT_FALSE(json_parse("[\"abc", &val, NULL, .prescan = true));
+}
+
+static void test_parse_lazy_numbers(void) {
+  const char *src = "[1.50e3, -42, 9007199254740993, -9223372036854775808, "
+                    "99999999999999999999, 2.9]";
+  json_value_t *val = NULL;
+
+  TEST_ASSERT_TRUE(json_parse(src, &val, NULL, .lazy_numbers = true));
+  ARRAY_OF(json_value_t *) *items = (void *)json_value_get_array(val);
+
+  size_t length;
+  const char *text = json_value_get_number_text(items->data[0], &length);
+  TEST_ASSERT_EQUAL_size_t(6, length);
+  TEST_ASSERT_EQUAL_STRING_LEN("1.50e3", text, length);
+  TEST_ASSERT_FALSE(items->data[0]->number_converted);
+  TEST_ASSERT_EQUAL_DOUBLE(1500.0, json_value_get_double(items->data[0]));
+  TEST_ASSERT_TRUE(items->data[0]->number_converted);
+  // The text is still there after converting.
+  TEST_ASSERT_EQUAL_PTR(text, json_value_get_number_text(items->data[0], NULL));
+
+  TEST_ASSERT_EQUAL_INT64(-42, json_value_get_int64(items->data[1]));
+  // Integers don't go through double.
+  TEST_ASSERT_EQUAL_INT64(9007199254740993LL,
+                          json_value_get_int64(items->data[2]));
+  TEST_ASSERT_EQUAL_INT64(INT64_MIN, json_value_get_int64(items->data[3]));
+  TEST_ASSERT_EQUAL_INT64(INT64_MAX, json_value_get_int64(items->data[4]));
+  TEST_ASSERT_EQUAL_INT64(2, json_value_get_int64(items->data[5]));
+  json_value_destroy(&val);
+
+  // Eagerly converted numbers have no text.
+  TEST_ASSERT_TRUE(json_parse("2.5", &val, NULL));
+  TEST_ASSERT_NULL(json_value_get_number_text(val, &length));
+  TEST_ASSERT_EQUAL_size_t(0, length);
+  TEST_ASSERT_EQUAL_INT64(2, json_value_get_int64(val));
+  json_value_destroy(&val);
+
+  TEST_ASSERT_FALSE(json_parse("[1, -]", &val, NULL, .lazy_numbers = true));
+}
+
+static void test_parser_prescan(void) {
+  json_parser_t *parser = json_parser_new();
+  json_value_t *val = NULL;
+  char src[64 * 16] = "{";
+  for (int i = 0; i < 64; i++)
+    sprintf(src + strlen(src), "%s\"k%d\": %d", i ? ", " : "", i, i);
+  strcat(src, "}");
+
+  // Recycled containers grow to the prescanned size too.
+  TEST_ASSERT_TRUE(json_parser_parse(parser, "{\"a\": [1]}", &val, NULL));
+  for (int i = 0; i < 2; i++) {
+    TEST_ASSERT_TRUE(json_parse_full(
+        src, &val, NULL,
+        (json_parse_options_t){.parser = parser, .prescan = true}));
+    hashtable_t *object = json_value_get_object(val);
+    TEST_ASSERT_EQUAL_size_t(64, object->length);
+    TEST_ASSERT_EQUAL_size_t(hashtable_capacity_for(64), object->capacity);
+    TEST_ASSERT_EQUAL_DOUBLE(42, json_value_get_double(
+                                     hashtable_get(object, "k42")));
+  }
+
+  json_parser_free(parser);
+}
+
+static void test_parser_with_allocator(void) {
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+  json_parser_t *parser = json_parser_new(.allocator = &counter.allocator);
+  json_value_t *val = NULL;
+
+  TEST_ASSERT_TRUE(json_parser_parse(parser, VALID_JSON_1, &val, NULL));
+  size_t allocations = counter.allocations;
+  size_t reallocations = counter.reallocations;
+
+  // The steady state doesn't allocate at all.
+  TEST_ASSERT_TRUE(json_parser_parse(parser, VALID_JSON_1, &val, NULL));
+  TEST_ASSERT_EQUAL_size_t(allocations, counter.allocations);
+  TEST_ASSERT_EQUAL_size_t(reallocations, counter.reallocations);
+
+  json_parser_free(parser);
+  TEST_ASSERT_EQUAL_size_t(0, counter.live_bytes);
+}
+
 int main(void) {
   UNITY_BEGIN();
 
@@ -260,5 +581,20 @@ int main(void) {
   RUN_TEST(test_parse_trailing_comma);
   RUN_TEST(test_parse_safe_invalid);
 
+  RUN_TEST(test_parse_stats);
+  RUN_TEST(test_parse_stats_allocations);
+  RUN_TEST(test_parse_with_allocator);
+  RUN_TEST(test_parse_prescan);
+  RUN_TEST(test_parse_lazy_numbers);
+
+  // Parser context tests
+  RUN_TEST(test_parser_reuse);
+  RUN_TEST(test_parser_duplicate_keys);
+  RUN_TEST(test_parse_object_order);
+  RUN_TEST(test_parser_errors);
+  RUN_TEST(test_parser_max_retained);
+  RUN_TEST(test_parser_with_allocator);
+  RUN_TEST(test_parser_prescan);
+
   return UNITY_END();
 }
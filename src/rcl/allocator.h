@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * An allocator that rcl containers and the JSON parser get their memory from.
+ * Every function receives the allocator's `ctx` as its first argument.
+ *
+ * Anything that takes a `const rcl_allocator_t *` also accepts NULL, which
+ * means the libc allocator (`malloc`, `realloc` and `free`). NULL is the
+ * default everywhere and skips the indirect calls entirely.
+ */
+typedef struct rcl_allocator_s {
+  /**
+   * Allocate `size` bytes, suitably aligned for any type. Like the rest of
+   * rcl, callers assume this never returns NULL.
+   */
+  void *(*alloc)(void *ctx, size_t size);
+  /**
+   * Resize an allocation made by this allocator, like `realloc`. `ptr` may be
+   * NULL, in which case this behaves like `alloc`.
+   */
+  void *(*realloc)(void *ctx, void *ptr, size_t size);
+  /** Free an allocation made by this allocator. `ptr` may be NULL. */
+  void (*free)(void *ctx, void *ptr);
+  /** Passed as-is to every function above. */
+  void *ctx;
+} rcl_allocator_t;
+
+/**
+ * The libc allocator as an `rcl_allocator_t`. Equivalent to passing NULL, but
+ * useful as the parent of allocators that wrap another one.
+ */
+extern const rcl_allocator_t rcl_libc_allocator;
+
+static inline void *rcl_alloc(const rcl_allocator_t *allocator, size_t size) {
+  if (!allocator)
+    return malloc(size);
+  return allocator->alloc(allocator->ctx, size);
+}
+
+static inline void *rcl_calloc(const rcl_allocator_t *allocator, size_t count,
+                               size_t size) {
+  if (!allocator)
+    return calloc(count, size);
+  void *ptr = allocator->alloc(allocator->ctx, count * size);
+  memset(ptr, 0, count * size);
+  return ptr;
+}
+
+static inline void *rcl_realloc(const rcl_allocator_t *allocator, void *ptr,
+                                size_t size) {
+  if (!allocator)
+    return realloc(ptr, size);
+  return allocator->realloc(allocator->ctx, ptr, size);
+}
+
+static inline void rcl_free(const rcl_allocator_t *allocator, void *ptr) {
+  if (!allocator)
+    free(ptr);
+  else
+    allocator->free(allocator->ctx, ptr);
+}
+
+// Only ISO C here (no strdup/strnlen), so the header builds with -std=c99.
+static inline char *rcl_copy_string(const rcl_allocator_t *allocator,
+                                    const char *str, size_t length) {
+  char *copy = rcl_alloc(allocator, length + 1);
+  memcpy(copy, str, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+static inline char *rcl_strndup(const rcl_allocator_t *allocator,
+                                const char *str, size_t max_length) {
+  const char *end = memchr(str, '\0', max_length);
+  return rcl_copy_string(allocator, str,
+                         end ? (size_t)(end - str) : max_length);
+}
+
+static inline char *rcl_strdup(const rcl_allocator_t *allocator,
+                               const char *str) {
+  return rcl_copy_string(allocator, str, strlen(str));
+}
+
+/**
+ * An allocator that counts the requests it forwards to another allocator. Meant
+ * for tests and benchmarks. It is not thread-safe: use one per thread.
+ *
+ * ```c
+ * rcl_counting_allocator_t counter;
+ * rcl_counting_allocator_init(&counter, NULL);
+ * array_t *arr = array_new(int, .allocator = &counter.allocator);
+ * ```
+ */
+typedef struct rcl_counting_allocator_s {
+  /** Pass a pointer to this wherever an allocator is expected. */
+  rcl_allocator_t allocator;
+  /** Where requests are forwarded to. NULL means libc. */
+  const rcl_allocator_t *parent;
+
+  /** Number of allocations, including `realloc(NULL, ...)`. */
+  size_t allocations;
+  /** Number of reallocations of existing blocks. */
+  size_t reallocations;
+  /** Number of frees of non-NULL pointers. */
+  size_t frees;
+  /** Total bytes requested by allocations and reallocations. */
+  size_t bytes;
+  /** Bytes currently allocated. */
+  size_t live_bytes;
+  /** Highest value `live_bytes` has reached. */
+  size_t peak_bytes;
+} rcl_counting_allocator_t;
+
+/**
+ * Initialize a counting allocator with every counter at zero.
+ *
+ * @param self the counting allocator to initialize.
+ * @param parent the allocator to forward requests to, or NULL for libc.
+ */
+void rcl_counting_allocator_init(rcl_counting_allocator_t *self,
+                                 const rcl_allocator_t *parent);
+
+/**
+ * Reset the counters of a counting allocator. `live_bytes` is kept, since the
+ * blocks it counts are still allocated, and `peak_bytes` restarts from it.
+ *
+ * @param self the counting allocator to reset.
+ */
+void rcl_counting_allocator_reset(rcl_counting_allocator_t *self);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "rcl/allocator.h"
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -51,12 +52,18 @@ typedef struct s_array {
    * in wonderful segfaults.
    */
   array_free_func *free_func;
+
+  /**
+   * The allocator the array and its data come from. NULL means libc.
+   */
+  const rcl_allocator_t *allocator;
 } array_t;
 
 typedef struct s_array_init {
   size_t capacity;
   size_t item_size;
   array_free_func *free_func;
+  const rcl_allocator_t *allocator;
 } array_init_t;
 
 /**
@@ -71,6 +78,7 @@ array_t *array_new_full(array_init_t init);
   array_new_full((array_init_t){.capacity = ARRAY_DEFAULT_CAPACITY,            \
                                 .item_size = sizeof(type),                     \
                                 .free_func = NULL,                             \
+                                .allocator = NULL,                             \
                                 __VA_ARGS__})
 
 #define ARRAY_OF(type)                                                         \
@@ -81,6 +89,7 @@ array_t *array_new_full(array_init_t init);
     size_t item_size;                                                          \
                                                                                \
     array_free_func *free_func;                                                \
+    const rcl_allocator_t *allocator;                                          \
   }
 
 /**
@@ -94,8 +103,8 @@ array_t *array_new_full(array_init_t init);
     __auto_type __item = (item);                                               \
     array_t *__arr = (arr);                                                    \
     if (__arr->length == __arr->capacity) {                                    \
-      __arr->data =                                                            \
-          realloc(__arr->data, __arr->capacity * 2 * __arr->item_size);        \
+      __arr->data = rcl_realloc(__arr->allocator, __arr->data,                 \
+                                __arr->capacity * 2 * __arr->item_size);       \
       __arr->capacity *= 2;                                                    \
     }                                                                          \
     ((__typeof__(__item) *)__arr->data)[__arr->length++] = __item;             \
@@ -108,6 +117,8 @@ array_t *array_new_full(array_init_t init);
  * Be VERY CAREFUL, as this function does not set a free_func on the new array.
  * If you do not do that yourself, you may create a memory leak.
  *
+ * The new array uses the source array's allocator.
+ *
  * @param arr the source array
  * @param from_type type of elements on source array
  * @param to_type type of elements on the new array
@@ -122,7 +133,8 @@ array_t *array_new_full(array_init_t init);
     array_t *__res =                                                           \
         array_new_full((array_init_t){.capacity = __cap,                       \
                                       .item_size = sizeof(to_type),            \
-                                      .free_func = NULL});                     \
+                                      .free_func = NULL,                       \
+                                      .allocator = __arr->allocator});         \
     for (size_t i = 0; i < __arr->length; i++) {                               \
       ((to_type *)__res->data)[i] =                                            \
           func(((from_type *)__arr->data)[i]);                                 \
@@ -150,7 +162,7 @@ array_t *array_filter(array_t *self, array_filter_func *fn);
  * value. For pointer types (e.g. `char *`), this would be a function like
  * `strdup`. For value types, this can be an identity function.
  *
- * The new array inherits the source array's free_func.
+ * The new array inherits the source array's free_func and allocator.
  *
  * @param arr the source array.
  * @param type the type of elements in the array.
@@ -164,7 +176,8 @@ array_t *array_filter(array_t *self, array_filter_func *fn);
     array_t *__res = array_new_full(                                           \
         (array_init_t){.capacity = __arr->length ?: ARRAY_DEFAULT_CAPACITY,    \
                        .item_size = sizeof(type),                              \
-                       .free_func = __arr->free_func});                        \
+                       .free_func = __arr->free_func,                          \
+                       .allocator = __arr->allocator});                        \
     size_t __count = 0;                                                        \
     for (size_t i = 0; i < __arr->length; i++) {                               \
       if (filter_fn(&((type *)__arr->data)[i])) {                             \
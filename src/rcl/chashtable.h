@@ -0,0 +1,197 @@
+#pragma once
+
+#include "rcl/allocator.h"
+#include "rcl/hashtable.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Number of write locks in a `chashtable_t`. A key is guarded by the lock its
+ * hash selects, so writers only contend when they hit the same stripe.
+ */
+#ifndef CHASHTABLE_STRIPES
+#define CHASHTABLE_STRIPES 64
+#endif
+
+/**
+ * Number of reader counters in a `chashtable_t`. Each thread uses one, picked
+ * when it first reads, so readers rarely share a cache line.
+ */
+#ifndef CHASHTABLE_READER_SHARDS
+#define CHASHTABLE_READER_SHARDS 64
+#endif
+
+/**
+ * Removed entries and replaced values are freed in batches of this many, once
+ * no reader can still see them.
+ */
+#ifndef CHASHTABLE_RETIRE_BATCH
+#define CHASHTABLE_RETIRE_BATCH 64
+#endif
+
+typedef struct s_chashtable_node chashtable_node_t;
+typedef struct s_chashtable_buckets chashtable_buckets_t;
+typedef struct s_chashtable_retired chashtable_retired_t;
+
+/**
+ * A thread-safe hashtable for read-mostly data shared between threads.
+ *
+ * - Reads take no locks and write nothing shared but a per-thread counter, so
+ *   they scale with cores.
+ * - Writes lock one of `CHASHTABLE_STRIPES` stripes, picked by the key's hash.
+ * - Growing copies the entries into a new bucket array while holding every
+ *   stripe; readers keep using the old array until the new one is published.
+ * - Removed entries and replaced values are retired, and freed (values through
+ *   `free_func`) only after every reader that could still see them is done.
+ *
+ * Lookups with `chashtable_get` happen inside a read section, see
+ * `chashtable_read_begin`.
+ *
+ * All fields are private.
+ */
+typedef struct s_chashtable {
+  /** The current bucket array. Replaced when the table grows. */
+  chashtable_buckets_t *buckets;
+
+  struct {
+    pthread_mutex_t lock;
+    /** Number of entries whose hash selects this stripe. */
+    size_t length;
+  } __attribute__((aligned(64))) stripes[CHASHTABLE_STRIPES];
+
+  struct {
+    long count[2];
+  } __attribute__((aligned(64))) readers[CHASHTABLE_READER_SHARDS];
+  /** Which of `count` new readers increment. Flipped by grace periods. */
+  unsigned reader_index;
+
+  /** Retired pointers waiting for a grace period. */
+  pthread_mutex_t retired_lock;
+  chashtable_retired_t *retired;
+  size_t retired_length;
+  size_t retired_capacity;
+  /** Only one grace period at a time. */
+  pthread_mutex_t grace_lock;
+
+  hashtable_free_func_t free_func;
+  hashtable_hash_func_t hash_func;
+  const rcl_allocator_t *allocator;
+} chashtable_t;
+
+typedef struct s_chashtable_init {
+  /** Initial number of buckets; rounded up to a power of two. */
+  size_t capacity;
+  /** Called on values that are replaced, removed, or left at free time. */
+  hashtable_free_func_t free_func;
+  /** NULL means the default, `hashtable_hash_wyhash`. */
+  hashtable_hash_func_t hash_func;
+  /**
+   * Allocator for the table, its entries and keys. It is called from every
+   * writing thread, so it must be thread-safe. NULL means libc.
+   */
+  const rcl_allocator_t *allocator;
+} chashtable_init_t;
+
+/**
+ * A read section token, see `chashtable_read_begin`.
+ */
+typedef unsigned chashtable_guard_t;
+
+/**
+ * Create a new concurrent hashtable.
+ *
+ * @param init the initialization parameters for the hashtable
+ * @returns a new hashtable
+ */
+chashtable_t *chashtable_new_full(chashtable_init_t init);
+
+/**
+ * Create a new concurrent hashtable with the default capacity.
+ *
+ * @returns a new hashtable
+ */
+chashtable_t *chashtable_new(void);
+
+/**
+ * Free the hashtable, all of its keys and, if a free function was set, its
+ * values. No other thread may be using the table.
+ *
+ * @param self the hashtable to free
+ */
+void chashtable_free(chashtable_t *self);
+
+/**
+ * Free the hashtable and set the pointer to NULL.
+ *
+ * @param self a pointer to the hashtable to destroy
+ */
+void chashtable_destroy(chashtable_t **self);
+
+/**
+ * Start a read section. Until the matching `chashtable_read_end`, no entry or
+ * value this thread can see is freed, even if another thread replaces or
+ * removes it. Read sections are cheap but hold up reclamation, so keep them
+ * short. They nest, but a thread must not write to the table inside one, as a
+ * write may wait for every read section to end.
+ *
+ * @param self the hashtable
+ * @returns a token to pass to `chashtable_read_end`
+ */
+chashtable_guard_t chashtable_read_begin(chashtable_t *self);
+
+/**
+ * End a read section.
+ *
+ * @param self the hashtable
+ * @param guard the token `chashtable_read_begin` returned
+ */
+void chashtable_read_end(chashtable_t *self, chashtable_guard_t guard);
+
+/**
+ * Get a value from the hashtable. Never blocks. Must be called inside a read
+ * section, and the value may only be used until that section ends, since
+ * another thread may replace or remove it at any time.
+ *
+ * @param self the hashtable
+ * @param key the key to get the value for
+ * @returns the value associated with the key, or NULL
+ */
+void *chashtable_get(chashtable_t *self, const char *key);
+
+/**
+ * Check if a key exists in the hashtable. Never blocks.
+ *
+ * @param self the hashtable
+ * @param key the key to check for
+ * @returns true if the key exists
+ */
+bool chashtable_exists(chashtable_t *self, const char *key);
+
+/**
+ * Set a value in the hashtable, copying the key. A value it replaces is freed
+ * with the free function once no reader can see it.
+ *
+ * @param self the hashtable
+ * @param key the key to set the value for
+ * @param value the value
+ */
+void chashtable_set(chashtable_t *self, const char *key, void *value);
+
+/**
+ * Delete a key from the hashtable. The value is freed with the free function
+ * once no reader can see it.
+ *
+ * @param self the hashtable
+ * @param key the key to delete
+ * @returns true if the key existed and was deleted
+ */
+bool chashtable_delete(chashtable_t *self, const char *key);
+
+/**
+ * Get the number of entries. Only exact while no other thread is writing.
+ *
+ * @param self the hashtable
+ * @returns the number of entries
+ */
+size_t chashtable_length(chashtable_t *self);
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "rcl/allocator.h"
+#include "rcl/hashtable.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct s_hashset_entry {
+  char *key;
+  /** The full hash of `key`, checked before comparing keys and reused when
+   * the set grows or its keys are copied into another set. */
+  size_t hash;
+} hashset_entry_t;
+
+/**
+ * A set of string keys. It probes like a HASHTABLE_LAYOUT_LINEAR
+ * `hashtable_t` (Robin Hood placement, backward-shift removal) but its slots
+ * hold only a key and its hash, 16 bytes instead of 24 on 64-bit systems.
+ *
+ * All fields are private, except `entries` and `capacity`, which
+ * `hashset_foreach` reads.
+ */
+typedef struct s_hashset {
+  /** `capacity` slots; empty ones have a NULL key. NULL until the first
+   * insert. */
+  hashset_entry_t *entries;
+  size_t capacity;
+  size_t length;
+  hashtable_hash_func_t hash_func;
+  const rcl_allocator_t *allocator;
+} hashset_t;
+
+typedef struct s_hashset_init {
+  /** Initial number of slots; rounded up to a power of two. */
+  size_t capacity;
+  /** NULL means the default, `hashtable_hash_wyhash`. */
+  hashtable_hash_func_t hash_func;
+  /** Allocator for the set and its keys. NULL means libc. */
+  const rcl_allocator_t *allocator;
+} hashset_init_t;
+
+/**
+ * Create a new set.
+ *
+ * @param init the initialization parameters for the set
+ * @returns a new set
+ */
+hashset_t *hashset_new_full(hashset_init_t init);
+
+/**
+ * Create a new set with the default capacity.
+ *
+ * @returns a new set
+ */
+hashset_t *hashset_new(void);
+
+/**
+ * Free the set and all of its keys.
+ *
+ * @param self the set to free
+ */
+void hashset_free(hashset_t *self);
+
+/**
+ * Free the set and set the pointer to NULL.
+ *
+ * @param self a pointer to the set to destroy
+ */
+void hashset_destroy(hashset_t **self);
+
+/**
+ * Add a key to the set, copying it.
+ *
+ * @param self the set
+ * @param key the key to add
+ * @returns true if the key was added, false if it was already in the set
+ */
+bool hashset_insert(hashset_t *self, const char *key);
+
+/**
+ * Check if a key is in the set.
+ *
+ * @param self the set
+ * @param key the key to check for
+ * @returns true if the key is in the set
+ */
+bool hashset_contains(const hashset_t *self, const char *key);
+
+/**
+ * Remove a key from the set.
+ *
+ * @param self the set
+ * @param key the key to remove
+ * @returns true if the key was in the set and was removed
+ */
+bool hashset_remove(hashset_t *self, const char *key);
+
+/**
+ * Get the number of keys in the set.
+ *
+ * @param self the set
+ * @returns the number of keys
+ */
+size_t hashset_length(const hashset_t *self);
+
+/**
+ * Create a set of the keys in either `a` or `b`. It copies the bigger set's
+ * slots as they are and inserts only the keys of the smaller one.
+ *
+ * The sets of `hashset_union`, `hashset_intersection` and `hashset_difference`
+ * use `a`'s hash function and allocator. If `b` has the same hash function,
+ * its cached hashes are reused instead of hashing its keys again.
+ *
+ * @param a a set
+ * @param b another set
+ * @returns a new set
+ */
+hashset_t *hashset_union(const hashset_t *a, const hashset_t *b);
+
+/**
+ * Create a set of the keys in both `a` and `b`. It walks the smaller set and
+ * looks its keys up in the bigger one.
+ *
+ * @param a a set
+ * @param b another set
+ * @returns a new set
+ */
+hashset_t *hashset_intersection(const hashset_t *a, const hashset_t *b);
+
+/**
+ * Create a set of the keys in `a` but not in `b`. If `a` is the smaller set it
+ * walks `a` and looks its keys up in `b`; otherwise it copies `a` and removes
+ * the keys of `b` from the copy.
+ *
+ * @param a a set
+ * @param b the set of keys to leave out
+ * @returns a new set
+ */
+hashset_t *hashset_difference(const hashset_t *a, const hashset_t *b);
+
+/**
+ * Iterate over all the keys in the set, in no particular order.
+ *
+ * @param set the set to iterate over
+ * @param fn the code to run for each key, which is in `key`
+ */
+#define hashset_foreach(set, fn)                                               \
+  for (size_t i = 0; i < (set)->capacity; i++) {                               \
+    if ((set)->entries[i].key == NULL) {                                       \
+      continue;                                                                \
+    }                                                                          \
+    {                                                                          \
+      __attribute__((unused)) const char *key = (set)->entries[i].key;         \
+      fn                                                                       \
+    }                                                                          \
+  }
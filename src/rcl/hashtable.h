@@ -1,8 +1,15 @@
 #pragma once
 
+#include "rcl/allocator.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
+/**
+ * Marked removed items in older versions. The table no longer writes it (empty
+ * slots always have a NULL key); it is kept for code that checks for it.
+ */
 #ifndef HASHTABLE_TOMBSTONE_MARKER
 #define HASHTABLE_TOMBSTONE_MARKER ((void *)-1)
 #endif
@@ -19,16 +26,85 @@ typedef void (*hashtable_free_func_t)(void *ptr);
  * A hash function used to hash `hashtable_t` keys.
  *
  * @param key the key to be hashed
- * @returns a hased index for the given key. note this hash will be modulo'd
- * before being used to index the hashtable.
+ * @returns a hased index for the given key. note this hash will be masked to
+ * the table's (power of two) capacity before being used to index the
+ * hashtable, so its low bits should be well mixed.
  */
 typedef size_t (*hashtable_hash_func_t)(const char *key);
 
+/**
+ * Number of buckets in `hashtable_stats_t.probe_lengths`.
+ */
+#ifndef HASHTABLE_STATS_PROBE_LENGTHS
+#define HASHTABLE_STATS_PROBE_LENGTHS 16
+#endif
+
+/**
+ * Lookup counters, see `hashtable_set_counters`. These are only updated if rcl
+ * was built with `RCL_HASHTABLE_STATS` (meson option `hashtable_stats`), see
+ * `hashtable_stats_level`; otherwise lookups carry no bookkeeping at all.
+ * Several tables can share one, to count them together.
+ */
+typedef struct s_hashtable_counters {
+  /**
+   * Lookups by `hashtable_get`, `hashtable_exists` and `hashtable_get_many`.
+   */
+  size_t lookups;
+  /** Lookups that found their key. */
+  size_t hits;
+  /** Lookups that didn't. */
+  size_t misses;
+  /**
+   * Slots (groups of 16, for HASHTABLE_LAYOUT_SWISS) the lookups looked at;
+   * `probes / lookups` is the average. A well-mixed hash keeps it under 2.
+   */
+  size_t probes;
+} hashtable_counters_t;
+
+typedef struct s_hashtable_key_chunk hashtable_key_chunk_t;
+typedef struct s_hashtable_mapping hashtable_mapping_t;
+
 typedef struct s_item {
   char *key;
   void *value;
+  /** The full hash of `key`, checked before comparing keys and reused when
+   * the table grows. */
+  size_t hash;
 } item_t;
 
+/**
+ * How a hashtable arranges its slots. Every layout keeps its items in `items`
+ * (empty slots have a NULL key), so `hashtable_foreach` works with all of them;
+ * see `hashtable_items_end` for how many there are.
+ */
+typedef enum {
+  /**
+   * Linear probing over `items`, one slot at a time, with Robin Hood
+   * placement and backward-shift removal: probe lengths stay short and even,
+   * and removal leaves no tombstones.
+   */
+  HASHTABLE_LAYOUT_LINEAR,
+  /**
+   * Swiss-table style: a separate array of 1-byte control tags (7 hash bits
+   * or an empty/deleted state) is probed 16 slots at a time with SSE2, and
+   * items are only touched where the tag matches. Best for large tables,
+   * where linear probing takes a cache miss on every collision. Capacities
+   * are at least 16.
+   */
+  HASHTABLE_LAYOUT_SWISS,
+  /**
+   * After CPython's dict: `items` is a dense array the items are appended to,
+   * in insertion order, and a separate `index` of 4-byte positions into it is
+   * probed like the linear layout. Iterating only visits the items appended,
+   * in the order they were inserted, and a table takes 4 bytes per slot plus
+   * one item per entry instead of an item per slot. Removed items leave a hole
+   * until the items are compacted. Lookups take an extra indirection, and
+   * resizing only rebuilds the index, so `.incremental` doesn't apply. Holds
+   * at most 2^32 - 1 items.
+   */
+  HASHTABLE_LAYOUT_COMPACT,
+} hashtable_layout_e;
+
 typedef struct s_hashtable {
   item_t *items;
   size_t capacity;
@@ -36,23 +112,242 @@ typedef struct s_hashtable {
 
   hashtable_free_func_t free_func;
   hashtable_hash_func_t hash_func;
+
+  /**
+   * The allocator the table, its items and its keys come from. NULL means
+   * libc.
+   */
+  const rcl_allocator_t *allocator;
+
+  /** The table's layout. Fixed at creation. */
+  hashtable_layout_e layout;
+  /** HASHTABLE_LAYOUT_SWISS only: one control tag per slot. */
+  uint8_t *ctrl;
+  /**
+   * Number of deleted slots still taking up room. Always 0 for
+   * HASHTABLE_LAYOUT_LINEAR.
+   */
+  size_t tombstones;
+
+  /**
+   * HASHTABLE_LAYOUT_COMPACT only: one entry per slot, 0 for an empty slot or
+   * 1 + the position of its item in `items`.
+   */
+  uint32_t *index;
+  /**
+   * HASHTABLE_LAYOUT_COMPACT only: the number of `items` appended, holes left
+   * by removed items included, and the number `items` has room for.
+   */
+  size_t used;
+  size_t items_capacity;
+
+  /** See `hashtable_init_t.incremental`. */
+  bool incremental;
+  /**
+   * While an incremental resize is in progress, the previous `items` (and
+   * `ctrl`), holding the items not moved over yet. NULL otherwise.
+   */
+  item_t *old_items;
+  uint8_t *old_ctrl;
+  size_t old_capacity;
+  /** The next slot of `old_items` to move. */
+  size_t migrate_index;
+
+  /** See `hashtable_init_t.key_arena`. */
+  bool key_arena;
+  /** The chunks keys are copied into, newest first. */
+  hashtable_key_chunk_t *key_chunks;
+  /** Bytes of `key_chunks` taken up by keys, removed ones included. */
+  size_t key_bytes;
+  /** Bytes of `key_chunks` left behind by removed keys. */
+  size_t key_garbage;
+
+  /**
+   * See `hashtable_freeze`. While frozen, `items` holds exactly `length`
+   * items, each at the position the perfect hash gives its key, and
+   * `capacity` is `length`.
+   */
+  bool frozen;
+  /** The displacement of each of the perfect hash's `buckets`. */
+  uint32_t *displacements;
+  size_t buckets;
+
+  /**
+   * Tables from `hashtable_open_mapped`: the mapped file, which holds their
+   * values and, until they are loaded (see `hashtable_finish_resize`), their
+   * items. NULL otherwise.
+   */
+  hashtable_mapping_t *mapping;
+
+  /** Number of times the table grew, see `hashtable_stats_t.grows`. */
+  size_t grows;
+  /** See `hashtable_set_counters`. */
+  hashtable_counters_t *counters;
 } hashtable_t;
 
+typedef struct s_hashtable_init {
+  /**
+   * Initial number of slots, rounded up to a power of two. 0, the default,
+   * allocates none until the first insert; see `hashtable_reserve` to size a
+   * table for a known number of items.
+   */
+  size_t capacity;
+  /** See `hashtable_set_free_func`. */
+  hashtable_free_func_t free_func;
+  /**
+   * Hash function for keys. NULL means the default,
+   * `hashtable_hash_wyhash`.
+   */
+  hashtable_hash_func_t hash_func;
+  /** Allocator for the table, its items and its keys. NULL means libc. */
+  const rcl_allocator_t *allocator;
+  /** See `hashtable_layout_e`. Defaults to HASHTABLE_LAYOUT_LINEAR. */
+  hashtable_layout_e layout;
+  /**
+   * Resize incrementally. Instead of moving every item at once when the table
+   * grows, which stalls that one insert for as long as the table is big, the
+   * new arrays are allocated beside the old ones and every later set, remove
+   * or delete moves a few slots over. Lookups check both meanwhile. Trades a
+   * little throughput for a bounded worst-case insert. Ignored by
+   * HASHTABLE_LAYOUT_COMPACT.
+   */
+  bool incremental;
+  /**
+   * Copy keys into chunks of memory the table owns instead of allocating each
+   * one. For short keys the allocator's per-allocation overhead is more than
+   * the key itself, and freeing the table frees a few chunks instead of every
+   * key. Removed keys leave their bytes behind until the keys are compacted,
+   * which happens when the table is rebuilt or runs out of room in its chunks
+   * with at least half of them unused. Compacting moves keys, so with this
+   * option a key pointer from the table is only valid until the next insert.
+   * `hashtable_set_steal` copies the key it's given, and frees it.
+   */
+  bool key_arena;
+  /** See `hashtable_set_counters`. */
+  hashtable_counters_t *counters;
+} hashtable_init_t;
+
+/**
+ * A snapshot of how full a hashtable is and how well its keys are spread, see
+ * `hashtable_stats`.
+ */
+typedef struct s_hashtable_stats {
+  size_t length;
+  size_t capacity;
+  /** `length / capacity`, or 0 for a table with no slots. */
+  double load_factor;
+  /**
+   * Removed items still taking up room: deleted slots of
+   * HASHTABLE_LAYOUT_SWISS tables and holes in the items of
+   * HASHTABLE_LAYOUT_COMPACT ones. Always 0 for the other layouts.
+   */
+  size_t tombstones;
+  /**
+   * How many keys a lookup finds after looking at 1, 2, 3, ... slots (groups
+   * of 16, for HASHTABLE_LAYOUT_SWISS); the last bucket counts every longer
+   * probe too. For frozen tables every key is found after 1.
+   */
+  size_t probe_lengths[HASHTABLE_STATS_PROBE_LENGTHS];
+  /**
+   * How far the furthest key is from the slot (or group) its hash starts the
+   * probe at. Long clusters show here before they show in the averages.
+   */
+  size_t max_displacement;
+  /** Number of times inserts made the table grow, its first slots included. */
+  size_t grows;
+  /** A copy of the table's counters, if it has any. */
+  hashtable_counters_t counters;
+} hashtable_stats_t;
+
 /**
- * Create a new hashtable with the default capacity.
+ * The default hash function. A wyhash-style hash that reads the key eight bytes
+ * at a time.
  *
- * @returns a new hashtable with the default capacity
+ * @param key the key to hash
+ * @returns the hash of `key`
+ */
+size_t hashtable_hash_wyhash(const char *key);
+
+/**
+ * FNV-1a. Simple, but it processes the key one byte at a time. This was the
+ * default hash function before `hashtable_hash_wyhash`.
+ *
+ * @param key the key to hash
+ * @returns the hash of `key`
+ */
+size_t hashtable_hash_fnv1a(const char *key);
+
+/**
+ * `hashtable_hash_wyhash` keyed with a secret drawn from the OS's random
+ * source the first time it's used in a process. Without the secret, keys that
+ * collide can't be worked out ahead of time, so use it for keys that come
+ * from untrusted input: with an unkeyed hash, whoever sends the keys can pick
+ * ones that all land in the same slots, and each insert then probes past all
+ * the others. JSON objects use it.
+ *
+ * Hashes differ between processes; `hashtable_save` rehashes keys with
+ * `hashtable_hash_wyhash`, so saved images are unaffected.
+ *
+ * @param key the key to hash
+ * @returns the hash of `key`
+ */
+size_t hashtable_hash_seeded(const char *key);
+
+/**
+ * Hash arbitrary bytes with the same function as `hashtable_hash_wyhash`.
+ *
+ * @param data the bytes to hash
+ * @param length the number of bytes
+ * @returns the hash of the bytes
+ */
+size_t hashtable_hash_bytes(const void *data, size_t length);
+
+/**
+ * Get the smallest capacity that holds `length` items without growing.
+ *
+ * @param length the number of items
+ * @returns a power of two capacity
+ */
+size_t hashtable_capacity_for(size_t length);
+
+/**
+ * Get the number of leading `items` that may hold an item: every slot, or the
+ * ones appended so far for HASHTABLE_LAYOUT_COMPACT.
+ *
+ * @param self the hashtable
+ * @returns the number of `items` to visit
+ */
+static inline size_t hashtable_items_end(const hashtable_t *self) {
+  return self->layout == HASHTABLE_LAYOUT_COMPACT && !self->frozen
+             ? self->used
+             : self->capacity;
+}
+
+/**
+ * Create a new, empty hashtable. Its slots are only allocated on the first
+ * insert, starting small.
+ *
+ * @returns a new hashtable
  */
 hashtable_t *hashtable_new(void);
 
 /**
  * Create a new hashtable with a specific initial capacity.
  *
- * @param initial_capacity the initial capacity of the hashtable
+ * @param initial_capacity the initial capacity of the hashtable, see
+ * `hashtable_init_t.capacity`
  * @returns a new hashtable with the given initial capacity
  */
 hashtable_t *hashtable_new_with_capacity(size_t initial_capacity);
 
+/**
+ * Create a new hashtable.
+ *
+ * @param init the initialization parameters for the hashtable
+ * @returns a new hashtable
+ */
+hashtable_t *hashtable_new_full(hashtable_init_t init);
+
 /**
  * Free the hashtable and all of its values. If a free function has been set
  * with `hashtable_set_free_func`, it will be called on every value in the
@@ -79,6 +374,16 @@ void hashtable_destroy(hashtable_t **self);
  */
 void hashtable_set_free_func(hashtable_t *self, hashtable_free_func_t func);
 
+/**
+ * Set the hash function for the hashtable. Every key is hashed again with the
+ * new function and the table is rebuilt.
+ *
+ * @param self the hashtable to set the hash function for
+ * @param func the new hash function. NULL means the default,
+ * `hashtable_hash_wyhash`.
+ */
+void hashtable_set_hash_func(hashtable_t *self, hashtable_hash_func_t func);
+
 /**
  * Check if a key exists in the hashtable.
  *
@@ -98,14 +403,28 @@ bool hashtable_exists(hashtable_t *self, const char *key);
  */
 void *hashtable_get(hashtable_t *self, const char *key);
 
+/**
+ * Get the values of many keys at once. Same as calling `hashtable_get` on each
+ * key, but keys are looked up in batches: every key of a batch is hashed and
+ * the memory its lookup will touch is prefetched before any is resolved, so
+ * on tables much bigger than the cache the misses overlap instead of adding
+ * up.
+ *
+ * @param self the hashtable to get the values from
+ * @param keys the keys to get the values for
+ * @param count the number of keys
+ * @param values where to store the `count` values, NULL for missing keys
+ */
+void hashtable_get_many(hashtable_t *self, const char *const *keys,
+                        size_t count, void **values);
+
 /**
  * Set a value in the hashtable.
  *
  * WARNING: if you call set a value for a key that already exists in the
  * hashtable, the old value will be freed if a free function has been set for
- * this table. If you want to avoid this behavior, you can use
- * `hashtable_exists` to check if the key already exists before setting the
- * value.
+ * this table. If you want to avoid this behavior, use `hashtable_entry`, which
+ * finds or inserts the key and leaves its value to you.
  *
  * @param self the hashtable to set the value in
  * @param key the key to set the value for
@@ -113,13 +432,34 @@ void *hashtable_get(hashtable_t *self, const char *key);
  */
 void hashtable_set(hashtable_t *self, const char *key, void *value);
 
+/**
+ * Find the entry for `key`, inserting it with a NULL value if it doesn't exist,
+ * and return a pointer to its value. Takes a single probe, so get-or-create
+ * and counting don't need a `hashtable_exists`/`hashtable_get` first. The key
+ * is only copied when it is inserted. The old value is never freed; assign
+ * through the pointer to replace it.
+ *
+ * @code
+ * void **count = hashtable_entry(table, word, NULL);
+ * *count = (void *)((size_t)*count + 1);
+ * @endcode
+ *
+ * @param self the hashtable
+ * @param key the key to find or insert
+ * @param inserted if not NULL, set to true if the key was inserted
+ * @returns a pointer to the value of `key`, valid until the next insert or
+ * removal
+ */
+void **hashtable_entry(hashtable_t *self, const char *key, bool *inserted);
+
 /**
  * Set a value in the hashtable, stealing the key. This function is the same as
  * `hashtable_set`, but it takes ownership of the key pointer instead of copying
  * it. This means that the caller is no longer responsible for freeing the key,
  * and doing so will result in undefined behavior. This can be useful if you
  * want to avoid the overhead of copying the key string, but it also means that
- * you need to be careful to not free the key after calling this function.
+ * you need to be careful to not free the key after calling this function. The
+ * key must have been allocated with the table's allocator.
  *
  * @param self the hashtable to set the value in
  * @param key the key to set the value for. This pointer will be stolen by the
@@ -151,7 +491,128 @@ bool hashtable_remove(hashtable_t *self, const char *key, void **value);
 bool hashtable_delete(hashtable_t *self, const char *key);
 
 /**
- * Iterate over all the items in the hashtable.
+ * Make room for `length` items in total, so inserting up to that many doesn't
+ * grow the table.
+ *
+ * @param self the hashtable
+ * @param length the number of items to make room for
+ */
+void hashtable_reserve(hashtable_t *self, size_t length);
+
+/**
+ * Shrink the table to the smallest capacity that holds its items, freeing its
+ * slots altogether if it's empty. Useful for tables that are done growing, or
+ * that once held many more items.
+ *
+ * @param self the hashtable
+ */
+void hashtable_shrink_to_fit(hashtable_t *self);
+
+/**
+ * Freeze the table for lookups. Its items are rearranged by a minimal perfect
+ * hash (CHD-style hash and displace), so `hashtable_get` and
+ * `hashtable_exists` take a single probe and at most one key comparison, and
+ * the table keeps just one item per key plus 4 bytes per bucket of a few keys.
+ * Meant for tables that are built once and then only read.
+ *
+ * Replacing the value of an existing key keeps the table frozen. Anything that
+ * adds or removes keys, or changes the hash function, thaws it first, which
+ * rebuilds the table's layout. A frozen table's items are visited in no
+ * particular order, even with HASHTABLE_LAYOUT_COMPACT, and keep that order
+ * once thawed.
+ *
+ * @param self the hashtable
+ * @returns true if the table is frozen, false if two of its keys' hashes
+ * collide, which a perfect hash can't tell apart; the table is then left as
+ * it was
+ */
+bool hashtable_freeze(hashtable_t *self);
+
+/**
+ * Write the table to `path` as an image `hashtable_open_mapped` can map. The
+ * image is position-independent: the keys go in one blob, records refer to
+ * them by offset, and values are stored as fixed-size payloads. The items are
+ * laid out by a minimal perfect hash, as by `hashtable_freeze`, and hashed with
+ * `hashtable_hash_wyhash` whatever the table's hash function is. The file is
+ * written beside `path` and renamed over it, so processes that have the old
+ * one mapped are not disturbed.
+ *
+ * Images use the byte order and layout of the machine that wrote them.
+ *
+ * @param self the hashtable to save
+ * @param path the file to write
+ * @param value_size the number of bytes each value points to, which are
+ * copied into the image. 0 stores the value pointers themselves, for tables
+ * whose values are integers cast to pointers.
+ * @returns false if the file couldn't be written, or the keys' hashes collide
+ * (see `hashtable_freeze`)
+ */
+bool hashtable_save(hashtable_t *self, const char *path, size_t value_size);
+
+/**
+ * Map an image written by `hashtable_save`. Nothing is read up front: pages
+ * are loaded by the OS as lookups touch them, and shared with every other
+ * process that maps the same file.
+ *
+ * The table is frozen (see `hashtable_freeze`) and its values are either
+ * pointers to the payloads in the mapping, which is read-only, or the stored
+ * integers. `hashtable_get`, `hashtable_exists` and `hashtable_get_many`
+ * read the mapping directly; anything else, iterating included, first loads
+ * the items into memory, copying the keys. The mapping stays until
+ * `hashtable_free`.
+ *
+ * A malformed image never makes the table read outside the mapping. Opening
+ * checks that every section lies inside the file, and returns NULL if one
+ * doesn't. A record whose key lies outside the keys is a miss for lookups, and
+ * loading an image with such a record gives an empty table. Payloads and
+ * stored integers are returned as they are in the file, unchecked, and the
+ * file must not be truncated or rewritten in place while it is mapped
+ * (`hashtable_save` replaces it with a rename, which is safe).
+ *
+ * @param path the file to map
+ * @returns a new hashtable, or NULL if the file can't be mapped or isn't an
+ * image of this version and byte order
+ */
+hashtable_t *hashtable_open_mapped(const char *path);
+
+/**
+ * Measure how full `self` is and how well its keys are spread. Walks every
+ * item, so it takes as long as iterating the table. Finishes an incremental
+ * resize in progress first.
+ *
+ * @param self the hashtable
+ * @returns the table's statistics
+ */
+hashtable_stats_t hashtable_stats(hashtable_t *self);
+
+/**
+ * Count the lookups in `self` into `counters`, or stop counting them if it's
+ * NULL. Only counted if rcl was built with `RCL_HASHTABLE_STATS`.
+ *
+ * @param self the hashtable
+ * @param counters the counters to add to, which must outlive the table
+ */
+void hashtable_set_counters(hashtable_t *self, hashtable_counters_t *counters);
+
+/**
+ * Get the level of statistics this build of rcl collects.
+ *
+ * @returns 0 if `hashtable_counters_t` are never updated, 1 if they are
+ */
+int hashtable_stats_level(void);
+
+/**
+ * Finish an incremental resize in progress, moving every remaining item into
+ * the new arrays, and load the items of a table from `hashtable_open_mapped`.
+ * `hashtable_foreach` calls this first, so it only has to visit `items`.
+ *
+ * @param self the hashtable
+ */
+void hashtable_finish_resize(hashtable_t *self);
+
+/**
+ * Iterate over all the items in the hashtable. HASHTABLE_LAYOUT_COMPACT
+ * tables visit them in insertion order, others in no particular order.
  *
  * @param table the hashtable to iterate over
  * @param fn the function to call on each item in the hashtable
@@ -160,7 +621,11 @@ bool hashtable_delete(hashtable_t *self, const char *key);
  * `key` and `value` to access the current item in the hashtable
  */
 #define hashtable_foreach(table, fn)                                           \
-  for (size_t i = 0; i < table->capacity; i++) {                               \
+  for (size_t i = ((table)->old_items || (table)->mapping                     \
+                       ? hashtable_finish_resize(table)                        \
+                       : (void)0,                                              \
+                   0);                                                         \
+       i < hashtable_items_end(table); i++) {                                  \
     if (table->items[i].key == NULL ||                                         \
         table->items[i].key == HASHTABLE_TOMBSTONE_MARKER) {                   \
       continue;                                                                \
@@ -171,3 +636,242 @@ bool hashtable_delete(hashtable_t *self, const char *key);
       fn                                                                       \
     }                                                                          \
   }
+
+/**
+ * Key helpers for `HASHTABLE_OF`. Integer keys: `hashtable_hash_int` and
+ * `hashtable_eq_int`.
+ *
+ * @param key the key to hash
+ * @returns the hash of `key`
+ */
+static inline size_t hashtable_hash_int(uint64_t key) {
+  // MurmurHash3's finalizer: every input bit affects the low bits.
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ull;
+  key ^= key >> 33;
+  return (size_t)key;
+}
+
+#define hashtable_eq_int(a, b) ((a) == (b))
+
+/**
+ * Key helpers for `HASHTABLE_OF`. Fixed-size binary keys (structs, arrays,
+ * floats) are hashed and compared byte by byte, so any padding in them must
+ * be zeroed.
+ */
+#define hashtable_hash_fixed(key) hashtable_hash_bytes(&(key), sizeof(key))
+#define hashtable_eq_fixed(a, b) (memcmp(&(a), &(b), sizeof(a)) == 0)
+
+/**
+ * A length-delimited string key for `HASHTABLE_OF`. The map stores the
+ * pointer and length, not a copy of the bytes, so they must outlive the entry.
+ * Use with `hashtable_hash_str` and `hashtable_eq_str`.
+ */
+typedef struct {
+  const char *data;
+  size_t length;
+} hashtable_str_t;
+
+/**
+ * Make a `hashtable_str_t` from a NUL-terminated string.
+ *
+ * @param str the string
+ * @returns a key for `str`, without the NUL
+ */
+static inline hashtable_str_t hashtable_str(const char *str) {
+  return (hashtable_str_t){.data = str, .length = strlen(str)};
+}
+
+static inline size_t hashtable_hash_str(hashtable_str_t key) {
+  return hashtable_hash_bytes(key.data, key.length);
+}
+
+static inline bool hashtable_eq_str(hashtable_str_t a, hashtable_str_t b) {
+  return a.length == b.length && memcmp(a.data, b.data, a.length) == 0;
+}
+
+/**
+ * Define a type-specialized hashtable, `name_t`, mapping keys of type `K` to
+ * values of type `V`. Keys and values are stored directly in the slots, so
+ * there is no allocation per entry, and `hash_fn(key)` and `eq_fn(a, b)`
+ * (functions or macros) are inlined instead of called through a pointer.
+ * Probing is Robin Hood with backward-shift removal, as in `hashtable_t`.
+ *
+ * Generated functions, all `static inline`:
+ *
+ * - `name_t *name_new(const rcl_allocator_t *allocator)`: an empty map;
+ *   nothing else is allocated until the first insert. NULL means libc.
+ * - `void name_free(name_t *self)`
+ * - `V *name_get(name_t *self, K key)`: a pointer to the value in its slot,
+ *   valid until the next insert or removal, or NULL.
+ * - `bool name_exists(name_t *self, K key)`
+ * - `bool name_set(name_t *self, K key, V value)`: returns true if the key is
+ *   new, false if its value was replaced.
+ * - `bool name_remove(name_t *self, K key, V *value)`: stores the removed
+ *   value in `value` unless it's NULL.
+ *
+ * Keys and values are plain data; the map never frees them.
+ *
+ * @code
+ * HASHTABLE_OF(ids, uint64_t, double, hashtable_hash_int, hashtable_eq_int)
+ *
+ * ids_t *map = ids_new(NULL);
+ * ids_set(map, 42, 1.5);
+ * double *value = ids_get(map, 42);
+ * ids_free(map);
+ * @endcode
+ *
+ * @param name prefix for the generated type and functions
+ * @param K the key type
+ * @param V the value type
+ * @param hash_fn a function or macro taking a `K` and returning a `size_t`
+ * @param eq_fn a function or macro taking two `K`s and returning whether
+ * they're equal
+ */
+#define HASHTABLE_OF(name, K, V, hash_fn, eq_fn)                               \
+  typedef struct {                                                             \
+    K key;                                                                     \
+    V value;                                                                   \
+    /* The key's hash, never 0; 0 marks an empty slot. */                      \
+    size_t hash;                                                               \
+  } name##_slot_t;                                                             \
+                                                                               \
+  typedef struct {                                                             \
+    name##_slot_t *slots;                                                      \
+    size_t capacity;                                                           \
+    size_t length;                                                             \
+    const rcl_allocator_t *allocator;                                          \
+  } name##_t;                                                                  \
+                                                                               \
+  static inline name##_t *name##_new(const rcl_allocator_t *allocator) {       \
+    name##_t *self = rcl_alloc(allocator, sizeof(*self));                      \
+    *self = (name##_t){.allocator = allocator};                                \
+    return self;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline void name##_free(name##_t *self) {                             \
+    if (self) {                                                                \
+      rcl_free(self->allocator, self->slots);                                  \
+      rcl_free(self->allocator, self);                                         \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline size_t name##_hash(K key) {                                    \
+    size_t h = (hash_fn(key));                                                 \
+    return h ? h : 1;                                                          \
+  }                                                                            \
+                                                                               \
+  static inline name##_slot_t *name##_find(name##_t *self, K key, size_t h) {  \
+    if (self->length == 0)                                                     \
+      return NULL;                                                             \
+    size_t mask = self->capacity - 1;                                          \
+    size_t index = h & mask;                                                   \
+    for (size_t dist = 0;; dist++) {                                           \
+      name##_slot_t *slot = &self->slots[index];                               \
+      if (!slot->hash || ((index - slot->hash) & mask) < dist)                 \
+        return NULL;                                                           \
+      if (slot->hash == h && (eq_fn(slot->key, key)))                          \
+        return slot;                                                           \
+      index = (index + 1) & mask;                                              \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline void name##_place(name##_slot_t *slots, size_t capacity,       \
+                                  name##_slot_t slot) {                        \
+    size_t mask = capacity - 1;                                                \
+    size_t index = slot.hash & mask;                                           \
+    for (size_t dist = 0;; dist++) {                                           \
+      if (!slots[index].hash) {                                                \
+        slots[index] = slot;                                                   \
+        return;                                                                \
+      }                                                                        \
+      size_t other = (index - slots[index].hash) & mask;                       \
+      if (other < dist) {                                                      \
+        name##_slot_t tmp = slots[index];                                      \
+        slots[index] = slot;                                                   \
+        slot = tmp;                                                            \
+        dist = other;                                                          \
+      }                                                                        \
+      index = (index + 1) & mask;                                              \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline void name##_grow(name##_t *self) {                             \
+    size_t capacity = self->capacity ? self->capacity * 2 : 16;                \
+    name##_slot_t *slots =                                                     \
+        rcl_calloc(self->allocator, capacity, sizeof(*slots));                 \
+    for (size_t i = 0; i < self->capacity; i++) {                              \
+      if (self->slots[i].hash)                                                 \
+        name##_place(slots, capacity, self->slots[i]);                         \
+    }                                                                          \
+    rcl_free(self->allocator, self->slots);                                    \
+    self->slots = slots;                                                       \
+    self->capacity = capacity;                                                 \
+  }                                                                            \
+                                                                               \
+  static inline V *name##_get(name##_t *self, K key) {                         \
+    name##_slot_t *slot = name##_find(self, key, name##_hash(key));            \
+    return slot ? &slot->value : NULL;                                         \
+  }                                                                            \
+                                                                               \
+  static inline bool name##_exists(name##_t *self, K key) {                    \
+    return name##_find(self, key, name##_hash(key)) != NULL;                   \
+  }                                                                            \
+                                                                               \
+  static inline bool name##_set(name##_t *self, K key, V value) {              \
+    size_t h = name##_hash(key);                                               \
+    name##_slot_t *slot = name##_find(self, key, h);                           \
+    if (slot) {                                                                \
+      slot->value = value;                                                     \
+      return false;                                                            \
+    }                                                                          \
+    if ((self->length + 1) * 10 >= self->capacity * 7)                         \
+      name##_grow(self);                                                       \
+    name##_place(self->slots, self->capacity,                                  \
+                 (name##_slot_t){.key = key, .value = value, .hash = h});      \
+    self->length++;                                                            \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline bool name##_remove(name##_t *self, K key, V *value) {          \
+    name##_slot_t *slot = name##_find(self, key, name##_hash(key));            \
+    if (!slot)                                                                 \
+      return false;                                                            \
+    if (value)                                                                 \
+      *value = slot->value;                                                    \
+    size_t mask = self->capacity - 1;                                          \
+    size_t index = (size_t)(slot - self->slots);                               \
+    size_t next = (index + 1) & mask;                                          \
+    while (self->slots[next].hash &&                                           \
+           ((next - self->slots[next].hash) & mask) != 0) {                    \
+      self->slots[index] = self->slots[next];                                  \
+      index = next;                                                            \
+      next = (next + 1) & mask;                                                \
+    }                                                                          \
+    self->slots[index].hash = 0;                                               \
+    self->length--;                                                            \
+    return true;                                                               \
+  }
+
+/**
+ * Iterate over all the entries of a `HASHTABLE_OF` map.
+ *
+ * @param table the map to iterate over
+ * @param fn the function to call on each entry
+ *
+ * @note the function `fn` should be a block of code that uses the variables
+ * `key` (a copy of the key) and `value` (a pointer to the value in its slot)
+ */
+#define hashtable_of_foreach(table, fn)                                        \
+  for (size_t i = 0; i < (table)->capacity; i++) {                             \
+    if (!(table)->slots[i].hash) {                                             \
+      continue;                                                                \
+    }                                                                          \
+    {                                                                          \
+      __attribute__((unused)) __auto_type key = (table)->slots[i].key;         \
+      __attribute__((unused)) __auto_type value = &(table)->slots[i].value;    \
+      fn                                                                       \
+    }                                                                          \
+  }
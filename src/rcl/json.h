@@ -1,7 +1,9 @@
 #pragma once
 
+#include "rcl/allocator.h"
 #include "rcl/array.h"
 #include "rcl/hashtable.h"
+#include <stdint.h>
 
 #ifndef RCL_JSON_ASSERT_GETS
 #define RCL_JSON_ASSERT_GETS 1
@@ -10,6 +12,10 @@
 #define out *
 #define set_out_value(ptr, val) do { if ((ptr)) *(ptr) = (val); } while (0)
 
+/**
+ * A parse error. Errors always come from the libc allocator, regardless of the
+ * allocator used for the parse, since they are handed to the caller.
+ */
 typedef struct json_error_s {
   char *message;
   size_t col;
@@ -30,6 +36,18 @@ typedef enum {
 
 typedef struct json_value_s {
   json_value_type_e type;
+  /**
+   * Numbers parsed with `lazy_numbers` only: the length of `number_text` and
+   * whether `value.number` holds its converted value yet. Use the getters
+   * rather than reading `value.number` directly.
+   */
+  uint32_t number_length : 31;
+  uint32_t number_converted : 1;
+  /**
+   * The allocator this node (and its string or container) came from. NULL
+   * means libc. `json_value_free` uses it to release the node.
+   */
+  const rcl_allocator_t *allocator;
   union {
     bool boolean;
     double number;
@@ -37,6 +55,11 @@ typedef struct json_value_s {
     array_t *array;
     hashtable_t *object;
   } value;
+  /**
+   * Numbers parsed with `lazy_numbers` only: the number's text in the source.
+   * Not null-terminated. NULL for every other node.
+   */
+  const char *number_text;
 } json_value_t;
 
 bool json_parse_safe(const char *src, json_value_t out *result,
@@ -49,7 +72,215 @@ void json_value_destroy(json_value_t **ptr);
 
 void json_dump(json_value_t *val, int indent_size);
 
+#ifndef JSON_PARSER_DEFAULT_MAX_RETAINED
+#define JSON_PARSER_DEFAULT_MAX_RETAINED (8 * 1024 * 1024)
+#endif
+
+/**
+ * A reusable parsing context. A parser owns every node, string and container of
+ * the trees it returns and keeps that memory around between parses, so parsing
+ * similarly shaped inputs in a loop does almost no allocator calls.
+ *
+ * Trees returned by a parser are only valid until the next call to
+ * `json_parser_parse`, `json_parser_reset` or `json_parser_free`. They must be
+ * treated as read-only and must NOT be freed with `json_value_free`.
+ */
+typedef struct json_parser_s json_parser_t;
+
+typedef struct json_parser_init_s {
+  /**
+   * Upper bound, in bytes, on the memory the parser keeps between parses. If a
+   * parse leaves the parser holding more than this, everything it holds is
+   * released on the next reset. Use `SIZE_MAX` to never release memory; 0
+   * means `JSON_PARSER_DEFAULT_MAX_RETAINED`.
+   */
+  size_t max_retained;
+  /** Allocator for everything the parser holds. NULL means libc. */
+  const rcl_allocator_t *allocator;
+} json_parser_init_t;
+
+/**
+ * Create a new parser context.
+ *
+ * @param init the initialization parameters for the parser.
+ * @returns a new parser.
+ */
+json_parser_t *json_parser_new_full(json_parser_init_t init);
+
+#define json_parser_new(...)                                                   \
+  json_parser_new_full((json_parser_init_t){                                   \
+      .max_retained = JSON_PARSER_DEFAULT_MAX_RETAINED, __VA_ARGS__})
+
+/**
+ * Free a parser and every tree it has returned.
+ *
+ * @param self the parser to free.
+ */
+void json_parser_free(json_parser_t *self);
+
+/**
+ * Free a parser and set the pointer to NULL.
+ *
+ * @param self a pointer to the parser to destroy.
+ */
+void json_parser_destroy(json_parser_t **self);
+
+/**
+ * Invalidate the last tree returned by the parser. This runs in constant time:
+ * nodes, strings and containers are recycled lazily by the next parse. If the
+ * parser holds more than `max_retained` bytes, its memory is released instead.
+ *
+ * @param self the parser to reset.
+ */
+void json_parser_reset(json_parser_t *self);
+
+/**
+ * Parse `src` using the parser's memory. This implicitly resets the parser, so
+ * the tree returned by the previous call is no longer valid.
+ *
+ * @param self the parser to use.
+ * @param src the JSON string to parse.
+ * @param result where to store the root of the parsed tree. The tree is owned
+ * by the parser.
+ * @param error where to store a parse error, if any. The error is owned by the
+ * caller and must be freed with `json_error_free`.
+ * @returns true on success, false on a parse error.
+ */
+bool json_parser_parse(json_parser_t *self, const char *src,
+                       json_value_t out *result, json_error_t out *error);
+
+/**
+ * Get the number of bytes currently retained by the parser.
+ *
+ * @param self the parser.
+ * @returns an estimate of the memory the parser holds, in bytes.
+ */
+size_t json_parser_retained(json_parser_t *self);
+
+/**
+ * Statistics about a single parse. These are only collected if rcl was built
+ * with `RCL_JSON_STATS` (meson option `json_stats`); otherwise every field is
+ * left at zero and the parser carries no bookkeeping at all. See
+ * `json_parse_stats_level`.
+ */
+typedef struct json_parse_stats_s {
+  /** Number of nodes created, indexed by `json_value_type_e`. */
+  size_t nodes[JSON_VALUE_TYPE_OBJECT + 1];
+  /** Deepest array/object nesting. A scalar root has depth 0. */
+  size_t max_depth;
+  /** Decoded bytes of string values and object keys, without terminators. */
+  size_t string_bytes;
+  /** Number of escape sequences in string values and object keys. */
+  size_t escapes;
+  /** Number of times an object's hashtable had to grow. */
+  size_t hashtable_grows;
+  /** Number of times an array's buffer had to be reallocated. */
+  size_t array_reallocs;
+  /** Number of allocator calls made by the parse, excluding errors. */
+  size_t allocations;
+
+  /*
+   * Cycles spent in each stage of the parse. Only collected if `RCL_JSON_STATS`
+   * is 2 or more (meson option `json_stats=cycles`). These use the CPU's time
+   * stamp counter where available (`rdtsc`, `cntvct_el0`) and nanoseconds
+   * otherwise, so only compare them against each other.
+   */
+
+  /** Skipping whitespace and classifying tokens. */
+  unsigned long long lex_cycles;
+  /** Finding the end of strings and decoding them. */
+  unsigned long long string_cycles;
+  /** Converting numbers. */
+  unsigned long long number_cycles;
+  /** Allocating nodes and inserting them into containers. */
+  unsigned long long build_cycles;
+  /** Counting container children ahead of the parse. See `prescan`. */
+  unsigned long long prescan_cycles;
+} json_parse_stats_t;
+
+/**
+ * Get the level of statistics this build of rcl collects.
+ *
+ * @returns 0 if `json_parse_stats_t` is never filled in, 1 if counters are
+ * collected and 2 if stage cycle counts are collected too.
+ */
+int json_parse_stats_level(void);
+
+typedef struct json_parse_options_s {
+  /**
+   * Parser context to allocate the tree from, or NULL to allocate every node
+   * on its own. See `json_parser_parse`.
+   */
+  json_parser_t *parser;
+  /** Where to store statistics about the parse, or NULL. */
+  json_parse_stats_t *stats;
+  /**
+   * Allocator for the nodes, strings and containers of the tree, or NULL for
+   * libc. Ignored when `parser` is set, since the parser's allocator is used.
+   */
+  const rcl_allocator_t *allocator;
+  /**
+   * Count the direct children of every array and object in a quick pass over
+   * `src` before parsing, so each container is allocated at its final size
+   * instead of growing. Worth it for large containers; small documents are
+   * faster without it.
+   */
+  bool prescan;
+  /**
+   * Don't convert numbers while parsing. Each number node keeps a pointer to
+   * its text in `src` instead, which is converted (and cached) by the first
+   * `json_value_get_double` or `json_value_get_int64` call. `src` must outlive
+   * the tree. See `json_value_get_number_text`.
+   *
+   * Since the first get writes the converted value into the node, getters
+   * modify a lazy tree: threads sharing one must lock around number gets (or
+   * convert every number before sharing it). Trees parsed without this option
+   * can be read from any number of threads at once.
+   */
+  bool lazy_numbers;
+} json_parse_options_t;
+
+/**
+ * Parse `src` with the given options. `json_parse_safe` and
+ * `json_parser_parse` are shorthands for this function.
+ *
+ * @param src the JSON string to parse.
+ * @param result where to store the root of the parsed tree.
+ * @param error where to store a parse error, if any.
+ * @param options the parse options.
+ * @returns true on success, false on a parse error.
+ */
+bool json_parse_full(const char *src, json_value_t out *result,
+                     json_error_t out *error, json_parse_options_t options);
+
+#define json_parse(src, result, error, ...)                                    \
+  json_parse_full((src), (result), (error),                                    \
+                  (json_parse_options_t){.parser = NULL, __VA_ARGS__})
+
 double json_value_get_double(json_value_t *self);
+
+/**
+ * Get a number as a 64-bit integer. Fractions are truncated and values out of
+ * range saturate. Integers parsed with `lazy_numbers` are converted exactly,
+ * even beyond 2^53.
+ *
+ * @param self a number node.
+ * @returns the number as an integer.
+ */
+int64_t json_value_get_int64(json_value_t *self);
+
+/**
+ * Get the source text of a number parsed with `lazy_numbers`, e.g. to write it
+ * back out exactly as it was read.
+ *
+ * @param self a number node.
+ * @param length where to store the length of the text. The text is NOT
+ * null-terminated.
+ * @returns a pointer into the parsed source, or NULL if the number was
+ * converted while parsing.
+ */
+const char *json_value_get_number_text(json_value_t *self,
+                                       size_t *length);
 bool json_value_get_bool(json_value_t *self);
 char *json_value_get_string(json_value_t *self);
 array_t *json_value_get_array(json_value_t *self);
@@ -1,18 +1,29 @@
 #pragma once
 
+#include "rcl/allocator.h"
 #include <stddef.h>
 
 typedef struct s_string {
   size_t length;
   size_t capacity;
   char *data;
+  /** The allocator the string and its data come from. NULL means libc. */
+  const rcl_allocator_t *allocator;
 } string_t;
 
 string_t *string_new(const char *str);
 
+/**
+ * Create a new string_t object from a copy of the given string, using
+ * `allocator` for the string and all of its future growth. NULL means libc.
+ */
+string_t *string_new_with_allocator(const char *str,
+                                    const rcl_allocator_t *allocator);
+
 /**
  * Create a new string_t object from a given string. This function will use the
  * given string as the internal buffer without copying it, then set it to NULL.
+ * The buffer must have been allocated with libc's `malloc`.
  */
 string_t *string_new_steal(char **str);
 
@@ -10,18 +10,29 @@ string_t *string_new_steal(char **str) {
   self->length = strlen(*str);
   self->capacity = self->length;
   self->data = *str;
+  self->allocator = NULL;
   *str = NULL;
   return self;
 }
 
 string_t *string_new(const char *str) {
-  char *temp = strdup(str);
-  return string_new_steal(&temp);
+  return string_new_with_allocator(str, NULL);
+}
+
+string_t *string_new_with_allocator(const char *str,
+                                    const rcl_allocator_t *allocator) {
+  string_t *self = rcl_alloc(allocator, sizeof(*self));
+  self->length = strlen(str);
+  self->capacity = self->length;
+  self->data = rcl_strdup(allocator, str);
+  self->allocator = allocator;
+  return self;
 }
 
 void string_free(string_t *self) {
-  free(self->data);
-  free(self);
+  const rcl_allocator_t *allocator = self->allocator;
+  rcl_free(allocator, self->data);
+  rcl_free(allocator, self);
 }
 
 void string_destroy(string_t **self) {
@@ -35,7 +46,7 @@ void string_destroy(string_t **self) {
 static inline void string_ensure_capacity(string_t *self, size_t minimum) {
   if (self->capacity < minimum) {
     self->capacity = MAX(self->capacity * 2, minimum);
-    self->data = realloc(self->data, self->capacity);
+    self->data = rcl_realloc(self->allocator, self->data, self->capacity);
   }
 }
 
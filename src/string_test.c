@@ -124,6 +124,21 @@ static void test_string_reverse(void) {
   string_free(s);
 }
 
+static void test_string_allocator(void) {
+  rcl_counting_allocator_t counter;
+  rcl_counting_allocator_init(&counter, NULL);
+
+  string_t *s = string_new_with_allocator("hello", &counter.allocator);
+  string_append_str(s, " world, this needs to grow");
+  string_prepend_str(s, ">> ");
+  TEST_ASSERT_EQUAL_STRING(">> hello world, this needs to grow", s->data);
+  TEST_ASSERT_EQUAL_size_t(2, counter.allocations);
+  TEST_ASSERT_TRUE(counter.reallocations > 0);
+
+  string_free(s);
+  TEST_ASSERT_EQUAL_size_t(0, counter.live_bytes);
+}
+
 int main(void) {
   UNITY_BEGIN();
 
@@ -135,6 +150,7 @@ int main(void) {
   RUN_TEST(stress_test);
   RUN_TEST(test_string_clear);
   RUN_TEST(test_string_reverse);
+  RUN_TEST(test_string_allocator);
 
   return UNITY_END();
 }